@@ -0,0 +1,568 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "AdaptiveRadixTreeFile.hpp"
+
+#include <emmintrin.h>
+
+#include <cstddef>
+#include <algorithm>
+
+uint64_t AdaptiveRadixTreeFile::BodySize(uint8_t type) {
+	const static uint64_t sizes[] = {sizeof(Node4), sizeof(Node16),
+		sizeof(Node48), sizeof(Node256)};
+	return sizes[type];
+}
+
+uint64_t AdaptiveRadixTreeFile::Capacity(uint8_t type) {
+	const static uint64_t capacities[] = {4, 16, 48, 256};
+	return capacities[type];
+}
+
+int AdaptiveRadixTreeFile::Compare(const uint8_t* a, uint32_t aLength,
+		const uint8_t* b, uint32_t bLength) {
+	const int c = memcmp(a, b, std::min(aLength, bLength));
+	if(c)
+		return c;
+	return aLength<bLength ? -1 : aLength>bLength;
+}
+
+
+
+uint64_t* AdaptiveRadixTreeFile::FindChild(Node* node, uint8_t byte) {
+	switch(node->type) {
+		case NODE4: {
+			Node4* n = (Node4*)node;
+			for(uint64_t i=0; i<n->count; ++i)
+				if(n->keys[i] == byte)
+					return n->children+i;
+			return NULL;
+		}
+		case NODE16: {
+			Node16* n = (Node16*)node;
+			const __m128i keys = _mm_loadu_si128((const __m128i*)n->keys);
+			const uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys,
+						_mm_set1_epi8(byte))) & ((1u<<n->count)-1);
+			return mask ? n->children+__builtin_ctz(mask) : NULL;
+		}
+		case NODE48: {
+			Node48* n = (Node48*)node;
+			const uint8_t i = n->index[byte];
+			return i==emptyIndex ? NULL : n->children+i;
+		}
+		default: {
+			Node256* n = (Node256*)node;
+			return n->children[byte]==empty ? NULL : n->children+byte;
+		}
+	}
+}
+
+uint64_t* AdaptiveRadixTreeFile::NextChild(Node* node, int32_t after,
+		uint8_t& byte) {
+	switch(node->type) {
+		case NODE4: {
+			Node4* n = (Node4*)node;
+			for(uint64_t i=0; i<n->count; ++i)
+				if(n->keys[i] > after) {
+					byte = n->keys[i];
+					return n->children+i;
+				}
+			return NULL;
+		}
+		case NODE16: {
+			Node16* n = (Node16*)node;
+			uint32_t mask = (1u<<n->count)-1;
+			if(after >= 0) {
+				// unsigned compare through signed one with flipped top bit
+				const __m128i flip = _mm_set1_epi8((char)0x80);
+				const __m128i keys = _mm_xor_si128(flip,
+						_mm_loadu_si128((const __m128i*)n->keys));
+				mask &= _mm_movemask_epi8(_mm_cmpgt_epi8(keys,
+							_mm_set1_epi8((char)(after ^ 0x80))));
+			}
+			if(mask == 0)
+				return NULL;
+			const uint32_t i = __builtin_ctz(mask);
+			byte = n->keys[i];
+			return n->children+i;
+		}
+		case NODE48: {
+			Node48* n = (Node48*)node;
+			for(int32_t b=after+1; b<256; ++b)
+				if(n->index[b] != emptyIndex) {
+					byte = b;
+					return n->children+n->index[b];
+				}
+			return NULL;
+		}
+		default: {
+			Node256* n = (Node256*)node;
+			for(int32_t b=after+1; b<256; ++b)
+				if(n->children[b] != empty) {
+					byte = b;
+					return n->children+b;
+				}
+			return NULL;
+		}
+	}
+}
+
+void AdaptiveRadixTreeFile::AddChild(Node* node, uint8_t byte, uint64_t child) {
+	switch(node->type) {
+		case NODE4:
+		case NODE16: {
+			uint8_t* keys;
+			uint64_t* children;
+			if(node->type == NODE4) {
+				keys = ((Node4*)node)->keys;
+				children = ((Node4*)node)->children;
+			} else {
+				keys = ((Node16*)node)->keys;
+				children = ((Node16*)node)->children;
+			}
+			uint64_t i = std::lower_bound(keys, keys+node->count, byte) - keys;
+			memmove(keys+i+1, keys+i, node->count-i);
+			memmove(children+i+1, children+i, (node->count-i)*sizeof(uint64_t));
+			keys[i] = byte;
+			children[i] = child;
+			break;
+		}
+		case NODE48: {
+			Node48* n = (Node48*)node;
+			uint8_t i = 0;
+			while(n->children[i] != empty)
+				++i;
+			n->children[i] = child;
+			n->index[byte] = i;
+			break;
+		}
+		default:
+			((Node256*)node)->children[byte] = child;
+	}
+	++node->count;
+}
+
+void AdaptiveRadixTreeFile::RemoveChild(Node* node, uint8_t byte) {
+	switch(node->type) {
+		case NODE4:
+		case NODE16: {
+			uint8_t* keys;
+			uint64_t* children;
+			if(node->type == NODE4) {
+				keys = ((Node4*)node)->keys;
+				children = ((Node4*)node)->children;
+			} else {
+				keys = ((Node16*)node)->keys;
+				children = ((Node16*)node)->children;
+			}
+			uint64_t i = std::lower_bound(keys, keys+node->count, byte) - keys;
+			memmove(keys+i, keys+i+1, node->count-i-1);
+			memmove(children+i, children+i+1, (node->count-i-1)*sizeof(uint64_t));
+			break;
+		}
+		case NODE48: {
+			Node48* n = (Node48*)node;
+			n->children[n->index[byte]] = empty;
+			n->index[byte] = emptyIndex;
+			break;
+		}
+		default:
+			((Node256*)node)->children[byte] = empty;
+	}
+	--node->count;
+}
+
+
+
+uint64_t AdaptiveRadixTreeFile::NewLeaf(const uint8_t* key, uint32_t length,
+		uint64_t value) {
+	const uint64_t link = allocator->Allocate(offsetof(Leaf, key) + length);
+	Leaf* leaf = GetLeaf(link);
+	leaf->value = value;
+	leaf->length = length;
+	memcpy(leaf->key, key, length);
+	return link | 1;
+}
+
+uint64_t AdaptiveRadixTreeFile::NewNode(uint8_t type, uint32_t prefixLength) {
+	const uint64_t link = allocator->Allocate(BodySize(type) + prefixLength);
+	Node* node = GetNode(link);
+	memset(node, 0, BodySize(type));
+	node->type = type;
+	node->prefixLength = prefixLength;
+	node->leaf = empty;
+	if(type == NODE48) {
+		memset(((Node48*)node)->index, emptyIndex, 256);
+		std::fill_n(((Node48*)node)->children, 48, empty);
+	} else if(type == NODE256) {
+		std::fill_n(((Node256*)node)->children, 256, empty);
+	}
+	return link;
+}
+
+uint64_t AdaptiveRadixTreeFile::Convert(uint64_t link, uint8_t type,
+		uint32_t prefixLength) {
+	const uint64_t copy = NewNode(type, prefixLength);
+	Node* from = GetNode(link);
+	Node* to = GetNode(copy);
+	to->leaf = from->leaf;
+	memcpy(Prefix(to)+prefixLength-from->prefixLength, Prefix(from),
+			from->prefixLength);
+	uint8_t byte;
+	for(uint64_t* child=NextChild(from, -1, byte); child;
+			child=NextChild(from, byte, byte))
+		AddChild(to, byte, *child);
+	return copy;
+}
+
+void AdaptiveRadixTreeFile::AttachLeaf(uint64_t link, uint64_t leaf,
+		uint32_t depth) {
+	const Leaf* l = GetLeaf(leaf);
+	Node* node = GetNode(link);
+	if(l->length == depth)
+		node->leaf = leaf;
+	else
+		AddChild(node, l->key[depth], leaf);
+}
+
+void AdaptiveRadixTreeFile::Shrink(uint64_t slot) {
+	const uint64_t link = Slot(slot);
+	Node* node = GetNode(link);
+	if(node->count == 0) {
+		Slot(slot) = node->leaf;
+		allocator->Free(link);
+	} else if(node->count == 1 && node->leaf == empty) {
+		// merge node with its only child
+		uint8_t byte;
+		const uint64_t child = *NextChild(node, -1, byte);
+		if(IsLeaf(child)) {
+			Slot(slot) = child;
+		} else {
+			const uint32_t prefixLength = node->prefixLength;
+			const uint64_t merged = Convert(child, GetNode(child)->type,
+					prefixLength + 1 + GetNode(child)->prefixLength);
+			uint8_t* prefix = Prefix(GetNode(merged));
+			memcpy(prefix, Prefix(GetNode(link)), prefixLength);
+			prefix[prefixLength] = byte;
+			allocator->Free(child);
+			Slot(slot) = merged;
+		}
+		allocator->Free(link);
+	} else if(node->type != NODE4 && node->count <= Capacity(node->type-1)*3/4) {
+		// shrinks with margin to not convert back and forth at one size
+		const uint64_t smaller = Convert(link, node->type-1, node->prefixLength);
+		allocator->Free(link);
+		Slot(slot) = smaller;
+	}
+}
+
+void AdaptiveRadixTreeFile::Destroy(uint64_t link) {
+	if(link == empty)
+		return;
+	if(!IsLeaf(link)) {
+		Destroy(GetNode(link)->leaf);
+		uint8_t byte;
+		for(uint64_t* child=NextChild(GetNode(link), -1, byte); child;
+				child=NextChild(GetNode(link), byte, byte))
+			Destroy(*child);
+	}
+	allocator->Free(link & -2);
+}
+
+
+
+bool AdaptiveRadixTreeFile::insert(const void* keyPointer, uint32_t length,
+		uint64_t value) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	uint64_t slot = ptr + offsetof(Root, root);
+	uint32_t depth = 0;
+	for(;;) {
+		const uint64_t link = Slot(slot);
+		if(link == empty) {
+			const uint64_t leaf = NewLeaf(key, length, value);
+			Slot(slot) = leaf;
+			break;
+		}
+		
+		if(IsLeaf(link)) {
+			const Leaf* leaf = GetLeaf(link);
+			if(Compare(leaf->key, leaf->length, key, length) == 0)
+				return false;
+			const uint32_t end = std::min(leaf->length, length);
+			uint32_t common = depth;
+			while(common < end && leaf->key[common] == key[common])
+				++common;
+			const uint64_t node = NewNode(NODE4, common-depth);
+			memcpy(Prefix(GetNode(node)), key+depth, common-depth);
+			AttachLeaf(node, link, common);
+			AttachLeaf(node, NewLeaf(key, length, value), common);
+			Slot(slot) = node;
+			break;
+		}
+		
+		Node* node = GetNode(link);
+		const uint8_t* prefix = Prefix(node);
+		uint32_t matched = 0;
+		while(matched < node->prefixLength && depth+matched < length &&
+				prefix[matched] == key[depth+matched])
+			++matched;
+		if(matched < node->prefixLength) {
+			// key leaves prefix, node gets parent with common part of prefix
+			const uint64_t parent = NewNode(NODE4, matched);
+			memcpy(Prefix(GetNode(parent)), key+depth, matched);
+			node = GetNode(link);
+			uint8_t* rest = Prefix(node);
+			const uint8_t byte = rest[matched];
+			node->prefixLength -= matched+1;
+			memmove(rest, rest+matched+1, node->prefixLength);
+			AddChild(GetNode(parent), byte, link);
+			AttachLeaf(parent, NewLeaf(key, length, value), depth+matched);
+			Slot(slot) = parent;
+			break;
+		}
+		depth += node->prefixLength;
+		
+		if(depth == length) {
+			if(node->leaf != empty)
+				return false;
+			const uint64_t leaf = NewLeaf(key, length, value);
+			GetNode(link)->leaf = leaf;
+			break;
+		}
+		
+		uint64_t* child = FindChild(node, key[depth]);
+		if(child == NULL) {
+			const uint64_t leaf = NewLeaf(key, length, value);
+			uint64_t grown = link;
+			if(GetNode(link)->count == Capacity(GetNode(link)->type)) {
+				grown = Convert(link, GetNode(link)->type+1,
+						GetNode(link)->prefixLength);
+				allocator->Free(link);
+				Slot(slot) = grown;
+			}
+			AddChild(GetNode(grown), key[depth], leaf);
+			break;
+		}
+		slot = Offset(child);
+		++depth;
+	}
+	++_root().leaves;
+	return true;
+}
+
+bool AdaptiveRadixTreeFile::erase(const void* keyPointer, uint32_t length) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	uint64_t slot = ptr + offsetof(Root, root);
+	uint64_t link = Slot(slot);
+	if(link == empty)
+		return false;
+	if(IsLeaf(link)) {
+		const Leaf* leaf = GetLeaf(link);
+		if(Compare(leaf->key, leaf->length, key, length) != 0)
+			return false;
+		allocator->Free(link & -2);
+		Slot(slot) = empty;
+		--_root().leaves;
+		return true;
+	}
+	
+	uint32_t depth = 0;
+	for(;;) {
+		Node* node = GetNode(link);
+		if(node->prefixLength > length-depth ||
+				memcmp(Prefix(node), key+depth, node->prefixLength) != 0)
+			return false;
+		depth += node->prefixLength;
+		
+		if(depth == length) {
+			if(node->leaf == empty)
+				return false;
+			allocator->Free(node->leaf & -2);
+			node->leaf = empty;
+			break;
+		}
+		
+		uint64_t* child = FindChild(node, key[depth]);
+		if(child == NULL)
+			return false;
+		if(IsLeaf(*child)) {
+			const Leaf* leaf = GetLeaf(*child);
+			if(Compare(leaf->key, leaf->length, key, length) != 0)
+				return false;
+			allocator->Free(*child & -2);
+			RemoveChild(node, key[depth]);
+			break;
+		}
+		slot = Offset(child);
+		link = *child;
+		++depth;
+	}
+	Shrink(slot);
+	--_root().leaves;
+	return true;
+}
+
+bool AdaptiveRadixTreeFile::find(const void* keyPointer, uint32_t length,
+		uint64_t& value) const {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	uint64_t link = _root().root;
+	uint32_t depth = 0;
+	while(link != empty && !IsLeaf(link)) {
+		Node* node = (Node*)GetNode(link);
+		if(node->prefixLength > length-depth ||
+				memcmp(Prefix(node), key+depth, node->prefixLength) != 0)
+			return false;
+		depth += node->prefixLength;
+		if(depth == length) {
+			link = node->leaf;
+			break;
+		}
+		const uint64_t* child = FindChild(node, key[depth]);
+		if(child == NULL)
+			return false;
+		link = *child;
+		++depth;
+	}
+	if(link == empty)
+		return false;
+	const Leaf* leaf = GetLeaf(link);
+	if(Compare(leaf->key, leaf->length, key, length) != 0)
+		return false;
+	value = leaf->value;
+	return true;
+}
+
+void AdaptiveRadixTreeFile::InitNewTree() {
+	ptr = allocator->Allocate(sizeof(Root));
+	_root().root = empty;
+	_root().leaves = 0;
+}
+
+void AdaptiveRadixTreeFile::DestroyTree() {
+	if(ptr == -1)
+		return;
+	Destroy(_root().root);
+	allocator->Free(ptr);
+	ptr = -1;
+}
+
+
+
+uint64_t AdaptiveRadixTreeFile::Cursor::integer() const {
+	uint64_t key;
+	memcpy(&key, GetLeaf().key, sizeof(key));
+	return Encode(key);
+}
+
+bool AdaptiveRadixTreeFile::Cursor::Leftmost(uint64_t link) {
+	while(!IsLeaf(link)) {
+		Node* node = tree->GetNode(link);
+		if(node->leaf != empty) {
+			path.push_back({link, -1});
+			link = node->leaf;
+		} else {
+			uint8_t byte;
+			path.push_back({link, 0});
+			link = *NextChild(node, -1, byte);
+			path.back().byte = byte;
+		}
+	}
+	leaf = link;
+	return true;
+}
+
+bool AdaptiveRadixTreeFile::Cursor::Advance() {
+	while(!path.empty()) {
+		Frame& frame = path.back();
+		uint8_t byte;
+		uint64_t* child = NextChild(tree->GetNode(frame.node), frame.byte, byte);
+		if(child) {
+			frame.byte = byte;
+			return Leftmost(*child);
+		}
+		path.pop_back();
+	}
+	leaf = -1;
+	return false;
+}
+
+bool AdaptiveRadixTreeFile::Cursor::first() {
+	path.clear();
+	leaf = -1;
+	const uint64_t root = tree->_root().root;
+	return root!=empty && Leftmost(root);
+}
+
+bool AdaptiveRadixTreeFile::Cursor::next() {
+	return leaf!=-1 && Advance();
+}
+
+bool AdaptiveRadixTreeFile::Cursor::seek(uint64_t key) {
+	const uint64_t k = Encode(key);
+	return seek(&k, 8);
+}
+
+bool AdaptiveRadixTreeFile::Cursor::seek(const void* keyPointer,
+		uint32_t length) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	path.clear();
+	leaf = -1;
+	uint64_t link = tree->_root().root;
+	if(link == empty)
+		return false;
+	uint32_t depth = 0;
+	for(;;) {
+		if(IsLeaf(link)) {
+			const Leaf* l = tree->GetLeaf(link);
+			leaf = link;
+			if(Compare(l->key, l->length, key, length) >= 0)
+				return true;
+			return Advance();
+		}
+		
+		Node* node = tree->GetNode(link);
+		const uint8_t* prefix = Prefix(node);
+		for(uint32_t i=0; i<node->prefixLength; ++i) {
+			// subtree keys are greater when key ends inside prefix
+			if(depth+i == length || prefix[i] > key[depth+i])
+				return Leftmost(link);
+			if(prefix[i] < key[depth+i])
+				return Advance();
+		}
+		depth += node->prefixLength;
+		if(depth == length)
+			return Leftmost(link);
+		
+		// leaf of node holds shorter key, so it is lower
+		const uint8_t byte = key[depth];
+		uint64_t* child = FindChild(node, byte);
+		if(child) {
+			path.push_back({link, byte});
+			link = *child;
+			++depth;
+			continue;
+		}
+		uint8_t next;
+		child = NextChild(node, byte, next);
+		if(child == NULL)
+			return Advance();
+		path.push_back({link, next});
+		return Leftmost(*child);
+	}
+}
+
@@ -0,0 +1,256 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADAPTIVE_RADIX_TREE_FILE_HPP
+#define ADAPTIVE_RADIX_TREE_FILE_HPP
+
+#include "MultiBlockAllocator.hpp"
+
+#include <cstring>
+#include <vector>
+
+/*
+ *  Adaptive radix tree mapping byte string keys to uint64_t values, stored
+ *  in MultiBlockAllocator. Keys are ordered lexicographically by bytes,
+ *  uint64_t keys are stored big endian as 8 byte strings so they keep
+ *  numeric order.
+ *  
+ *  Inner nodes hold 4, 16, 48 or 256 children and grow or shrink between
+ *  these types. Every inner node stores whole common prefix of its subtree
+ *  after its body and a leaf of key ending at that node, so keys can be
+ *  prefixes of other keys. Leaves store whole key. Links are byte offsets
+ *  in allocator, leaf links have lowest bit set (-1 is invalid link).
+ *  
+ *  Pointers into allocator are valid only until next allocation.
+ */
+
+class AdaptiveRadixTreeFile {
+private:
+	
+	struct Leaf;
+	
+public:
+	
+	using AllocatorType = MultiBlockAllocator;
+	
+	struct Root {
+		uint64_t root;
+		uint64_t leaves;
+	};
+	
+	/*
+	 *  Cursor keeps path from root to current leaf. Key and value references
+	 *  are valid until tree is modified.
+	 */
+	class Cursor {
+	public:
+		
+		Cursor() : leaf(-1), tree(NULL) {}
+		Cursor(AdaptiveRadixTreeFile* tree) : leaf(-1), tree(tree) {}
+		
+		bool first();
+		bool seek(const void* key, uint32_t length);	// moves to first key not lower than key
+		bool seek(uint64_t key);
+		bool next();
+		
+		inline operator bool() const {return leaf!=-1;}
+		
+		inline const uint8_t* key() const {return GetLeaf().key;}
+		inline uint32_t length() const {return GetLeaf().length;}
+		uint64_t integer() const;	// key stored by uint64_t overloads
+		inline uint64_t& value() {return GetLeaf().value;}
+		inline uint64_t value() const {return GetLeaf().value;}
+		
+	private:
+		
+		struct Frame {
+			uint64_t node;
+			int32_t byte;	// byte of current child, -1 for leaf of node
+		};
+		
+		bool Leftmost(uint64_t link);
+		bool Advance();
+		
+		inline Leaf& GetLeaf() const {return *tree->GetLeaf(leaf);}
+		
+		std::vector<Frame> path;
+		uint64_t leaf;
+		AdaptiveRadixTreeFile* tree;
+	};
+	
+	AdaptiveRadixTreeFile() : ptr(-1), allocator(NULL) {}
+	AdaptiveRadixTreeFile(AllocatorType* allocator) : ptr(-1), allocator(allocator) {}
+	AdaptiveRadixTreeFile(uint64_t treeManagerNode, AllocatorType* allocator) : ptr(treeManagerNode), allocator(allocator) {}
+	
+	inline operator bool() const {return ptr!=-1 && (bool)allocator && (bool)*allocator;}
+	
+	// returns false and keeps old value if key is present
+	bool insert(const void* key, uint32_t length, uint64_t value);
+	bool erase(const void* key, uint32_t length);
+	bool find(const void* key, uint32_t length, uint64_t& value) const;
+	
+	inline bool insert(uint64_t key, uint64_t value) {
+		const uint64_t k = Encode(key);
+		return insert(&k, 8, value);
+	}
+	inline bool erase(uint64_t key) {
+		const uint64_t k = Encode(key);
+		return erase(&k, 8);
+	}
+	inline bool find(uint64_t key, uint64_t& value) const {
+		const uint64_t k = Encode(key);
+		return find(&k, 8, value);
+	}
+	
+	// calls function(cursor) for every key starting with prefix, returns
+	// number of visited keys
+	template<typename F>
+	uint64_t scan_prefix(const void* prefix, uint32_t length, F&& function) {
+		uint64_t count = 0;
+		Cursor cursor(this);
+		for(bool valid=cursor.seek(prefix, length); valid &&
+				cursor.length()>=length &&
+				memcmp(cursor.key(), prefix, length)==0;
+				valid=cursor.next(), ++count)
+			function(cursor);
+		return count;
+	}
+	
+	// calls function(cursor) for every key in [min, max]
+	template<typename F>
+	uint64_t scan_range(const void* min, uint32_t minLength, const void* max,
+			uint32_t maxLength, F&& function) {
+		uint64_t count = 0;
+		Cursor cursor(this);
+		for(bool valid=cursor.seek(min, minLength); valid &&
+				Compare(cursor.key(), cursor.length(),
+					(const uint8_t*)max, maxLength) <= 0;
+				valid=cursor.next(), ++count)
+			function(cursor);
+		return count;
+	}
+	template<typename F>
+	inline uint64_t scan_range(uint64_t min, uint64_t max, F&& function) {
+		const uint64_t a = Encode(min), b = Encode(max);
+		return scan_range(&a, 8, &b, 8, function);
+	}
+	
+	Root& _root() {return *allocator->Origin<Root>(ptr);}
+	const Root& _root() const {return *allocator->Origin<Root>(ptr);}
+	
+	inline uint64_t GetTreeManagerNode() const {return ptr;}
+	
+	void InitNewTree();
+	void DestroyTree();
+	
+	uint64_t size() const {return _root().leaves;}
+	
+	static int Compare(const uint8_t* a, uint32_t aLength, const uint8_t* b,
+			uint32_t bLength);
+	inline static uint64_t Encode(uint64_t key) {return __builtin_bswap64(key);}
+	
+private:
+	
+	enum NodeType : uint8_t {
+		NODE4 = 0,
+		NODE16 = 1,
+		NODE48 = 2,
+		NODE256 = 3
+	};
+	
+	struct Node {
+		uint8_t type;
+		uint8_t unused;
+		uint16_t count;			// number of children, without leaf
+		uint32_t prefixLength;	// prefix is stored after node body
+		uint64_t leaf;			// leaf of key ending at this node
+	};
+	
+	// keys are sorted
+	struct Node4 : Node {
+		uint8_t keys[4];
+		uint32_t padding;
+		uint64_t children[4];
+	};
+	
+	struct Node16 : Node {
+		uint8_t keys[16];
+		uint64_t children[16];
+	};
+	
+	// index of child for every byte, emptyIndex when missing
+	struct Node48 : Node {
+		uint8_t index[256];
+		uint64_t children[48];
+	};
+	
+	struct Node256 : Node {
+		uint64_t children[256];
+	};
+	
+	struct Leaf {
+		uint64_t value;
+		uint32_t length;
+		uint8_t key[];
+	};
+	
+	constexpr static uint64_t empty = -1;
+	constexpr static uint8_t emptyIndex = 0xFF;
+	
+	inline static bool IsLeaf(uint64_t link) {return link & 1;}
+	static uint64_t BodySize(uint8_t type);
+	static uint64_t Capacity(uint8_t type);
+	inline static uint8_t* Prefix(Node* node) {
+		return (uint8_t*)node + BodySize(node->type);
+	}
+	inline static const uint8_t* Prefix(const Node* node) {
+		return (const uint8_t*)node + BodySize(node->type);
+	}
+	
+	// slot of child for byte or NULL
+	static uint64_t* FindChild(Node* node, uint8_t byte);
+	// first child with byte greater than after (-1 for first child)
+	static uint64_t* NextChild(Node* node, int32_t after, uint8_t& byte);
+	static void AddChild(Node* node, uint8_t byte, uint64_t child);
+	static void RemoveChild(Node* node, uint8_t byte);
+	
+	inline Node* GetNode(uint64_t link) {return allocator->Origin<Node>(link);}
+	inline const Node* GetNode(uint64_t link) const {return allocator->Origin<Node>(link);}
+	inline Leaf* GetLeaf(uint64_t link) {return allocator->Origin<Leaf>(link & -2);}
+	inline const Leaf* GetLeaf(uint64_t link) const {return allocator->Origin<Leaf>(link & -2);}
+	inline uint64_t& Slot(uint64_t offset) {return *allocator->Origin<uint64_t>(offset);}
+	inline uint64_t Offset(void* pointer) {
+		return (uint8_t*)pointer - allocator->Origin<uint8_t>();
+	}
+	
+	uint64_t NewLeaf(const uint8_t* key, uint32_t length, uint64_t value);
+	uint64_t NewNode(uint8_t type, uint32_t prefixLength);
+	// copy of node with different type, old prefix is put at end of prefix
+	// of given length
+	uint64_t Convert(uint64_t link, uint8_t type, uint32_t prefixLength);
+	// places leaf in node not yet full, depth is length of node key
+	void AttachLeaf(uint64_t link, uint64_t leaf, uint32_t depth);
+	void Shrink(uint64_t slot);		// after removal from node in slot
+	void Destroy(uint64_t link);
+	
+	uint64_t ptr;
+	AllocatorType* allocator;
+};
+
+#endif
+
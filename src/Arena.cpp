@@ -0,0 +1,107 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Arena.hpp"
+
+struct Arena::Chunk {
+	Chunk* next;
+	uint64_t size;
+	
+	inline uint8_t* Begin() {return (uint8_t*)(this+1);}
+	inline uint8_t* End() {return Begin()+size;}
+};
+
+Arena::Arena(uint64_t chunkSize, std::pmr::memory_resource* upstream) :
+	first(NULL), current(NULL), ptr(NULL), end(NULL), chunkSize(chunkSize),
+	upstream(upstream) {
+}
+
+Arena::~Arena() {
+	Release();
+}
+
+void Arena::Rewind(Mark mark) {
+	current = mark.chunk;
+	ptr = mark.ptr;
+	end = current ? current->End() : NULL;
+}
+
+void Arena::Reset() {
+	Rewind({first, first ? first->Begin() : NULL});
+}
+
+void Arena::Release() {
+	while(first) {
+		Chunk* next = first->next;
+		upstream->deallocate(first, sizeof(Chunk)+first->size, alignof(Chunk));
+		first = next;
+	}
+	current = NULL;
+	ptr = end = NULL;
+}
+
+uint64_t Arena::used() const {
+	uint64_t ret = 0;
+	for(Chunk* c=first; c && c!=current; c=c->next)
+		ret += c->size;
+	if(current)
+		ret += ptr - current->Begin();
+	return ret;
+}
+
+uint64_t Arena::reserved() const {
+	uint64_t ret = 0;
+	for(Chunk* c=first; c; c=c->next)
+		ret += c->size;
+	return ret;
+}
+
+Arena& Arena::ThreadLocal() {
+	thread_local Arena arena;
+	return arena;
+}
+
+void* Arena::AllocateSlow(std::size_t bytes, std::size_t alignment) {
+	// skip to next kept chunk when it is large enough
+	Chunk* next = current ? current->next : first;
+	uint64_t needed = bytes + alignment;
+	if(next == NULL || next->size < needed) {
+		uint64_t size = needed > chunkSize ? needed : chunkSize;
+		Chunk* chunk = (Chunk*)upstream->allocate(sizeof(Chunk)+size,
+				alignof(Chunk));
+		chunk->size = size;
+		chunk->next = next;
+		if(current)
+			current->next = chunk;
+		else
+			first = chunk;
+		next = chunk;
+	}
+	current = next;
+	ptr = current->Begin();
+	end = current->End();
+	return do_allocate(bytes, alignment);
+}
+
+void Arena::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
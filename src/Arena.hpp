@@ -0,0 +1,117 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cinttypes>
+#include <cstddef>
+#include <memory_resource>
+
+/*
+ *  Bump pointer memory resource for short lived query time buffers.
+ *  Deallocation does nothing, memory is reclaimed all at once with Rewind()
+ *  or Reset(), chunks are kept for reuse until Release().
+ *  
+ *  Arena is not thread safe, use ThreadLocal() instance with Scope:
+ *  
+ *      Arena::Scope scope;
+ *      std::pmr::vector<uint64_t> result(&scope.arena);
+ */
+
+class Arena : public std::pmr::memory_resource {
+public:
+	
+	const static uint64_t defaultChunkSize = 1<<16;
+	
+private:
+	
+	struct Chunk;
+	
+public:
+	
+	struct Mark {
+		Chunk* chunk;
+		uint8_t* ptr;
+	};
+	
+	// rewinds arena to state from construction when destroyed
+	class Scope {
+	public:
+		
+		Scope() : arena(ThreadLocal()), mark(arena.GetMark()) {}
+		Scope(Arena& arena) : arena(arena), mark(arena.GetMark()) {}
+		Scope(const Scope&) = delete;
+		~Scope() {arena.Rewind(mark);}
+		
+		Arena& arena;
+		
+	private:
+		
+		Mark mark;
+	};
+	
+	Arena(uint64_t chunkSize=defaultChunkSize,
+			std::pmr::memory_resource* upstream=std::pmr::new_delete_resource());
+	Arena(const Arena&) = delete;
+	~Arena();
+	
+	Arena& operator=(const Arena&) = delete;
+	
+	inline Mark GetMark() const {return {current, ptr};}
+	void Rewind(Mark mark);
+	void Reset();
+	void Release();		// returns all chunks to upstream resource
+	
+	uint64_t used() const;
+	uint64_t reserved() const;
+	
+	static Arena& ThreadLocal();
+	
+protected:
+	
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void* ptr, std::size_t bytes,
+			std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const
+		noexcept override;
+	
+private:
+	
+	void* AllocateSlow(std::size_t bytes, std::size_t alignment);
+	
+	Chunk* first;
+	Chunk* current;
+	uint8_t* ptr;
+	uint8_t* end;
+	
+	uint64_t chunkSize;
+	std::pmr::memory_resource* upstream;
+};
+
+inline void* Arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+	uint8_t* ret = (uint8_t*)(((uintptr_t)ptr + alignment-1) & -alignment);
+	if(ret+bytes <= end && ptr) {
+		ptr = ret+bytes;
+		return ret;
+	}
+	return AllocateSlow(bytes, alignment);
+}
+
+#endif
+
@@ -0,0 +1,454 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BPlusTreeFile.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+uint64_t BPlusTreeFile::Head(const uint8_t* suffix, uint32_t length) {
+	uint64_t head = 0;
+	memcpy(&head, suffix, std::min<uint32_t>(length, 8));
+	return __builtin_bswap64(head);
+}
+
+int BPlusTreeFile::Compare(const uint8_t* a, uint32_t aLength,
+		const uint8_t* b, uint32_t bLength) {
+	const int c = memcmp(a, b, std::min(aLength, bLength));
+	if(c)
+		return c;
+	return aLength<bLength ? -1 : aLength>bLength;
+}
+
+const uint8_t* BPlusTreeFile::Suffix(const Page* page, const Slot& slot) const {
+	const uint8_t* data = (const uint8_t*)page + slot.offset;
+	if(!slot.overflow)
+		return data;
+	uint64_t block;
+	memcpy(&block, data, sizeof(block));
+	const Overflow* overflow = allocator->Origin<Overflow>(block);
+	return overflow->key + overflow->length - slot.length;
+}
+
+int BPlusTreeFile::CompareSlot(const Page* page, uint64_t i,
+		const uint8_t* suffix, uint32_t length, uint64_t head) const {
+	const Slot& slot = page->slots[i];
+	if(slot.head != head)
+		return slot.head<head ? -1 : 1;
+	// equal heads with zero padding decide only when both suffixes fit
+	if(slot.length <= 8 && length <= 8)
+		return slot.length<length ? -1 : slot.length>length;
+	return Compare(Suffix(page, slot), slot.length, suffix, length);
+}
+
+uint64_t BPlusTreeFile::Search(const Page* page, const uint8_t* key,
+		uint32_t length, bool upper) const {
+	// routed key does not have to share prefix of keys already in page
+	const uint8_t* prefix = (const uint8_t*)page + page->prefixOffset;
+	const int c = memcmp(key, prefix, std::min(length, page->prefixLength));
+	if(c < 0 || (c == 0 && length < page->prefixLength))
+		return 0;
+	if(c > 0)
+		return page->count;
+	const uint8_t* suffix = key + page->prefixLength;
+	length -= page->prefixLength;
+	const uint64_t head = Head(suffix, length);
+	
+	uint64_t begin = 0, end = page->count;
+	while(begin < end) {
+		const uint64_t mid = (begin+end)/2;
+		const int r = CompareSlot(page, mid, suffix, length, head);
+		if(r < 0 || (upper && r == 0))
+			begin = mid+1;
+		else
+			end = mid;
+	}
+	return begin;
+}
+
+bool BPlusTreeFile::IsEqual(const Page* page, uint64_t i, const uint8_t* key,
+		uint32_t length) const {
+	// Search returns slot 0 for keys below the prefix, so verify it here
+	if(i >= page->count || length < page->prefixLength)
+		return false;
+	const uint8_t* prefix = (const uint8_t*)page + page->prefixOffset;
+	if(memcmp(key, prefix, page->prefixLength) != 0)
+		return false;
+	const uint8_t* suffix = key + page->prefixLength;
+	length -= page->prefixLength;
+	return CompareSlot(page, i, suffix, length, Head(suffix, length)) == 0;
+}
+
+uint64_t BPlusTreeFile::Child(const Page* page, const uint8_t* key,
+		uint32_t length) const {
+	const uint64_t i = Search(page, key, length, true);
+	return i<page->count ? page->slots[i].value : page->upper;
+}
+
+
+
+void BPlusTreeFile::Extract(uint64_t page, std::vector<Entry>& entries) {
+	const Page* p = GetPage(page);
+	const std::string_view prefix((const char*)p + p->prefixOffset,
+			p->prefixLength);
+	entries.clear();
+	entries.reserve(p->count+1);
+	for(uint64_t i=0; i<p->count; ++i) {
+		const Slot& slot = p->slots[i];
+		Entry entry;
+		entry.key.reserve(prefix.size() + slot.length);
+		entry.key.append(prefix);
+		entry.key.append((const char*)Suffix(p, slot), slot.length);
+		entry.value = slot.value;
+		entry.overflow = -1;
+		if(slot.overflow)
+			memcpy(&entry.overflow, (const uint8_t*)p+slot.offset, 8);
+		entries.emplace_back(std::move(entry));
+	}
+}
+
+namespace {
+	uint32_t CommonPrefix(const std::string& a, const std::string& b) {
+		return std::mismatch(a.begin(), a.begin()+std::min(a.size(), b.size()),
+				b.begin()).first - a.begin();
+	}
+}
+
+bool BPlusTreeFile::Fits(const std::vector<Entry>& entries, uint64_t begin,
+		uint64_t end) const {
+	const uint64_t prefixLength = begin==end ? 0 : std::min<uint64_t>(
+			maxInlineKey, CommonPrefix(entries[begin].key, entries[end-1].key));
+	uint64_t bytes = sizeof(Page) + prefixLength;
+	for(uint64_t i=begin; i<end; ++i) {
+		const uint64_t length = entries[i].key.size();
+		bytes += sizeof(Slot) + (length>maxInlineKey ? 8 : length-prefixLength);
+	}
+	return bytes <= pageSize;
+}
+
+void BPlusTreeFile::Write(uint64_t page, std::vector<Entry>& entries,
+		uint64_t begin, uint64_t end, bool leaf, uint64_t upper) {
+	// keys are sorted, so prefix of first and last is common to all
+	const uint32_t prefixLength = begin==end ? 0 : std::min<uint64_t>(
+			maxInlineKey, CommonPrefix(entries[begin].key, entries[end-1].key));
+	
+	// allocations move memory, so overflow blocks are prepared first
+	for(uint64_t i=begin; i<end; ++i) {
+		Entry& entry = entries[i];
+		const bool overflow = entry.key.size() > maxInlineKey;
+		if(overflow && entry.overflow == -1) {
+			entry.overflow = allocator->Allocate(sizeof(Overflow) +
+					entry.key.size());
+			Overflow* block = allocator->Origin<Overflow>(entry.overflow);
+			block->length = entry.key.size();
+			memcpy(block->key, entry.key.data(), entry.key.size());
+		} else if(!overflow && entry.overflow != -1) {
+			allocator->Free(entry.overflow);
+			entry.overflow = -1;
+		}
+	}
+	
+	Page* p = GetPage(page);
+	p->leaf = leaf;
+	p->unused = 0;
+	p->count = end-begin;
+	p->padding = 0;
+	p->upper = upper;
+	p->reserved = 0;
+	uint64_t data = pageSize - prefixLength;
+	p->prefixOffset = data;
+	p->prefixLength = prefixLength;
+	if(begin != end)
+		memcpy((uint8_t*)p+data, entries[begin].key.data(), prefixLength);
+	for(uint64_t i=begin; i<end; ++i) {
+		const Entry& entry = entries[i];
+		const uint8_t* suffix = (const uint8_t*)entry.key.data() + prefixLength;
+		const uint32_t length = entry.key.size() - prefixLength;
+		Slot& slot = p->slots[i-begin];
+		slot.head = Head(suffix, length);
+		slot.value = entry.value;
+		slot.length = length;
+		slot.overflow = entry.overflow != -1;
+		if(slot.overflow) {
+			data -= 8;
+			memcpy((uint8_t*)p+data, &entry.overflow, 8);
+		} else {
+			data -= length;
+			memcpy((uint8_t*)p+data, suffix, length);
+		}
+		slot.offset = data;
+	}
+	p->dataOffset = data;
+}
+
+void BPlusTreeFile::Insert(std::vector<uint64_t>& path, uint64_t page,
+		const uint8_t* key, uint32_t length, uint64_t value) {
+	Page* p = GetPage(page);
+	const uint8_t* prefix = (const uint8_t*)p + p->prefixOffset;
+	if(length >= p->prefixLength && memcmp(key, prefix, p->prefixLength) == 0) {
+		const uint32_t suffixLength = length - p->prefixLength;
+		const bool overflow = length > maxInlineKey;
+		const uint64_t bytes = overflow ? 8 : suffixLength;
+		const uint64_t freeSpace = p->dataOffset - sizeof(Page) -
+			p->count*sizeof(Slot);
+		if(freeSpace >= sizeof(Slot) + bytes) {
+			uint64_t block = -1;
+			if(overflow) {
+				block = allocator->Allocate(sizeof(Overflow) + length);
+				Overflow* o = allocator->Origin<Overflow>(block);
+				o->length = length;
+				memcpy(o->key, key, length);
+				p = GetPage(page);
+			}
+			const uint64_t i = Search(p, key, length, false);
+			memmove(p->slots+i+1, p->slots+i, (p->count-i)*sizeof(Slot));
+			const uint8_t* suffix = key + p->prefixLength;
+			p->dataOffset -= bytes;
+			if(overflow)
+				memcpy((uint8_t*)p+p->dataOffset, &block, 8);
+			else
+				memcpy((uint8_t*)p+p->dataOffset, suffix, bytes);
+			Slot& slot = p->slots[i];
+			slot.head = Head(suffix, suffixLength);
+			slot.value = value;
+			slot.offset = p->dataOffset;
+			slot.overflow = overflow;
+			slot.length = suffixLength;
+			++p->count;
+			return;
+		}
+	}
+	
+	// page is rebuilt, which also compacts its key heap
+	std::vector<Entry> entries;
+	Extract(page, entries);
+	const uint64_t i = Search(GetPage(page), key, length, false);
+	entries.insert(entries.begin()+i, Entry{std::string((const char*)key,
+				length), value, (uint64_t)-1});
+	const bool leaf = GetPage(page)->leaf;
+	const uint64_t upper = GetPage(page)->upper;
+	const uint64_t n = entries.size();
+	if(Fits(entries, 0, n)) {
+		Write(page, entries, 0, n, leaf, upper);
+		return;
+	}
+	
+	// split near half of bytes, where both pages fit. Longer prefix never
+	// grows entries, so split separating new key from the rest always fits.
+	auto cost = [](const Entry& entry) {
+		return sizeof(Slot) + (entry.key.size()>maxInlineKey ? 8 :
+				entry.key.size());
+	};
+	auto fits = [&](uint64_t mid) {
+		return Fits(entries, 0, mid) && Fits(entries, leaf ? mid : mid+1, n);
+	};
+	uint64_t total = 0, half = cost(entries[0]), mid = 1;
+	for(const Entry& entry : entries)
+		total += cost(entry);
+	for(; mid<n-1 && half*2<total; ++mid)
+		half += cost(entries[mid]);
+	for(uint64_t d=0; d<n; ++d) {
+		if(mid > d && fits(mid-d)) {
+			mid -= d;
+			break;
+		}
+		if(mid+d < n && fits(mid+d)) {
+			mid += d;
+			break;
+		}
+	}
+	
+	const uint64_t right = allocator->Allocate(pageSize);
+	std::string separator;
+	if(leaf) {
+		// shortest key greater than left keys and not greater than right ones
+		separator = entries[mid].key.substr(0,
+				CommonPrefix(entries[mid-1].key, entries[mid].key)+1);
+		Write(right, entries, mid, n, true, upper);
+		Write(page, entries, 0, mid, true, right);
+	} else {
+		separator = std::move(entries[mid].key);
+		allocator->Free(entries[mid].overflow);
+		Write(right, entries, mid+1, n, false, upper);
+		Write(page, entries, 0, mid, false, entries[mid].value);
+	}
+	
+	if(path.empty()) {
+		const uint64_t root = allocator->Allocate(pageSize);
+		std::vector<Entry> top;
+		top.push_back(Entry{std::move(separator), page, (uint64_t)-1});
+		Write(root, top, 0, 1, false, right);
+		_root().root = root;
+		++_root().height;
+		return;
+	}
+	
+	// keys not lower than separator move from page to right
+	const uint64_t parent = path.back();
+	path.pop_back();
+	Page* pp = GetPage(parent);
+	if(pp->upper == page) {
+		pp->upper = right;
+	} else {
+		for(uint64_t j=0; j<pp->count; ++j)
+			if(pp->slots[j].value == page) {
+				pp->slots[j].value = right;
+				break;
+			}
+	}
+	Insert(path, parent, (const uint8_t*)separator.data(), separator.size(),
+			page);
+}
+
+void BPlusTreeFile::Destroy(uint64_t page) {
+	const Page* p = GetPage(page);
+	for(uint64_t i=0; i<p->count; ++i) {
+		if(!p->leaf)
+			Destroy(p->slots[i].value);
+		p = GetPage(page);
+		if(p->slots[i].overflow) {
+			uint64_t block;
+			memcpy(&block, (const uint8_t*)p+p->slots[i].offset, 8);
+			allocator->Free(block);
+		}
+	}
+	if(!p->leaf)
+		Destroy(p->upper);
+	allocator->Free(page);
+}
+
+
+
+bool BPlusTreeFile::insert(const void* keyPointer, uint32_t length,
+		uint64_t value) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	std::vector<uint64_t> path;
+	path.reserve(_root().height);
+	uint64_t page = _root().root;
+	while(!GetPage(page)->leaf) {
+		path.push_back(page);
+		page = Child(GetPage(page), key, length);
+	}
+	const Page* p = GetPage(page);
+	if(IsEqual(p, Search(p, key, length, false), key, length))
+		return false;
+	Insert(path, page, key, length, value);
+	++_root().keys;
+	return true;
+}
+
+bool BPlusTreeFile::erase(const void* keyPointer, uint32_t length) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	uint64_t page = _root().root;
+	while(!GetPage(page)->leaf)
+		page = Child(GetPage(page), key, length);
+	Page* p = GetPage(page);
+	const uint64_t i = Search(p, key, length, false);
+	if(!IsEqual(p, i, key, length))
+		return false;
+	if(p->slots[i].overflow) {
+		uint64_t block;
+		memcpy(&block, (const uint8_t*)p+p->slots[i].offset, 8);
+		allocator->Free(block);
+	}
+	// heap space of suffix is reclaimed when page is rebuilt
+	memmove(p->slots+i, p->slots+i+1, (p->count-i-1)*sizeof(Slot));
+	--p->count;
+	--_root().keys;
+	return true;
+}
+
+bool BPlusTreeFile::find(const void* keyPointer, uint32_t length,
+		uint64_t& value) const {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	uint64_t page = _root().root;
+	while(!GetPage(page)->leaf)
+		page = Child(GetPage(page), key, length);
+	const Page* p = GetPage(page);
+	const uint64_t i = Search(p, key, length, false);
+	if(!IsEqual(p, i, key, length))
+		return false;
+	value = p->slots[i].value;
+	return true;
+}
+
+void BPlusTreeFile::InitNewTree() {
+	ptr = allocator->Allocate(sizeof(Root));
+	const uint64_t root = allocator->Allocate(pageSize);
+	std::vector<Entry> entries;
+	Write(root, entries, 0, 0, true, -1);
+	_root().root = root;
+	_root().keys = 0;
+	_root().height = 1;
+}
+
+void BPlusTreeFile::DestroyTree() {
+	if(ptr == -1)
+		return;
+	Destroy(_root().root);
+	allocator->Free(ptr);
+	ptr = -1;
+}
+
+
+
+uint64_t& BPlusTreeFile::Cursor::value() {
+	return tree->GetPage(page)->slots[slot].value;
+}
+
+bool BPlusTreeFile::Cursor::Settle() {
+	while(page != -1) {
+		const Page* p = tree->GetPage(page);
+		if(slot < p->count) {
+			const Slot& s = p->slots[slot];
+			currentKey.assign((const char*)p + p->prefixOffset, p->prefixLength);
+			currentKey.append((const char*)tree->Suffix(p, s), s.length);
+			return true;
+		}
+		page = p->upper;
+		slot = 0;
+	}
+	return false;
+}
+
+bool BPlusTreeFile::Cursor::first() {
+	page = tree->_root().root;
+	while(!tree->GetPage(page)->leaf) {
+		const Page* p = tree->GetPage(page);
+		page = p->count ? p->slots[0].value : p->upper;
+	}
+	slot = 0;
+	return Settle();
+}
+
+bool BPlusTreeFile::Cursor::seek(const void* keyPointer, uint32_t length) {
+	const uint8_t* key = (const uint8_t*)keyPointer;
+	page = tree->_root().root;
+	while(!tree->GetPage(page)->leaf)
+		page = tree->Child(tree->GetPage(page), key, length);
+	slot = tree->Search(tree->GetPage(page), key, length, false);
+	return Settle();
+}
+
+bool BPlusTreeFile::Cursor::next() {
+	if(page == -1)
+		return false;
+	++slot;
+	return Settle();
+}
+
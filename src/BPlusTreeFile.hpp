@@ -0,0 +1,188 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef B_PLUS_TREE_FILE_HPP
+#define B_PLUS_TREE_FILE_HPP
+
+#include "MultiBlockAllocator.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ *  B+tree mapping byte string keys to uint64_t values, stored in 4 KiB
+ *  pages of MultiBlockAllocator. Keys are ordered lexicographically.
+ *  
+ *  Page layout:
+ *    - 32B header
+ *    - slot array growing up, 24B per key: first 8 bytes of key suffix as
+ *      big endian integer (most comparisons end on it), value or child
+ *      page, offset and length of suffix
+ *    - key heap growing down from end of page
+ *  
+ *  Common prefix of all keys in page is stored once and only suffixes are
+ *  kept in slots. Key longer than maxInlineKey is moved to overflow block
+ *  and page keeps only link to it. Leaf split posts to parent shortest separator
+ *  between split keys. Inner page child i holds keys lower than separator
+ *  i, upper link holds keys not lower than last separator. Leaves are
+ *  linked through upper link, pages are not merged on erase.
+ *  
+ *  Pointers into allocator are valid only until next allocation.
+ */
+
+class BPlusTreeFile {
+public:
+	
+	using AllocatorType = MultiBlockAllocator;
+	
+	constexpr static uint64_t pageSize = 4096;
+	constexpr static uint64_t maxInlineKey = 256;
+	
+	struct Root {
+		uint64_t root;
+		uint64_t keys;
+		uint64_t height;
+	};
+	
+	/*
+	 *  Cursor keeps copy of current key, value reference is valid until
+	 *  tree is modified.
+	 */
+	class Cursor {
+	public:
+		
+		Cursor() : page(-1), slot(0), tree(NULL) {}
+		Cursor(BPlusTreeFile* tree) : page(-1), slot(0), tree(tree) {}
+		
+		bool first();
+		bool seek(const void* key, uint32_t length);	// moves to first key not lower than key
+		bool next();
+		
+		inline operator bool() const {return page!=-1;}
+		
+		inline std::string_view key() const {return currentKey;}
+		uint64_t& value();
+		
+	private:
+		
+		bool Settle();	// skips to next nonempty leaf and loads key
+		
+		uint64_t page;
+		uint64_t slot;
+		std::string currentKey;
+		BPlusTreeFile* tree;
+	};
+	
+	BPlusTreeFile() : ptr(-1), allocator(NULL) {}
+	BPlusTreeFile(AllocatorType* allocator) : ptr(-1), allocator(allocator) {}
+	BPlusTreeFile(uint64_t treeManagerNode, AllocatorType* allocator) : ptr(treeManagerNode), allocator(allocator) {}
+	
+	inline operator bool() const {return ptr!=-1 && (bool)allocator && (bool)*allocator;}
+	
+	// returns false and keeps old value if key is present
+	bool insert(const void* key, uint32_t length, uint64_t value);
+	bool erase(const void* key, uint32_t length);
+	bool find(const void* key, uint32_t length, uint64_t& value) const;
+	
+	inline bool insert(std::string_view key, uint64_t value) {
+		return insert(key.data(), key.size(), value);
+	}
+	inline bool erase(std::string_view key) {return erase(key.data(), key.size());}
+	inline bool find(std::string_view key, uint64_t& value) const {
+		return find(key.data(), key.size(), value);
+	}
+	
+	Root& _root() {return *allocator->Origin<Root>(ptr);}
+	const Root& _root() const {return *allocator->Origin<Root>(ptr);}
+	
+	inline uint64_t GetTreeManagerNode() const {return ptr;}
+	
+	void InitNewTree();
+	void DestroyTree();
+	
+	uint64_t size() const {return _root().keys;}
+	uint64_t height() const {return _root().height;}
+	
+private:
+	
+	struct Slot {
+		uint64_t head;		// first 8 bytes of suffix, zero padded
+		uint64_t value;		// child page in inner pages
+		uint16_t offset;	// of suffix in page or of overflow block link
+		uint16_t overflow;
+		uint32_t length;	// of suffix
+	};
+	
+	struct Page {
+		uint8_t leaf;
+		uint8_t unused;
+		uint16_t count;
+		uint16_t dataOffset;	// begin of key heap
+		uint16_t prefixOffset;
+		uint32_t prefixLength;
+		uint32_t padding;
+		uint64_t upper;			// next leaf or child for greatest keys
+		uint64_t reserved;
+		Slot slots[];
+	};
+	
+	struct Overflow {
+		uint64_t length;
+		uint8_t key[];		// whole key
+	};
+	
+	// page content during split or prefix change
+	struct Entry {
+		std::string key;
+		uint64_t value;
+		uint64_t overflow;	// reused block or -1
+	};
+	
+	static uint64_t Head(const uint8_t* suffix, uint32_t length);
+	static int Compare(const uint8_t* a, uint32_t aLength, const uint8_t* b,
+			uint32_t bLength);
+	
+	inline Page* GetPage(uint64_t page) {return allocator->Origin<Page>(page);}
+	inline const Page* GetPage(uint64_t page) const {return allocator->Origin<Page>(page);}
+	
+	const uint8_t* Suffix(const Page* page, const Slot& slot) const;
+	int CompareSlot(const Page* page, uint64_t i, const uint8_t* suffix,
+			uint32_t length, uint64_t head) const;
+	// first slot with key not lower (or greater with upper) than key
+	uint64_t Search(const Page* page, const uint8_t* key, uint32_t length,
+			bool upper) const;
+	bool IsEqual(const Page* page, uint64_t i, const uint8_t* key,
+			uint32_t length) const;
+	uint64_t Child(const Page* page, const uint8_t* key, uint32_t length) const;
+	
+	void Extract(uint64_t page, std::vector<Entry>& entries);
+	bool Fits(const std::vector<Entry>& entries, uint64_t begin,
+			uint64_t end) const;
+	void Write(uint64_t page, std::vector<Entry>& entries, uint64_t begin,
+			uint64_t end, bool leaf, uint64_t upper);
+	void Insert(std::vector<uint64_t>& path, uint64_t page, const uint8_t* key,
+			uint32_t length, uint64_t value);
+	void Destroy(uint64_t page);
+	
+	uint64_t ptr;
+	AllocatorType* allocator;
+};
+
+#endif
+
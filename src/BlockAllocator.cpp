@@ -16,27 +16,27 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-template<uint64_t a>
-BlockAllocator<a>::BlockAllocator() {
+template<uint64_t a, bool p>
+BlockAllocator<a,p>::BlockAllocator() {
 	preallocatedBlocks = 0;
 	reservingBlocksAtOnce = 512;
 }
 
-template<uint64_t a>
-BlockAllocator<a>::BlockAllocator(const char* memoryFile,
+template<uint64_t a, bool p>
+BlockAllocator<a,p>::BlockAllocator(const char* memoryFile,
 		const char* heapFile) {
 	reservingBlocksAtOnce = 512;
 	Open(memoryFile, heapFile);
 }
 
-template<uint64_t a>
-BlockAllocator<a>::~BlockAllocator() {
+template<uint64_t a, bool p>
+BlockAllocator<a,p>::~BlockAllocator() {
 	memoryFile.Close();
 	heap.Close();
 }
 
-template<uint64_t a>
-bool BlockAllocator<a>::Open(const char* memoryFile, const char* heapFile) {
+template<uint64_t a, bool p>
+bool BlockAllocator<a,p>::Open(const char* memoryFile, const char* heapFile) {
 	bool valid = this->memoryFile.Open(memoryFile);
 	valid &= this->heap.Open(heapFile);
 	if(!valid) {
@@ -44,27 +44,42 @@ bool BlockAllocator<a>::Open(const char* memoryFile, const char* heapFile) {
 		this->heap.Close();
 		return valid;
 	}
-	preallocatedBlocks = this->memoryFile.Size()>>blockOffsetBits;
+	preallocatedBlocks = this->memoryFile.Size()/blockSize;
 	return valid;
 }
 
-template<uint64_t a>
-uint64_t BlockAllocator<a>::AllocateBlock() {
+template<uint64_t a, bool p>
+void BlockAllocator<a,p>::Close() {
+	memoryFile.Close();
+	heap.Close();
+	preallocatedBlocks = 0;
+}
+
+template<uint64_t a, bool p>
+uint64_t BlockAllocator<a,p>::AllocateBlock() {
 	if(heap.Size() == 0)
 		Reserve(reservingBlocksAtOnce);
 	uint64_t ret=0;
 	heap.Pop(ret);
-	return ret<<blockOffsetBits;
+	return ret*blockSize;
+}
+
+template<uint64_t a, bool p>
+void BlockAllocator<a,p>::FreeBlock(uint64_t ptr) {
+	heap.Push(ptr/blockSize);
 }
 
-template<uint64_t a>
-void BlockAllocator<a>::FreeBlock(uint64_t ptr) {
-	heap.Push(ptr>>blockOffsetBits);
+template<uint64_t a, bool p>
+uint64_t BlockAllocator<a,p>::AllocateContiguousBlocks(uint64_t count) {
+	uint64_t first = preallocatedBlocks;
+	preallocatedBlocks += count;
+	memoryFile.Reserve(preallocatedBlocks*blockSize);
+	return first*blockSize;
 }
 
-template<uint64_t a>
-void BlockAllocator<a>::Reserve(uint64_t blocks) {
-	memoryFile.Reserve((preallocatedBlocks+blocks)<<blockOffsetBits);
+template<uint64_t a, bool p>
+void BlockAllocator<a,p>::Reserve(uint64_t blocks) {
+	memoryFile.Reserve((preallocatedBlocks+blocks)*blockSize);
 	uint64_t i=preallocatedBlocks;
 	preallocatedBlocks += blocks;
 	if(heap.Size() == 0) {
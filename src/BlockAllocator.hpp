@@ -29,6 +29,12 @@
    When pointer has value -1 (0xFFFFFFFFFFFFFFFF) then this pointer is invalid.
 */
 
+/*
+   Block size is rounded up to power of two. Packed allocators round it up
+   only to multiple of 8 bytes, so blocks of odd sizes like 24 bytes do not
+   waste space, but block offsets are not aligned to block size.
+*/
+
 constexpr uint64_t BitsForBlockSizeCorrect(uint64_t value) {
 	uint64_t i=3;
 	for(; i<30 && value>(1<<i); ++i) {
@@ -36,11 +42,18 @@ constexpr uint64_t BitsForBlockSizeCorrect(uint64_t value) {
 	return i;
 }
 
-template<uint64_t _blockSize>
+constexpr uint64_t BlockSizeCorrect(uint64_t value, bool packed) {
+	if(!packed)
+		return 1llu<<BitsForBlockSizeCorrect(value);
+	if(value <= 8)
+		return 8;
+	return (value+7)&(-8llu);
+}
+
+template<uint64_t _blockSize, bool packed=false>
 class BlockAllocator {
 public:
-	const static uint64_t blockOffsetBits = BitsForBlockSizeCorrect(_blockSize);
-	const static uint64_t blockSize = 1<<blockOffsetBits;
+	const static uint64_t blockSize = BlockSizeCorrect(_blockSize, packed);
 	
 	BlockAllocator();
 	BlockAllocator(const char* memoryFile, const char* heapFile);
@@ -54,6 +67,13 @@ public:
 	uint64_t AllocateBlock();
 	void FreeBlock(uint64_t ptr);
 	
+	// returns pointer to first of count blocks placed one after another at
+	// the end of memory, blocks can be freed separately with FreeBlock
+	uint64_t AllocateContiguousBlocks(uint64_t count);
+	
+	// number of blocks that can be allocated without resizing memory file
+	inline uint64_t FreeBlocks() const {return heap.Size();}
+	
 	template<typename T=void>
 	inline T* Origin() {return memoryFile.Origin<T>();}
 	template<typename T=void>
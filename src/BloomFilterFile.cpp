@@ -0,0 +1,185 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "BloomFilterFile.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace {
+	
+	const static uint32_t salts[8] = {
+		0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+		0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+	};
+	
+	// block is selected by high bits of hash, bits inside by low 32 bits
+	inline uint64_t BitOf(uint64_t keyHash, uint64_t word) {
+		return 1llu << (((uint32_t)keyHash * salts[word]) >> 26);
+	}
+	
+	bool TestScalar(const uint64_t* block, uint64_t keyHash) {
+		bool result = true;
+		for(uint64_t w=0; w<8; ++w)
+			result &= (block[w] & BitOf(keyHash, w)) != 0;
+		return result;
+	}
+	
+	__attribute__((target("avx2")))
+	inline void MasksAvx2(uint64_t keyHash, __m256i& lo, __m256i& hi) {
+		const __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(
+					_mm256_set1_epi32((uint32_t)keyHash),
+					_mm256_loadu_si256((const __m256i*)salts)), 26);
+		const __m256i one = _mm256_set1_epi64x(1);
+		lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+					_mm256_castsi256_si128(bits)));
+		hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(
+					_mm256_extracti128_si256(bits, 1)));
+	}
+	
+	__attribute__((target("avx2")))
+	bool TestAvx2(const uint64_t* block, uint64_t keyHash) {
+		__m256i lo, hi;
+		MasksAvx2(keyHash, lo, hi);
+		// testc is 1 when every mask bit is set in block
+		return _mm256_testc_si256(
+					_mm256_loadu_si256((const __m256i*)block), lo) &
+			_mm256_testc_si256(
+					_mm256_loadu_si256((const __m256i*)(block+4)), hi);
+	}
+	
+	__attribute__((target("avx512f")))
+	bool TestAvx512(const uint64_t* block, uint64_t keyHash) {
+		const __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(
+					_mm256_set1_epi32((uint32_t)keyHash),
+					_mm256_loadu_si256((const __m256i*)salts)), 26);
+		const __m512i mask = _mm512_sllv_epi64(_mm512_set1_epi64(1),
+				_mm512_cvtepu32_epi64(bits));
+		const __m512i b = _mm512_load_si512(block);
+		return _mm512_cmpeq_epi64_mask(_mm512_and_si512(b, mask), mask)
+			== 0xFF;
+	}
+	
+	bool (*const Test)(const uint64_t*, uint64_t) = []() {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f"))
+			return TestAvx512;
+		if(__builtin_cpu_supports("avx2"))
+			return TestAvx2;
+		return TestScalar;
+	}();
+}
+
+BloomFilterFile::BloomFilterFile() {
+}
+
+BloomFilterFile::BloomFilterFile(const char* fileName, uint64_t capacity,
+		uint64_t bitsPerKey) {
+	Open(fileName, capacity, bitsPerKey);
+}
+
+BloomFilterFile::~BloomFilterFile() {
+	Close();
+}
+
+bool BloomFilterFile::Open(const char* fileName, uint64_t capacity,
+		uint64_t bitsPerKey) {
+	Close();
+	if(!file.Open(fileName))
+		return false;
+	if(file.Size() < sizeof(Header)) {
+		file.Resize(sizeof(Header));
+		GetHeader().bitsPerKey = bitsPerKey;
+		Reset(capacity);
+	}
+	return true;
+}
+
+void BloomFilterFile::Close() {
+	file.Close();
+}
+
+void BloomFilterFile::Reset(uint64_t capacity) {
+	capacity = std::max<uint64_t>(capacity, 1);
+	const uint64_t blocks = (capacity * GetHeader().bitsPerKey + 511) / 512;
+	file.Resize(sizeof(Header) + blocks*blockSize);
+	Header& header = GetHeader();
+	header.blocks = blocks;
+	header.capacity = capacity;
+	header.keys = 0;
+	header.stale = 0;
+	memset(file.Origin(blockSize), 0, blocks*blockSize);
+}
+
+void BloomFilterFile::Insert(uint64_t keyHash) {
+	uint64_t* block = Block(keyHash);
+	for(uint64_t w=0; w<8; ++w)
+		block[w] |= BitOf(keyHash, w);
+}
+
+void BloomFilterFile::insert(uint64_t key) {
+	Insert(hash::mix64(key));
+	GetHeader().keys++;
+}
+
+void BloomFilterFile::insert_many(const uint64_t* keys, uint64_t count) {
+	uint64_t hashes[256];
+	for(uint64_t i=0; i<count; i+=256) {
+		const uint64_t n = std::min<uint64_t>(256, count-i);
+		hash::hash_many(keys+i, hashes, n);
+		for(uint64_t j=0; j<n; ++j)
+			Insert(hashes[j]);
+	}
+	GetHeader().keys += count;
+}
+
+bool BloomFilterFile::may_contain(uint64_t key) const {
+	const uint64_t keyHash = hash::mix64(key);
+	return Test(Block(keyHash), keyHash);
+}
+
+void BloomFilterFile::may_contain_many(const uint64_t* keys, bool* results,
+		uint64_t count) const {
+	uint64_t hashes[256];
+	for(uint64_t i=0; i<count; i+=256) {
+		const uint64_t n = std::min<uint64_t>(256, count-i);
+		hash::hash_many(keys+i, hashes, n);
+		// blocks of whole batch are requested before first is tested
+		for(uint64_t j=0; j<n; ++j)
+			__builtin_prefetch(Block(hashes[j]));
+		for(uint64_t j=0; j<n; ++j)
+			results[i+j] = Test(Block(hashes[j]), hashes[j]);
+	}
+}
+
+double BloomFilterFile::FalsePositiveRate() const {
+	// keys per block follow Poisson distribution, block with k keys has
+	// given bit of each word set with probability 1-(63/64)^k
+	const double lambda = (double)Keys() / Blocks();
+	double p = exp(-lambda), rate = 0;
+	for(uint64_t k=0; k<lambda*4+64; ++k) {
+		rate += p * pow(1.0 - pow(63.0/64.0, k), 8);
+		p *= lambda / (k+1);
+	}
+	return rate;
+}
+
@@ -0,0 +1,103 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOOM_FILTER_FILE_HPP
+#define BLOOM_FILTER_FILE_HPP
+
+#include "CachedFile.hpp"
+
+#include <cinttypes>
+
+/*
+ *  Persistent blocked Bloom filter of uint64_t keys. Every key maps to one
+ *  64 byte block (one cache line) and sets one bit in each of its eight
+ *  64 bit words, bit positions come from 32 bit multiplications of key hash
+ *  by fixed odd salts. Query loads single block and tests all eight words
+ *  at once with AVX2/AVX-512 when available.
+ *  
+ *  Filter can not remove keys, owner counts removed ones as stale and
+ *  rebuilds filter when it gets too inaccurate.
+ */
+
+class BloomFilterFile {
+public:
+	
+	const static uint64_t blockSize = 64;
+	const static uint64_t defaultBitsPerKey = 12;
+	
+	BloomFilterFile();
+	BloomFilterFile(const char* fileName, uint64_t capacity=1<<16,
+			uint64_t bitsPerKey=defaultBitsPerKey);
+	~BloomFilterFile();
+	
+	// capacity and bitsPerKey are used only when file is created
+	bool Open(const char* fileName, uint64_t capacity=1<<16,
+			uint64_t bitsPerKey=defaultBitsPerKey);
+	void Close();
+	
+	inline operator bool() const {return (bool)file;}
+	
+	void insert(uint64_t key);
+	void insert_many(const uint64_t* keys, uint64_t count);
+	bool may_contain(uint64_t key) const;
+	void may_contain_many(const uint64_t* keys, bool* results,
+			uint64_t count) const;
+	
+	// removes all keys and resizes filter for given number of keys
+	void Reset(uint64_t capacity);
+	
+	inline uint64_t Keys() const {return GetHeader().keys;}
+	inline uint64_t Stale() const {return GetHeader().stale;}
+	inline uint64_t Capacity() const {return GetHeader().capacity;}
+	inline uint64_t Blocks() const {return GetHeader().blocks;}
+	inline void MarkStale(uint64_t count=1) {GetHeader().stale += count;}
+	
+	// expected false positive rate for current number of keys
+	double FalsePositiveRate() const;
+	
+private:
+	
+	struct Header {
+		uint64_t blocks;
+		uint64_t capacity;
+		uint64_t bitsPerKey;
+		uint64_t keys;
+		uint64_t stale;
+		uint64_t reserved[3];
+	};
+	
+	static_assert(sizeof(Header) == blockSize);
+	
+	inline Header& GetHeader() {return *file.Origin<Header>();}
+	inline const Header& GetHeader() const {return *file.Origin<Header>();}
+	inline uint64_t* Block(uint64_t keyHash) {
+		return file.Origin<uint64_t>(blockSize +
+				(((unsigned __int128)keyHash * Blocks()) >> 64) * blockSize);
+	}
+	inline const uint64_t* Block(uint64_t keyHash) const {
+		return file.Origin<uint64_t>(blockSize +
+				(((unsigned __int128)keyHash * Blocks()) >> 64) * blockSize);
+	}
+	
+	void Insert(uint64_t keyHash);
+	
+	CachedFile file;
+};
+
+#endif
+
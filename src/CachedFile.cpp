@@ -23,6 +23,8 @@
 
 #include <fstream>
 
+#include <sys/mman.h>
+
 bool CachedFile::Open(const char* fileName) {
 	Close();
 	{
@@ -81,5 +83,11 @@ uint64_t CachedFile::Reserve(uint64_t minSize) {
 	return size;
 }
 
+bool CachedFile::PunchHole(uint64_t offset, uint64_t length) {
+	if(!file || offset+length > size || length == 0)
+		return false;
+	return madvise((uint8_t*)ptr+offset, length, MADV_REMOVE) == 0;
+}
+
 #endif
 
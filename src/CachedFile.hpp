@@ -64,6 +64,10 @@ public:
 	uint64_t Resize(uint64_t newSize);
 	uint64_t Reserve(uint64_t minSize);
 	
+	// releases disk and memory pages backing given range, range reads as zeros
+	// afterwards, offset and length should be page aligned
+	bool PunchHole(uint64_t offset, uint64_t length);
+	
 	template<typename T=void>
 	inline T* Origin() {return (T*)ptr;}
 	template<typename T=void>
@@ -0,0 +1,395 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ConcurrentHashMapFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+ConcurrentHashMapFile::ConcurrentHashMapFile() : current(NULL),
+	hashFunction(hash::HASH64), maxLoadFactor(0.75) {
+	for(Stripe& stripe : stripes)
+		stripe.entries.store(0, std::memory_order_relaxed);
+	epochs.SetReclaimHook([](uint64_t table) {delete (Table*)table;});
+}
+
+ConcurrentHashMapFile::ConcurrentHashMapFile(const char* fileName,
+		hash::Function function) :
+	ConcurrentHashMapFile() {
+	Open(fileName, function);
+}
+
+ConcurrentHashMapFile::~ConcurrentHashMapFile() {
+	Close();
+}
+
+bool ConcurrentHashMapFile::Open(const char* fileName,
+		hash::Function function) {
+	Close();
+	this->fileName = fileName;
+	std::remove((this->fileName+".resize").c_str());
+	Table* table = OpenTable(fileName, initialGroups, function);
+	if(table == NULL)
+		return false;
+	hashFunction = (hash::Function)table->file.Origin<Header>()->hashFunction;
+	
+	// recount entries and undo marks of interrupted resize
+	for(Stripe& stripe : stripes)
+		stripe.entries.store(0, std::memory_order_relaxed);
+	uint64_t overflowed = 0;
+	for(uint64_t id=0; id<=table->mask; ++id) {
+		Group& group = table->groups[id];
+		group.version = 0;
+		group.flags &= ~(uint64_t)MOVED;
+		overflowed += (group.flags & OVERFLOW) != 0;
+		for(uint64_t slot=0; slot<3; ++slot)
+			if(group.keys[slot] != EMPTY)
+				stripes[StripeOf(HashKey(group.keys[slot]))].entries++;
+	}
+	table->overflowed.store(overflowed, std::memory_order_relaxed);
+	current.store(table, std::memory_order_release);
+	return true;
+}
+
+void ConcurrentHashMapFile::Close() {
+	Table* table = current.load(std::memory_order_acquire);
+	if(table == NULL)
+		return;
+	while(table->successor.load(std::memory_order_acquire)) {
+		HelpMigrate(table);
+		table = current.load(std::memory_order_acquire);
+	}
+	current.store(NULL, std::memory_order_release);
+	delete table;
+	epochs.Collect();
+}
+
+ConcurrentHashMapFile::Table* ConcurrentHashMapFile::OpenTable(
+		const char* fileName, uint64_t groups, hash::Function function) {
+	Table* table = new Table;
+	if(!table->file.Open(fileName)) {
+		delete table;
+		return NULL;
+	}
+	if(table->file.Size() < sizeof(Header)) {
+		table->file.Resize(sizeof(Header) + groups*sizeof(Group));
+		table->file.Origin<Header>()->groups = groups;
+		table->file.Origin<Header>()->hashFunction = function;
+		Group* g = table->file.Origin<Group>(sizeof(Header));
+		for(uint64_t id=0; id<groups; ++id) {
+			g[id].version = 0;
+			g[id].flags = 0;
+			std::fill(g[id].keys, g[id].keys+3, EMPTY);
+			std::fill(g[id].values, g[id].values+3, 0);
+		}
+	}
+	groups = table->file.Origin<Header>()->groups;
+	table->groups = table->file.Origin<Group>(sizeof(Header));
+	table->mask = groups-1;
+	table->shift = 64 - __builtin_ctzll(groups);
+	table->successor.store(NULL, std::memory_order_relaxed);
+	table->claimed.store(0, std::memory_order_relaxed);
+	table->migrated.store(0, std::memory_order_relaxed);
+	table->overflowed.store(0, std::memory_order_relaxed);
+	return table;
+}
+
+
+
+void ConcurrentHashMapFile::Read(Group& group, Group& copy) {
+	std::atomic_ref<uint64_t> version(group.version);
+	for(;;) {
+		const uint64_t v = version.load(std::memory_order_acquire);
+		if(v & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+		copy.flags = Load(group.flags);
+		for(uint64_t slot=0; slot<3; ++slot) {
+			copy.keys[slot] = Load(group.keys[slot]);
+			copy.values[slot] = Load(group.values[slot]);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(version.load(std::memory_order_relaxed) == v)
+			return;
+	}
+}
+
+void ConcurrentHashMapFile::Lock(Group& group) {
+	std::atomic_ref<uint64_t> version(group.version);
+	for(;;) {
+		uint64_t v = version.load(std::memory_order_relaxed);
+		if(!(v & 1) && version.compare_exchange_weak(v, v+1,
+					std::memory_order_acquire))
+			break;
+		std::this_thread::yield();
+	}
+	// odd version has to be visible before any modified field
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void ConcurrentHashMapFile::Unlock(Group& group) {
+	std::atomic_ref<uint64_t> version(group.version);
+	version.store(version.load(std::memory_order_relaxed)+1,
+			std::memory_order_release);
+}
+
+
+
+bool ConcurrentHashMapFile::Find(Table* table, uint64_t key, uint64_t keyHash,
+		Group*& group, uint64_t& slot, uint64_t& value, bool& moved) {
+	moved = false;
+	uint64_t id = Home(table, keyHash);
+	for(uint64_t probe=0; probe<=table->mask; ++probe) {
+		Group copy;
+		Read(table->groups[id], copy);
+		if(copy.flags & MOVED) {
+			moved = true;
+		} else {
+			for(slot=0; slot<3; ++slot) {
+				if(copy.keys[slot] == key) {
+					group = &table->groups[id];
+					value = copy.values[slot];
+					return true;
+				}
+			}
+		}
+		if(!(copy.flags & OVERFLOW))
+			break;
+		id = (id+1) & table->mask;
+	}
+	return false;
+}
+
+bool ConcurrentHashMapFile::Insert(Table* table, uint64_t key, uint64_t keyHash,
+		uint64_t value) {
+	uint64_t id = Home(table, keyHash);
+	for(uint64_t probe=0; probe<=table->mask; ++probe) {
+		Group& group = table->groups[id];
+		Lock(group);
+		if(group.flags & MOVED) {
+			Unlock(group);
+			return false;
+		}
+		for(uint64_t slot=0; slot<3; ++slot) {
+			if(group.keys[slot] == EMPTY) {
+				Store(group.values[slot], value);
+				Store(group.keys[slot], key);
+				Unlock(group);
+				return true;
+			}
+		}
+		if(!(group.flags & OVERFLOW)) {
+			Store(group.flags, group.flags | OVERFLOW);
+			table->overflowed.fetch_add(1, std::memory_order_relaxed);
+		}
+		Unlock(group);
+		id = (id+1) & table->mask;
+	}
+	throw std::runtime_error("ConcurrentHashMapFile: table is full");
+}
+
+
+
+bool ConcurrentHashMapFile::get(uint64_t key, uint64_t& value) {
+	if(key == EMPTY)
+		return false;
+	const uint64_t keyHash = HashKey(key);
+	EpochManager::Guard guard(epochs);
+	Table* table = current.load(std::memory_order_acquire);
+	while(table) {
+		Group* group;
+		uint64_t slot;
+		bool moved;
+		if(Find(table, key, keyHash, group, slot, value, moved))
+			return true;
+		if(!moved)
+			return false;
+		table = table->successor.load(std::memory_order_acquire);
+	}
+	return false;
+}
+
+bool ConcurrentHashMapFile::put(uint64_t key, uint64_t value) {
+	if(key == EMPTY)
+		throw std::runtime_error("ConcurrentHashMapFile: EMPTY key can not be stored");
+	const uint64_t keyHash = HashKey(key);
+	Stripe& stripe = stripes[StripeOf(keyHash)];
+	EpochManager::Guard guard(epochs);
+	std::lock_guard lock(stripe.mutex);
+	for(;;) {
+		Table* table = WritableTable(keyHash);
+		Group* group;
+		uint64_t slot, old;
+		bool moved;
+		if(Find(table, key, keyHash, group, slot, old, moved)) {
+			// slot with key of this stripe can be changed only by migration
+			Lock(*group);
+			moved = group->flags & MOVED;
+			if(!moved)
+				Store(group->values[slot], value);
+			Unlock(*group);
+			if(moved)
+				continue;
+			return false;
+		}
+		if(moved || !Insert(table, key, keyHash, value))
+			continue;
+		const uint64_t entries = stripe.entries.load(std::memory_order_relaxed)+1;
+		stripe.entries.store(entries, std::memory_order_relaxed);
+		CheckLoad(table, entries);
+		return true;
+	}
+}
+
+bool ConcurrentHashMapFile::erase(uint64_t key) {
+	if(key == EMPTY)
+		return false;
+	const uint64_t keyHash = HashKey(key);
+	Stripe& stripe = stripes[StripeOf(keyHash)];
+	EpochManager::Guard guard(epochs);
+	std::lock_guard lock(stripe.mutex);
+	for(;;) {
+		Table* table = WritableTable(keyHash);
+		Group* group;
+		uint64_t slot, old;
+		bool moved;
+		if(!Find(table, key, keyHash, group, slot, old, moved)) {
+			if(moved)
+				continue;
+			return false;
+		}
+		Lock(*group);
+		moved = group->flags & MOVED;
+		if(!moved)
+			Store(group->keys[slot], EMPTY);
+		Unlock(*group);
+		if(moved)
+			continue;
+		stripe.entries.store(stripe.entries.load(std::memory_order_relaxed)-1,
+				std::memory_order_relaxed);
+		return true;
+	}
+}
+
+uint64_t ConcurrentHashMapFile::size() {
+	uint64_t sum = 0;
+	for(Stripe& stripe : stripes)
+		sum += stripe.entries.load(std::memory_order_relaxed);
+	return sum;
+}
+
+uint64_t ConcurrentHashMapFile::capacity() {
+	EpochManager::Guard guard(epochs);
+	return (current.load(std::memory_order_acquire)->mask+1)*3;
+}
+
+uint64_t ConcurrentHashMapFile::overflowed() {
+	EpochManager::Guard guard(epochs);
+	return current.load(std::memory_order_acquire)->overflowed.load(
+			std::memory_order_relaxed);
+}
+
+
+
+ConcurrentHashMapFile::Table* ConcurrentHashMapFile::WritableTable(
+		uint64_t keyHash) {
+	Table* table = current.load(std::memory_order_acquire);
+	while(Table* successor = table->successor.load(std::memory_order_acquire)) {
+		HelpMigrate(table);
+		// whole probe path of key has to be migrated before key is
+		// modified in successor
+		uint64_t id = Home(table, keyHash);
+		for(uint64_t probe=0; probe<=table->mask; ++probe) {
+			MigrateGroup(table, id);
+			if(!(Load(table->groups[id].flags) & OVERFLOW))
+				break;
+			id = (id+1) & table->mask;
+		}
+		table = successor;
+	}
+	return table;
+}
+
+void ConcurrentHashMapFile::CheckLoad(Table* table, uint64_t stripeEntries) {
+	const uint64_t slots = (table->mask+1)*3;
+	uint64_t entries = stripeEntries*stripesCount;
+	// estimate from single stripe is too coarse for small tables
+	if(slots < stripesCount*64)
+		entries = size();
+	if(entries > maxLoadFactor*slots)
+		StartResize(table, (table->mask+1)*2);
+	else if(table->overflowed.load(std::memory_order_relaxed) > (table->mask+1)/2)
+		StartResize(table, table->mask+1);
+}
+
+void ConcurrentHashMapFile::StartResize(Table* table, uint64_t groups) {
+	std::lock_guard lock(resizeMutex);
+	if(current.load(std::memory_order_acquire) != table ||
+			table->successor.load(std::memory_order_acquire))
+		return;
+	const std::string name = fileName+".resize";
+	std::remove(name.c_str());
+	Table* successor = OpenTable(name.c_str(), groups, hashFunction);
+	if(successor == NULL)
+		throw std::runtime_error("ConcurrentHashMapFile: cannot create "
+				+ name);
+	table->successor.store(successor, std::memory_order_release);
+}
+
+void ConcurrentHashMapFile::MigrateGroup(Table* table, uint64_t id) {
+	Group& group = table->groups[id];
+	Lock(group);
+	if(!(group.flags & MOVED)) {
+		Table* successor = table->successor.load(std::memory_order_acquire);
+		for(uint64_t slot=0; slot<3; ++slot) {
+			const uint64_t key = group.keys[slot];
+			if(key != EMPTY)
+				Insert(successor, key, HashKey(key), group.values[slot]);
+		}
+		Store(group.flags, group.flags | MOVED);
+	}
+	Unlock(group);
+}
+
+void ConcurrentHashMapFile::HelpMigrate(Table* table) {
+	const uint64_t groups = table->mask+1;
+	const uint64_t begin = table->claimed.fetch_add(migrationChunk,
+			std::memory_order_relaxed);
+	if(begin >= groups)
+		return;
+	const uint64_t end = std::min(begin+migrationChunk, groups);
+	for(uint64_t id=begin; id<end; ++id)
+		MigrateGroup(table, id);
+	if(table->migrated.fetch_add(end-begin, std::memory_order_acq_rel)
+			+ (end-begin) == groups)
+		FinishResize(table);
+}
+
+void ConcurrentHashMapFile::FinishResize(Table* table) {
+	std::lock_guard lock(resizeMutex);
+	std::rename((fileName+".resize").c_str(), fileName.c_str());
+	current.store(table->successor.load(std::memory_order_acquire),
+			std::memory_order_release);
+	// runs inside Guard of put() or erase(), Retire() and Collect() do not wait
+	epochs.Retire((uint64_t)table);
+	epochs.Collect();
+}
+
@@ -0,0 +1,180 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENT_HASH_MAP_FILE_HPP
+#define CONCURRENT_HASH_MAP_FILE_HPP
+
+#include "CachedFile.hpp"
+#include "Epoch.hpp"
+#include "Hash.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+/*
+ *  File backed map of uint64_t keys to uint64_t values, safe to use from
+ *  many threads at once.
+ *  
+ *  Table is an array of 64 byte groups with 3 entries each, probed linearly
+ *  from home group of key. Every group has version counter used as seqlock:
+ *  readers copy group and retry when version changed or was odd, writers
+ *  make it odd for the moment of modification. Writers of the same key are
+ *  serialized by striped mutexes selected by key hash.
+ *  
+ *  When table gets too full, table of double size is created in
+ *  <fileName>.resize and every writer migrates a chunk of groups before its
+ *  own operation (and groups on probe path of its key). Migrated groups
+ *  keep their entries and are only marked, readers which meet such group on
+ *  probe path of key search also new table. Last migrating thread replaces
+ *  <fileName> with new table, old table is freed after epoch grace period.
+ *  
+ *  Overflow marks of groups are not cleared when keys are erased. When more
+ *  than half of groups is marked, table is migrated the same way to new
+ *  table of the same size, which has only marks of keys still present.
+ *  
+ *  Resize is not crash safe: after interrupted resize, Open() restores table
+ *  from before resize and writes done to new table are lost.
+ */
+
+class ConcurrentHashMapFile {
+public:
+	
+	const static uint64_t EMPTY = -1;		// this key can not be stored
+	const static uint64_t stripeBits = 8;
+	const static uint64_t stripesCount = 1 << stripeBits;
+	const static uint64_t initialGroups = 64;
+	const static uint64_t migrationChunk = 64;	// groups migrated per operation
+	
+	ConcurrentHashMapFile();
+	ConcurrentHashMapFile(const char* fileName,
+			hash::Function function=hash::HASH64);
+	~ConcurrentHashMapFile();
+	
+	// function is used only when file is created, otherwise stored one
+	bool Open(const char* fileName, hash::Function function=hash::HASH64);
+	void Close();		// requires no concurrent operations
+	
+	inline operator bool() const {return current.load() != NULL;}
+	
+	// EMPTY key is never found, put() of it throws std::runtime_error
+	bool get(uint64_t key, uint64_t& value);
+	bool put(uint64_t key, uint64_t value);		// returns true if key was new
+	bool erase(uint64_t key);					// returns false if key was not present
+	
+	uint64_t size();
+	uint64_t capacity();	// entries in current table
+	uint64_t overflowed();	// groups with overflow mark in current table
+	
+	inline void SetMaxLoadFactor(double value) {maxLoadFactor = value;}
+	inline hash::Function GetHashFunction() const {return hashFunction;}
+	
+private:
+	
+	enum Flags : uint64_t {
+		OVERFLOW = 1,	// some key probed past this group
+		MOVED = 2		// group was migrated to successor table
+	};
+	
+	struct alignas(64) Group {
+		uint64_t version;
+		uint64_t flags;
+		uint64_t keys[3];
+		uint64_t values[3];
+	};
+	
+	struct Header {
+		uint64_t groups;
+		uint64_t hashFunction;
+		uint64_t reserved[6];
+	};
+	
+	struct Table {
+		CachedFile file;
+		Group* groups;
+		uint64_t mask;
+		uint64_t shift;
+		std::atomic<Table*> successor;
+		std::atomic<uint64_t> claimed;
+		std::atomic<uint64_t> migrated;
+		std::atomic<uint64_t> overflowed;	// groups with OVERFLOW flag
+	};
+	
+	struct alignas(64) Stripe {
+		std::mutex mutex;
+		std::atomic<uint64_t> entries;	// modified only under mutex
+	};
+	
+	static_assert(sizeof(Group) == 64);
+	static_assert(sizeof(Header) == 64);
+	
+	static Table* OpenTable(const char* fileName, uint64_t groups,
+			hash::Function function);
+	
+	static inline uint64_t Load(const uint64_t& v) {
+		return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(v)).load(
+				std::memory_order_relaxed);
+	}
+	static inline void Store(uint64_t& v, uint64_t value) {
+		std::atomic_ref<uint64_t>(v).store(value, std::memory_order_relaxed);
+	}
+	
+	static void Read(Group& group, Group& copy);
+	static void Lock(Group& group);
+	static void Unlock(Group& group);
+	
+	inline uint64_t HashKey(uint64_t key) const {
+		return hash::hash(hashFunction, key);
+	}
+	// FNV of single word mixes only towards high bits, multiplicative
+	// hashing spreads it before top bits are taken
+	static inline uint64_t Home(const Table* table, uint64_t keyHash) {
+		return (keyHash*0x9E3779B97F4A7C15llu) >> table->shift;
+	}
+	static inline uint64_t StripeOf(uint64_t keyHash) {
+		return (keyHash*0xC2B2AE3D27D4EB4Fllu) >> (64-stripeBits);
+	}
+	
+	/*
+	 *  Searches whole probe path of key, moved groups are skipped and
+	 *  reported in moved, then key can be also present in successor table.
+	 */
+	bool Find(Table* table, uint64_t key, uint64_t keyHash, Group*& group,
+			uint64_t& slot, uint64_t& value, bool& moved);
+	// returns false when moved group was met and operation needs to restart
+	bool Insert(Table* table, uint64_t key, uint64_t keyHash,
+			uint64_t value);
+	
+	Table* WritableTable(uint64_t keyHash);
+	void CheckLoad(Table* table, uint64_t stripeEntries);
+	void StartResize(Table* table, uint64_t groups);
+	void MigrateGroup(Table* table, uint64_t id);
+	void HelpMigrate(Table* table);
+	void FinishResize(Table* table);
+	
+	std::atomic<Table*> current;
+	std::string fileName;
+	hash::Function hashFunction;
+	double maxLoadFactor;
+	std::mutex resizeMutex;
+	Stripe stripes[stripesCount];
+	EpochManager epochs;
+};
+
+#endif
+
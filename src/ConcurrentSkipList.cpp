@@ -0,0 +1,256 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ConcurrentSkipList.hpp"
+
+#include <new>
+
+ConcurrentSkipList::ConcurrentSkipList() : height(1), count(0) {
+	head = NewNode(0, maxHeight);
+	epochs.SetReclaimHook([](uint64_t node) {DeleteNode((Node*)node);});
+}
+
+ConcurrentSkipList::~ConcurrentSkipList() {
+	Node* node = head;
+	while(node) {
+		Node* next = Ptr(node->next[0].load(std::memory_order_relaxed));
+		DeleteNode(node);
+		node = next;
+	}
+}
+
+ConcurrentSkipList::Node* ConcurrentSkipList::NewNode(uint64_t value,
+		uint32_t height) {
+	void* memory = ::operator new(sizeof(Node) +
+			height*sizeof(std::atomic<uintptr_t>));
+	Node* node = new(memory) Node;
+	node->value = value;
+	node->height = height;
+	node->state.store(0, std::memory_order_relaxed);
+	for(uint32_t l=0; l<height; ++l)
+		new(&node->next[l]) std::atomic<uintptr_t>(0);
+	return node;
+}
+
+void ConcurrentSkipList::DeleteNode(Node* node) {
+	node->~Node();
+	::operator delete(node);
+}
+
+uint32_t ConcurrentSkipList::RandomHeight() {
+	thread_local uint64_t seed = (uint64_t)&seed * 0x9E3779B97F4A7C15llu + 1;
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	// geometric distribution with p = 1/2
+	return __builtin_ctzll(seed | (1llu << (maxHeight-1))) + 1;
+}
+
+void ConcurrentSkipList::Release(Node* node, State state) {
+	if(node->state.fetch_or(state, std::memory_order_acq_rel) ==
+			(LINKED | REMOVED) - state) {
+		std::lock_guard lock(retireMutex);
+		epochs.Retire((uint64_t)node);
+	}
+}
+
+
+
+bool ConcurrentSkipList::Search(uint64_t value, Node** preds, Node** succs,
+		bool pastEqual) {
+retry:
+	Node* pred = head;
+	for(int l=maxHeight-1; l>=0; --l) {
+		Node* curr = Ptr(pred->next[l].load(std::memory_order_acquire));
+		while(curr) {
+			uintptr_t succ = curr->next[l].load(std::memory_order_acquire);
+			if(Marked(succ)) {
+				uintptr_t expected = (uintptr_t)curr;
+				if(!pred->next[l].compare_exchange_strong(expected,
+							succ & ~(uintptr_t)1, std::memory_order_acq_rel))
+					goto retry;
+				curr = Ptr(succ);
+			} else if(curr->value < value ||
+					(pastEqual && curr->value == value)) {
+				pred = curr;
+				curr = Ptr(succ);
+			} else {
+				break;
+			}
+		}
+		preds[l] = pred;
+		succs[l] = curr;
+	}
+	return succs[0] && succs[0]->value == value;
+}
+
+ConcurrentSkipList::Node* ConcurrentSkipList::LowerBound(uint64_t value) {
+	Node* pred = head;
+	Node* curr = NULL;
+	for(int l=height.load(std::memory_order_relaxed)-1; l>=0; --l) {
+		curr = Ptr(pred->next[l].load(std::memory_order_acquire));
+		while(curr && curr->value < value) {
+			pred = curr;
+			curr = Ptr(curr->next[l].load(std::memory_order_acquire));
+		}
+	}
+	while(curr && Marked(curr->next[0].load(std::memory_order_acquire)))
+		curr = Ptr(curr->next[0].load(std::memory_order_acquire));
+	return curr;
+}
+
+
+
+bool ConcurrentSkipList::insert(uint64_t value) {
+	Node* preds[maxHeight];
+	Node* succs[maxHeight];
+	const uint32_t top = RandomHeight();
+	EpochManager::Guard guard(epochs);
+	
+	Node* node = NULL;
+	for(;;) {
+		if(Search(value, preds, succs)) {
+			if(node)
+				DeleteNode(node);
+			return false;
+		}
+		if(node == NULL)
+			node = NewNode(value, top);
+		for(uint32_t l=0; l<top; ++l)
+			node->next[l].store((uintptr_t)succs[l], std::memory_order_relaxed);
+		uintptr_t expected = (uintptr_t)succs[0];
+		if(preds[0]->next[0].compare_exchange_strong(expected, (uintptr_t)node,
+					std::memory_order_acq_rel))
+			break;
+	}
+	count.fetch_add(1, std::memory_order_relaxed);
+	
+	uint32_t h = height.load(std::memory_order_relaxed);
+	while(h < top && !height.compare_exchange_weak(h, top,
+				std::memory_order_relaxed)) {
+	}
+	
+	// node is in set now, upper levels only speed up searches
+	for(uint32_t l=1; l<top; ++l) {
+		for(;;) {
+			uintptr_t next = node->next[l].load(std::memory_order_acquire);
+			if(Marked(next))
+				goto erased;
+			if(next != (uintptr_t)succs[l] &&
+					!node->next[l].compare_exchange_strong(next,
+						(uintptr_t)succs[l], std::memory_order_acq_rel))
+				goto erased;
+			uintptr_t expected = (uintptr_t)succs[l];
+			if(preds[l]->next[l].compare_exchange_strong(expected,
+						(uintptr_t)node, std::memory_order_acq_rel))
+				break;
+			Search(value, preds, succs);
+			if(succs[0] != node)
+				goto erased;
+		}
+	}
+	if(Marked(node->next[0].load(std::memory_order_acquire))) {
+erased:
+		// eraser could miss levels linked after its search
+		Search(value, preds, succs, true);
+	}
+	Release(node, LINKED);
+	return true;
+}
+
+bool ConcurrentSkipList::erase(uint64_t value) {
+	Node* preds[maxHeight];
+	Node* succs[maxHeight];
+	EpochManager::Guard guard(epochs);
+	if(!Search(value, preds, succs))
+		return false;
+	Node* node = succs[0];
+	for(int l=node->height-1; l>=1; --l) {
+		uintptr_t next = node->next[l].load(std::memory_order_acquire);
+		while(!Marked(next) && !node->next[l].compare_exchange_weak(next,
+					next | 1, std::memory_order_acq_rel)) {
+		}
+	}
+	uintptr_t next = node->next[0].load(std::memory_order_acquire);
+	for(;;) {
+		if(Marked(next))
+			return false;	// erased by other thread
+		if(node->next[0].compare_exchange_weak(next, next | 1,
+					std::memory_order_acq_rel))
+			break;
+	}
+	count.fetch_sub(1, std::memory_order_relaxed);
+	Search(value, preds, succs, true);
+	Release(node, REMOVED);
+	return true;
+}
+
+
+
+bool ConcurrentSkipList::find(uint64_t value) {
+	EpochManager::Guard guard(epochs);
+	Node* node = LowerBound(value);
+	return node && node->value == value;
+}
+
+bool ConcurrentSkipList::find_ge(uint64_t value, uint64_t& result) {
+	EpochManager::Guard guard(epochs);
+	Node* node = LowerBound(value);
+	if(node)
+		result = node->value;
+	return node;
+}
+
+bool ConcurrentSkipList::find_le(uint64_t value, uint64_t& result) {
+	EpochManager::Guard guard(epochs);
+	for(;;) {
+		// last node not greater than value, list has no backward links, so
+		// search is repeated below erased one
+		Node* pred = head;
+		for(int l=height.load(std::memory_order_relaxed)-1; l>=0; --l) {
+			Node* curr = Ptr(pred->next[l].load(std::memory_order_acquire));
+			while(curr && curr->value <= value) {
+				pred = curr;
+				curr = Ptr(curr->next[l].load(std::memory_order_acquire));
+			}
+		}
+		if(pred == head)
+			return false;
+		if(!Marked(pred->next[0].load(std::memory_order_acquire))) {
+			result = pred->value;
+			return true;
+		}
+		if(pred->value == 0)
+			return false;
+		value = pred->value - 1;
+	}
+}
+
+std::pmr::vector<uint64_t> ConcurrentSkipList::range(uint64_t min,
+		uint64_t max, std::pmr::memory_resource* resource) {
+	std::pmr::vector<uint64_t> values(resource);
+	EpochManager::Guard guard(epochs);
+	for(Node* node=LowerBound(min); node && node->value<=max;) {
+		const uintptr_t next = node->next[0].load(std::memory_order_acquire);
+		if(!Marked(next))
+			values.push_back(node->value);
+		node = Ptr(next);
+	}
+	return values;
+}
+
@@ -0,0 +1,105 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENT_SKIP_LIST_HPP
+#define CONCURRENT_SKIP_LIST_HPP
+
+#include "Epoch.hpp"
+
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+/*
+ *  In memory lock free ordered set of uint64_t values, any number of
+ *  threads can insert, erase and search at once.
+ *  
+ *  Skip list with marked next pointers: erase first marks links of node
+ *  from top level down, node is removed when its bottom link gets marked,
+ *  then searches unlink it from every level. Readers never modify links
+ *  and step over marked nodes. Unlinked nodes are freed through
+ *  EpochManager after both eraser and inserter (which can still be linking
+ *  upper levels) are done with them.
+ */
+
+class ConcurrentSkipList {
+public:
+	
+	const static uint32_t maxHeight = 32;
+	
+	ConcurrentSkipList();
+	~ConcurrentSkipList();		// requires no concurrent operations
+	
+	ConcurrentSkipList(const ConcurrentSkipList&) = delete;
+	ConcurrentSkipList& operator=(const ConcurrentSkipList&) = delete;
+	
+	bool insert(uint64_t value);	// returns false if value was present
+	bool erase(uint64_t value);		// returns false if value was not present
+	
+	bool find(uint64_t value);
+	bool find_ge(uint64_t value, uint64_t& result);	// first element not lower than value
+	bool find_le(uint64_t value, uint64_t& result);	// first element not grater then value
+	
+	// returns all values in [min, max] present during traversal
+	std::pmr::vector<uint64_t> range(uint64_t min, uint64_t max,
+			std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+	
+	inline uint64_t size() const {return count.load(std::memory_order_relaxed);}
+	
+private:
+	
+	enum State : uint32_t {
+		LINKED = 1,		// inserter finished linking upper levels
+		REMOVED = 2		// eraser finished unlinking
+	};
+	
+	struct Node {
+		uint64_t value;
+		uint32_t height;
+		std::atomic<uint32_t> state;
+		std::atomic<uintptr_t> next[];	// lowest bit marks erased node
+	};
+	
+	static inline Node* Ptr(uintptr_t link) {return (Node*)(link & ~(uintptr_t)1);}
+	static inline bool Marked(uintptr_t link) {return link & 1;}
+	
+	static Node* NewNode(uint64_t value, uint32_t height);
+	static void DeleteNode(Node* node);
+	static uint32_t RandomHeight();
+	
+	/*
+	 *  Fills predecessors and successors of value on every level, unlinking
+	 *  marked nodes on the way. With pastEqual, nodes equal to value are
+	 *  passed too, so every marked node with that value is unlinked.
+	 */
+	bool Search(uint64_t value, Node** preds, Node** succs,
+			bool pastEqual=false);
+	// first node not lower than value at bottom level, without unlinking
+	Node* LowerBound(uint64_t value);
+	void Release(Node* node, State state);
+	
+	Node* head;
+	std::atomic<uint32_t> height;
+	std::atomic<uint64_t> count;
+	EpochManager epochs;
+	std::mutex retireMutex;		// EpochManager takes retired items from one thread
+};
+
+#endif
+
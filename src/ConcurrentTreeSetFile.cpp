@@ -0,0 +1,190 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ConcurrentTreeSetFile.hpp"
+
+ConcurrentTreeSetFile::ConcurrentTreeSetFile(AllocatorType* allocator,
+		EpochManager* epochs) : ptr(-1), allocator(allocator),
+	epochs(epochs) {
+}
+
+ConcurrentTreeSetFile::ConcurrentTreeSetFile(uint64_t treeManagerNode,
+		AllocatorType* allocator, EpochManager* epochs) :
+	ConcurrentTreeSetFile(allocator, epochs) {
+	ptr = treeManagerNode;
+}
+
+void ConcurrentTreeSetFile::InitNewTree() {
+	ptr = AllocateBlock();
+	GetRoot().root = -1;
+	GetRoot().nodes = 0;
+}
+
+void ConcurrentTreeSetFile::DestroyTree() {
+	if(ptr != -1) {
+		DestroyBranch(GetRoot().root);
+		allocator->FreeBlock(ptr);
+		ptr = -1;
+	}
+}
+
+void ConcurrentTreeSetFile::DestroyBranch(uint64_t block) {
+	while(block != -1) {
+		DestroyBranch(Get(block).left);
+		uint64_t right = Get(block).right;
+		allocator->FreeBlock(block);
+		block = right;
+	}
+}
+
+uint64_t ConcurrentTreeSetFile::AllocateBlock() {
+	if(allocator->FreeBlocks() == 0) {
+		// memory file will be resized and remapped
+		EpochManager::ExclusiveGuard guard(*epochs);
+		return allocator->AllocateBlock();
+	}
+	return allocator->AllocateBlock();
+}
+
+void ConcurrentTreeSetFile::Replace(uint64_t parent, uint64_t old,
+		uint64_t block) {
+	if(block != -1)
+		Get(block).parent = parent;
+	if(parent == -1)
+		Store(GetRoot().root, block);
+	else if(Get(parent).left == old)
+		Store(Get(parent).left, block);
+	else
+		Store(Get(parent).right, block);
+}
+
+bool ConcurrentTreeSetFile::insert(uint64_t value) {
+	uint64_t parent = -1, block = GetRoot().root;
+	bool left = false;
+	while(block != -1) {
+		uint64_t v = Get(block).value;
+		if(v == value)
+			return false;
+		parent = block;
+		left = value < v;
+		block = left ? Get(block).left : Get(block).right;
+	}
+	
+	block = AllocateBlock();
+	Block& b = Get(block);
+	b.value = value;
+	b.parent = parent;
+	b.left = -1;
+	b.right = -1;
+	// release store makes initialized block visible to readers
+	if(parent == -1)
+		Store(GetRoot().root, block);
+	else if(left)
+		Store(Get(parent).left, block);
+	else
+		Store(Get(parent).right, block);
+	Store(GetRoot().nodes, GetRoot().nodes+1);
+	return true;
+}
+
+bool ConcurrentTreeSetFile::erase(uint64_t value) {
+	uint64_t block = GetRoot().root;
+	while(block != -1) {
+		uint64_t v = Get(block).value;
+		if(v == value)
+			break;
+		block = value < v ? Get(block).left : Get(block).right;
+	}
+	if(block == -1)
+		return false;
+	
+	if(Get(block).left != -1 && Get(block).right != -1) {
+		uint64_t next = Get(block).right;
+		while(Get(next).left != -1)
+			next = Get(next).left;
+		// successor value is present twice until it is unlinked, readers
+		// which passed this node with old value have to leave first
+		Store(Get(block).value, Get(next).value);
+		epochs->Synchronize();
+		block = next;
+	}
+	
+	const Block& b = Get(block);
+	Replace(b.parent, block, b.left != -1 ? b.left : b.right);
+	Store(GetRoot().nodes, GetRoot().nodes-1);
+	epochs->Retire(block, [](void* allocator, uint64_t block) {
+				((AllocatorType*)allocator)->FreeBlock(block);
+			}, allocator);
+	return true;
+}
+
+bool ConcurrentTreeSetFile::find(uint64_t value) const {
+	EpochManager::Guard guard(*epochs);
+	uint64_t block = Load(GetRoot().root);
+	while(block != -1) {
+		const Block& b = Get(block);
+		uint64_t v = Load(b.value);
+		if(v == value)
+			return true;
+		block = value < v ? Load(b.left) : Load(b.right);
+	}
+	return false;
+}
+
+bool ConcurrentTreeSetFile::find_ge(uint64_t value, uint64_t& result) const {
+	EpochManager::Guard guard(*epochs);
+	uint64_t block = Load(GetRoot().root);
+	bool found = false;
+	while(block != -1) {
+		const Block& b = Get(block);
+		uint64_t v = Load(b.value);
+		if(v == value) {
+			result = v;
+			return true;
+		} else if(value < v) {
+			result = v;
+			found = true;
+			block = Load(b.left);
+		} else {
+			block = Load(b.right);
+		}
+	}
+	return found;
+}
+
+bool ConcurrentTreeSetFile::find_le(uint64_t value, uint64_t& result) const {
+	EpochManager::Guard guard(*epochs);
+	uint64_t block = Load(GetRoot().root);
+	bool found = false;
+	while(block != -1) {
+		const Block& b = Get(block);
+		uint64_t v = Load(b.value);
+		if(v == value) {
+			result = v;
+			return true;
+		} else if(value < v) {
+			block = Load(b.left);
+		} else {
+			result = v;
+			found = true;
+			block = Load(b.right);
+		}
+	}
+	return found;
+}
+
@@ -0,0 +1,107 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENT_TREE_SET_FILE_HPP
+#define CONCURRENT_TREE_SET_FILE_HPP
+
+#include "TreeSetFile.hpp"
+#include "Epoch.hpp"
+
+#include <atomic>
+
+/*
+ *  Set of uint64_t values with single writer and lock free readers, uses
+ *  the same node layout as TreeSetFile (TreeSetFormat::Wide).
+ *  
+ *  Writer publishes new links and values with release stores, readers only
+ *  descend from root with acquire loads, parent links are used only by
+ *  writer. Unlinked blocks are retired to EpochManager and freed after all
+ *  readers which could see them left. When allocation needs to resize
+ *  memory file, readers are excluded for that moment.
+ *  
+ *  EpochManager can be shared by several sets, each retired block carries
+ *  allocator of its set. Writers of all sets sharing it have to be
+ *  serialized, since EpochManager has single writer side.
+ *  
+ *  Erase of node with two children first copies successor value into node,
+ *  waits for grace period and only then unlinks successor, so readers never
+ *  miss value that is present in the set.
+ */
+
+class ConcurrentTreeSetFile {
+public:
+	
+	using AllocatorType = BlockAllocator<32>;
+	using Block = TreeSetFormat::Wide::Block;
+	
+	struct Root {
+		uint64_t root;
+		uint64_t nodes;
+	};
+	
+	ConcurrentTreeSetFile() : ptr(-1), allocator(NULL), epochs(NULL) {}
+	ConcurrentTreeSetFile(AllocatorType* allocator, EpochManager* epochs);
+	ConcurrentTreeSetFile(uint64_t treeManagerNode, AllocatorType* allocator,
+			EpochManager* epochs);
+	
+	inline operator bool() const {return ptr!=-1 && (bool)allocator && (bool)*allocator;}
+	
+	// writer side, one thread at a time
+	void InitNewTree();
+	void DestroyTree();			// requires no active readers
+	bool insert(uint64_t value);	// returns false if value was present
+	bool erase(uint64_t value);		// returns false if value was not present
+	
+	// reader side, any number of threads
+	bool find(uint64_t value) const;
+	bool find_ge(uint64_t value, uint64_t& result) const;	// first element not lower than value
+	bool find_le(uint64_t value, uint64_t& result) const;	// first element not grater then value
+	
+	inline uint64_t size() const {
+		return std::atomic_ref<uint64_t>(GetRoot().nodes).load(
+				std::memory_order_relaxed);
+	}
+	
+	inline uint64_t Ptr() const {return ptr;}
+	
+private:
+	
+	inline static uint64_t Load(const uint64_t& v) {
+		return std::atomic_ref<uint64_t>((uint64_t&)v).load(
+				std::memory_order_acquire);
+	}
+	inline static void Store(uint64_t& v, uint64_t value) {
+		std::atomic_ref<uint64_t>(v).store(value, std::memory_order_release);
+	}
+	
+	inline Block& Get(uint64_t block) const {
+		return *allocator->Origin<Block>(block);
+	}
+	inline Root& GetRoot() const {return *allocator->Origin<Root>(ptr);}
+	
+	uint64_t AllocateBlock();
+	void Replace(uint64_t parent, uint64_t old, uint64_t block);
+	void DestroyBranch(uint64_t block);
+	
+	uint64_t ptr;
+	AllocatorType* allocator;
+	EpochManager* epochs;
+};
+
+#endif
+
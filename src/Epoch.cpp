@@ -0,0 +1,148 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Epoch.hpp"
+
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+EpochManager::EpochManager() : epoch(1), exclusive(false),
+	collectThreshold(1024) {
+	for(Slot& slot : slots)
+		slot.epoch.store(0, std::memory_order_relaxed);
+}
+
+EpochManager::~EpochManager() {
+	for(const Retired& r : retired)
+		r.Reclaim(reclaim);
+}
+
+namespace {
+	// ids of exited threads are reused, so slots are limited by number of
+	// threads alive at once, not created during process lifetime
+	std::mutex threadIdsMutex;
+	std::vector<uint64_t> freeThreadIds;
+	uint64_t threadIds = 0;
+	
+	struct ThreadIdHolder {
+		uint64_t id;
+		ThreadIdHolder() {
+			std::lock_guard lock(threadIdsMutex);
+			if(freeThreadIds.empty()) {
+				id = threadIds++;
+			} else {
+				id = freeThreadIds.back();
+				freeThreadIds.pop_back();
+			}
+		}
+		~ThreadIdHolder() {
+			std::lock_guard lock(threadIdsMutex);
+			freeThreadIds.push_back(id);
+		}
+	};
+}
+
+uint64_t EpochManager::ThreadId() {
+	thread_local ThreadIdHolder holder;
+	if(holder.id >= maxThreads)
+		throw std::runtime_error("EpochManager: too many threads");
+	return holder.id;
+}
+
+void EpochManager::Enter() {
+	Slot& slot = slots[ThreadId()];
+	for(;;) {
+		while(exclusive.load(std::memory_order_acquire))
+			std::this_thread::yield();
+		// announcement has to be visible before exclusive flag and any link
+		// is read, pairs with fences in BeginExclusive() and Collect()
+		slot.epoch.store(epoch.load(std::memory_order_acquire),
+				std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(!exclusive.load(std::memory_order_acquire))
+			return;
+		slot.epoch.store(0, std::memory_order_release);
+	}
+}
+
+void EpochManager::Exit() {
+	slots[ThreadId()].epoch.store(0, std::memory_order_release);
+}
+
+void EpochManager::Retire(uint64_t item) {
+	Retire(item, NULL, NULL);
+}
+
+void EpochManager::Retire(uint64_t item, ReclaimFunction function,
+		void* context) {
+	retired.push_back({item, epoch.load(std::memory_order_relaxed), function,
+			context});
+	if(retired.size() >= collectThreshold)
+		Collect();
+}
+
+uint64_t EpochManager::Collect() {
+	uint64_t current = epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint64_t min = current;
+	for(Slot& slot : slots) {
+		uint64_t e = slot.epoch.load(std::memory_order_relaxed);
+		if(e && e < min)
+			min = e;
+	}
+	// readers which entered before item was retired have epoch <= its epoch
+	uint64_t reclaimed = 0;
+	for(uint64_t i=0; i<retired.size();) {
+		if(retired[i].epoch < min) {
+			retired[i].Reclaim(reclaim);
+			retired[i] = retired.back();
+			retired.pop_back();
+			++reclaimed;
+		} else {
+			++i;
+		}
+	}
+	return reclaimed;
+}
+
+void EpochManager::Synchronize() {
+	uint64_t target = epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for(Slot& slot : slots) {
+		for(;;) {
+			uint64_t e = slot.epoch.load(std::memory_order_acquire);
+			if(e == 0 || e >= target)
+				break;
+			std::this_thread::yield();
+		}
+	}
+}
+
+void EpochManager::BeginExclusive() {
+	exclusive.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for(Slot& slot : slots)
+		while(slot.epoch.load(std::memory_order_acquire))
+			std::this_thread::yield();
+}
+
+void EpochManager::EndExclusive() {
+	exclusive.store(false, std::memory_order_release);
+}
+
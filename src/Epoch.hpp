@@ -0,0 +1,135 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <cinttypes>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/*
+ *  Epoch based reclamation for structures with lock free readers and single
+ *  writer. Readers announce global epoch in their slot for the time of
+ *  critical section (Guard). Writer retires unlinked items with current
+ *  epoch, item is passed to its reclaim function, or to reclaim hook when
+ *  it was retired without one, when every active reader entered in later
+ *  epoch. Structures sharing one EpochManager pass own reclaim functions,
+ *  their writer side calls still have to be serialized.
+ *  
+ *  Synchronize() waits for grace period, after it returns no reader can
+ *  observe state from before the call.
+ *  
+ *  Writer can also exclude all readers for a moment (ExclusiveGuard), which
+ *  is needed when mapped file is resized and its origin moves. Readers spin
+ *  at entry while exclusive section is in progress.
+ *  
+ *  Every thread takes one slot on first use and returns it at exit, at most
+ *  maxThreads threads alive at once can use EpochManager. Writer must not
+ *  call Synchronize() or begin ExclusiveGuard while holding Guard, both
+ *  wait for its own slot. Retire() and Collect() never wait and can be
+ *  called inside Guard, items retired there are reclaimed only by Collect()
+ *  after that Guard ends.
+ */
+
+class EpochManager {
+public:
+	
+	const static uint64_t maxThreads = 256;
+	
+	using ReclaimFunction = void(*)(void* context, uint64_t item);
+	
+	class Guard {
+	public:
+		
+		inline Guard(EpochManager& manager) : manager(manager) {manager.Enter();}
+		inline ~Guard() {manager.Exit();}
+		Guard(const Guard&) = delete;
+		
+	private:
+		
+		EpochManager& manager;
+	};
+	
+	class ExclusiveGuard {
+	public:
+		
+		inline ExclusiveGuard(EpochManager& manager) : manager(manager) {
+			manager.BeginExclusive();
+		}
+		inline ~ExclusiveGuard() {manager.EndExclusive();}
+		ExclusiveGuard(const ExclusiveGuard&) = delete;
+		
+	private:
+		
+		EpochManager& manager;
+	};
+	
+	EpochManager();
+	~EpochManager();
+	
+	// reader side
+	void Enter();
+	void Exit();
+	
+	// writer side
+	inline void SetReclaimHook(std::function<void(uint64_t)> hook) {reclaim = hook;}
+	inline void SetCollectThreshold(uint64_t value) {collectThreshold = value;}
+	void Retire(uint64_t item);		// collects when threshold is reached
+	void Retire(uint64_t item, ReclaimFunction function, void* context);
+	uint64_t Collect();				// returns number of reclaimed items
+	void Synchronize();				// waits until readers active at call exit
+	void BeginExclusive();
+	void EndExclusive();
+	
+	inline uint64_t Pending() const {return retired.size();}
+	
+private:
+	
+	struct alignas(64) Slot {
+		std::atomic<uint64_t> epoch;	// 0 when outside of critical section
+	};
+	
+	struct Retired {
+		uint64_t item;
+		uint64_t epoch;
+		ReclaimFunction function;	// NULL when reclaim hook is used
+		void* context;
+		
+		inline void Reclaim(const std::function<void(uint64_t)>& hook) const {
+			if(function)
+				function(context, item);
+			else if(hook)
+				hook(item);
+		}
+	};
+	
+	static uint64_t ThreadId();
+	
+	Slot slots[maxThreads];
+	alignas(64) std::atomic<uint64_t> epoch;
+	std::atomic<bool> exclusive;
+	
+	std::vector<Retired> retired;
+	std::function<void(uint64_t)> reclaim;
+	uint64_t collectThreshold;
+};
+
+#endif
+
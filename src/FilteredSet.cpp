@@ -0,0 +1,90 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FilteredSet.hpp"
+
+#include <algorithm>
+#include <vector>
+
+FilteredSet::FilteredSet(TreeSetFile set, BloomFilterFile* filter) :
+	set(set), filter(filter), filtered(0) {
+	// filter file created after the tree, or left behind by it
+	if(filter->Keys() - filter->Stale() != set.size())
+		Rebuild();
+}
+
+TreeSetFile::Iterator FilteredSet::insert(uint64_t value) {
+	const uint64_t before = set.size();
+	TreeSetFile::Iterator it = set.insert(value);
+	if(set.size() != before) {
+		filter->insert(value);
+		if(filter->Keys() > filter->Capacity())
+			Rebuild();
+	}
+	return it;
+}
+
+TreeSetFile::Iterator FilteredSet::erase(uint64_t value) {
+	const uint64_t before = set.size();
+	TreeSetFile::Iterator it = set.erase(value);
+	if(set.size() != before) {
+		filter->MarkStale();
+		if(filter->Stale()*2 > filter->Keys())
+			Rebuild();
+	}
+	return it;
+}
+
+TreeSetFile::Iterator FilteredSet::find(uint64_t value) {
+	if(!filter->may_contain(value)) {
+		++filtered;
+		return set.end();
+	}
+	return set.find(value);
+}
+
+bool FilteredSet::contains(uint64_t value) {
+	return (bool)find(value);
+}
+
+void FilteredSet::contains_many(const uint64_t* values, bool* found,
+		uint64_t count) {
+	filter->may_contain_many(values, found, count);
+	for(uint64_t i=0; i<count; ++i) {
+		if(found[i])
+			found[i] = (bool)set.find(values[i]);
+		else
+			++filtered;
+	}
+}
+
+void FilteredSet::Rebuild() {
+	// room for doubling before next rebuild
+	filter->Reset(std::max<uint64_t>(set.size()*2, 1024));
+	std::vector<uint64_t> batch;
+	batch.reserve(4096);
+	for(TreeSetFile::Iterator it=set.begin(); it; ++it) {
+		batch.push_back(*it);
+		if(batch.size() == 4096) {
+			filter->insert_many(batch.data(), batch.size());
+			batch.clear();
+		}
+	}
+	filter->insert_many(batch.data(), batch.size());
+}
+
@@ -0,0 +1,64 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILTERED_SET_HPP
+#define FILTERED_SET_HPP
+
+#include "TreeSetFile.hpp"
+#include "BloomFilterFile.hpp"
+
+/*
+ *  TreeSetFile with Bloom filter checked before every lookup, so negative
+ *  find() costs one cache line of filter instead of walk down the tree.
+ *  Filter is maintained on insert, erased values stay in it as stale ones.
+ *  Filter is rebuilt from tree (compaction) when it holds more keys than it
+ *  was sized for, or when stale keys make half of it.
+ */
+
+class FilteredSet {
+public:
+	
+	FilteredSet(TreeSetFile set, BloomFilterFile* filter);
+	
+	inline TreeSetFile& Set() {return set;}
+	inline BloomFilterFile& Filter() {return *filter;}
+	
+	TreeSetFile::Iterator insert(uint64_t value);
+	TreeSetFile::Iterator erase(uint64_t value);
+	
+	TreeSetFile::Iterator find(uint64_t value);
+	bool contains(uint64_t value);
+	// found[i] tells whether values[i] is present, filter is probed in batch
+	void contains_many(const uint64_t* values, bool* found, uint64_t count);
+	
+	void Rebuild();
+	
+	inline uint64_t size() const {return set.size();}
+	
+	// lookups answered by filter alone
+	inline uint64_t FilteredLookups() const {return filtered;}
+	
+private:
+	
+	TreeSetFile set;
+	BloomFilterFile* filter;
+	uint64_t filtered;
+};
+
+#endif
+
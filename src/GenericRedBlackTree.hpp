@@ -22,6 +22,13 @@
 #include <cinttypes>
 #include <cstdio>
 
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "Interleaved.hpp"
+
 namespace Generic {
 
 	inline const static uint64_t BLACK = 0;
@@ -52,7 +59,35 @@ namespace Generic {
 		};
 	}
 	
-	template<typename Tree, typename NodeAccessor>
+	/*
+	 *  Ordering of keys by Compare, which must be stateless. Arithmetic keys
+	 *  with std::less are compared with built-in operators, also in constant
+	 *  expressions.
+	 */
+	template<typename Key, typename Compare>
+	struct KeyOrder {
+		constexpr static bool builtin = std::is_arithmetic_v<Key> &&
+			std::is_same_v<Compare, std::less<Key>>;
+		
+		inline constexpr static bool Less(const Key& a, const Key& b) {
+			if constexpr(builtin)
+				return a < b;
+			else
+				return Compare{}(a, b);
+		}
+	};
+	
+	/*
+	 *  NodeAccessor::Value(tree, node) returns key of node convertible to
+	 *  Key, nodes are ordered by Compare and equivalent keys are allowed.
+	 *  
+	 *  NodeAccessor may also provide Count(tree, node) and Count(tree, node,
+	 *  newCount) storing number of nodes in subtree of node. Tree keeps them
+	 *  up to date in O(log n) per insert and erase, which enables CountLower()
+	 *  and Select().
+	 */
+	template<typename Tree, typename NodeAccessor, typename Key=uint64_t,
+		typename Compare=std::less<Key>>
 	struct NodeImpl {
 		NodeImpl() = delete;
 		~NodeImpl() = delete;
@@ -67,7 +102,9 @@ namespace Generic {
 		inline void Right(Tree* tree, Node* newRight);
 		inline Node* Parent(Tree* tree);
 		inline void Parent(Tree* tree, Node* newParent);
-		inline uint64_t Value(Tree* tree);
+		inline Key Value(Tree* tree);
+		inline uint64_t Count(Tree* tree);
+		inline void Count(Tree* tree, uint64_t newCount);
 		
 		inline Node* Prev(Tree* tree);
 		inline Node* Next(Tree* tree);
@@ -75,68 +112,27 @@ namespace Generic {
 		inline Node* LeftMost(Tree* tree);
 		inline Node* RightMost(Tree* tree);
 
-		inline Node* FindGreaterEqual(Tree* tree, uint64_t value);
-		
-		
-		
+		inline Node* FindGreaterEqual(Tree* tree, const Key& value);
 		
-		
-		
-		inline uint64_t MinHeight(Tree* tree) {
-			if(Left(tree) && Right(tree)) {
-				uint64_t h=0;
-				h = Left(tree)->MinHeight(tree);
-				uint64_t y = Right(tree)->MinHeight(tree);
-				if(h > y)
-					h = y;
-				return h+1;
-			} else if(Left(tree) || Right(tree)) {
-				return 1;
-				uint64_t h=0;
-				if(Left(tree))
-					h = Left(tree)->MinHeight(tree);
-				if(Right(tree)) {
-					uint64_t y = Right(tree)->MinHeight(tree);
-					if(h > y)
-						h = y;
-				}
-				return h+1;
-			}
-			return 1;
-		}
-		
-		inline uint64_t Height(Tree* tree) {
-			uint64_t h = 0;
-			if(Left(tree))
-				h = Left(tree)->Height(tree);
-			if(Right(tree)) {
-				uint64_t y = Right(tree)->Height(tree);
-				if(h < y)
-					h = y;
-			}
-			return h+1;
-		}
-		
-		inline uint64_t VerifyParenting(bool print, Tree* tree, uint64_t d=0, char C='R', Node* parent=NULL) {
-			if(print) {
-				for(int i=0; i<d; ++i)
-					printf("    ");
-				printf(" %c %p  : parent (%p)\n", C, this, parent);
-			}
-			uint64_t sum = this->Parent(tree) != parent;
-			if(Left(tree))
-				sum += Left(tree)->VerifyParenting(print, tree, d+1, 'L', this);
-			if(Right(tree))
-				sum += Right(tree)->VerifyParenting(print, tree, d+1, 'R', this);
-			return sum;
-		}
+		// iterative traversals with explicit stack, red-black tree height
+		// is at most 2*log2(n+1) so stack stays small
+		inline uint64_t MinHeight(Tree* tree);
+		inline uint64_t Height(Tree* tree);
+		inline uint64_t VerifyParenting(bool print, Tree* tree);
 	};
 	
-	template<typename Tree, typename NodeAccessor>
+	template<typename Tree, typename NodeAccessor, typename Key=uint64_t,
+		typename Compare=std::less<Key>>
 	class RedBlackTree {
 	public:
 		
-		using Node = NodeImpl<Tree, NodeAccessor>;
+		using Node = NodeImpl<Tree, NodeAccessor, Key, Compare>;
+		using KeyType = Key;
+		
+		constexpr static bool counted = requires(Tree* t, void* n) {
+			NodeAccessor::Count(t, n);
+			NodeAccessor::Count(t, n, uint64_t());
+		};
 		
 		template<typename T=Node>
 		inline void Insert(T* node) { InsertImpl((Node*)node); }
@@ -169,16 +165,53 @@ namespace Generic {
 		}
 		
 		template<typename T=Node>
-		inline T* FindGreaterEqual(uint64_t value) {
+		inline T* FindGreaterEqual(const Key& value) {
 			if(Root())
 				return (T*)(Root()->FindGreaterEqual(tree, value));
 			return NULL;
 		}
 		
+		// order statistics of counted trees, O(log n)
+		
+		// returns number of nodes lower than value, or not greater than
+		// value when inclusive
+		uint64_t CountLower(const Key& value, bool inclusive=false);
+		
+		// returns id-th (from 0) lowest node or NULL
+		template<typename T=Node>
+		inline T* Select(uint64_t id) { return (T*)SelectImpl(id); }
+		
+		// batched FindGreaterEqual, up to 16 lookups descend in lockstep and
+		// next node of each one is prefetched before others are advanced
+		template<typename T=Node>
+		inline void FindGreaterEqualMany(std::span<const Key> values,
+				std::span<std::type_identity_t<T>*> out) {
+			FindGreaterEqualManyImpl(values,
+					std::span<Node*>((Node**)out.data(), out.size()));
+		}
+		
+		// coroutine version of FindGreaterEqual, suspends after prefetching
+		// every next node
+		LookupTask FindGreaterEqualTask(Key value, Node** result);
+		
+		// FindGreaterEqual of all values with group coroutines interleaved
+		template<typename T=Node>
+		inline void FindGreaterEqualInterleaved(std::span<const Key> values,
+				std::span<std::type_identity_t<T>*> out, uint64_t group=16) {
+			uint64_t count = values.size() < out.size() ? values.size()
+				: out.size();
+			RunInterleaved(count, group, [&](uint64_t i) {
+						return FindGreaterEqualTask(values[i], (Node**)&out[i]);
+					});
+		}
+		
 	private:
 		
 		void InsertImpl(Node* node);
 		void EraseImpl(Node* node);
+		Node* SelectImpl(uint64_t id);
+		void FindGreaterEqualManyImpl(std::span<const Key> values,
+				std::span<Node*> out);
 		
 		void BSTInsert(Node* node);
 		Node* RBTInsertFixUpForRightChildUncle(Node* node);
@@ -186,7 +219,22 @@ namespace Generic {
 		void RotateLeft(Node* x);
 		void RotateRight(Node* x);
 		
-// 		void RBTErase(Node* node);
+		void Transplant(Node* u, Node* v);
+		void EraseFixUp(Node* x, Node* parent);
+		
+		inline uint64_t Count(Node* node) {
+			return node ? node->Count(tree) : 0;
+		}
+		inline void UpdateCount(Node* node) {
+			if constexpr(counted)
+				node->Count(tree, Count(node->Left(tree)) +
+						Count(node->Right(tree)) + 1);
+		}
+		inline void AddCount(Node* node, int64_t diff) {
+			if constexpr(counted)
+				for(; node; node=node->Parent(tree))
+					node->Count(tree, node->Count(tree)+diff);
+		}
 		
 	public:
 		
@@ -61,48 +61,56 @@ namespace Generic {
 		}
 	}
 	
-	template<typename T, typename N>
-	inline uint64_t NodeImpl<T,N>::Color(T* tree) {
+	template<typename T, typename N, typename K, typename C>
+	inline uint64_t NodeImpl<T,N,K,C>::Color(T* tree) {
 		return N::Color(tree, this);
 	}
-	template<typename T, typename N>
-	void NodeImpl<T,N>::Color(T* tree, uint64_t newColor) {
+	template<typename T, typename N, typename K, typename C>
+	void NodeImpl<T,N,K,C>::Color(T* tree, uint64_t newColor) {
 		N::Color(tree, this, newColor);
 	}
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::Left(T* tree) {
-		return (NodeImpl<T,N>*)N::Left(tree, this);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::Left(T* tree) {
+		return (NodeImpl<T,N,K,C>*)N::Left(tree, this);
 	}
-	template<typename T, typename N>
-	void NodeImpl<T,N>::Left(T* tree, NodeImpl<T,N>* newLeft) {
+	template<typename T, typename N, typename K, typename C>
+	void NodeImpl<T,N,K,C>::Left(T* tree, NodeImpl<T,N,K,C>* newLeft) {
 		N::Left(tree, this, newLeft);
 	}
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::Right(T* tree) {
-		return (NodeImpl<T,N>*)N::Right(tree, this);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::Right(T* tree) {
+		return (NodeImpl<T,N,K,C>*)N::Right(tree, this);
 	}
-	template<typename T, typename N>
-	void NodeImpl<T,N>::Right(T* tree, NodeImpl<T,N>* newRight) {
+	template<typename T, typename N, typename K, typename C>
+	void NodeImpl<T,N,K,C>::Right(T* tree, NodeImpl<T,N,K,C>* newRight) {
 		N::Right(tree, this, newRight);
 	}
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::Parent(T* tree) {
-		return (NodeImpl<T,N>*)N::Parent(tree, this);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::Parent(T* tree) {
+		return (NodeImpl<T,N,K,C>*)N::Parent(tree, this);
 	}
-	template<typename T, typename N>
-	void NodeImpl<T,N>::Parent(T* tree, NodeImpl<T,N>* newParent) {
+	template<typename T, typename N, typename K, typename C>
+	void NodeImpl<T,N,K,C>::Parent(T* tree, NodeImpl<T,N,K,C>* newParent) {
 		N::Parent(tree, this, newParent);
 	}
-	template<typename T, typename N>
-	uint64_t NodeImpl<T,N>::Value(T* tree) {
+	template<typename T, typename N, typename K, typename C>
+	K NodeImpl<T,N,K,C>::Value(T* tree) {
 		return N::Value(tree, this);
 	}
+	template<typename T, typename N, typename K, typename C>
+	inline uint64_t NodeImpl<T,N,K,C>::Count(T* tree) {
+		return N::Count(tree, this);
+	}
+	template<typename T, typename N, typename K, typename C>
+	void NodeImpl<T,N,K,C>::Count(T* tree, uint64_t newCount) {
+		N::Count(tree, this, newCount);
+	}
 	
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::Prev(T* tree) {
-		NodeImpl<T,N>* node = Left(tree);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::Prev(T* tree) {
+		NodeImpl<T,N,K,C>* node = Left(tree);
 		if(node) {
-			NodeImpl<T,N>* next = NULL;
+			NodeImpl<T,N,K,C>* next = NULL;
 			while(true) {
 				next = node->Right(tree);
 				if(next == NULL)
@@ -113,7 +121,7 @@ namespace Generic {
 			// TODO: continue search
 			node = this;
 			while(true) {
-				NodeImpl<T,N>* parent = node->Parent(tree);
+				NodeImpl<T,N,K,C>* parent = node->Parent(tree);
 				if(parent == NULL)
 					return NULL;
 				if(parent->Right(tree) == node) {
@@ -126,11 +134,11 @@ namespace Generic {
 		}
 	}
 
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::Next(T* tree) {
-		NodeImpl<T,N>* node = Right(tree);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::Next(T* tree) {
+		NodeImpl<T,N,K,C>* node = Right(tree);
 		if(node) {
-			NodeImpl<T,N>* next = NULL;
+			NodeImpl<T,N,K,C>* next = NULL;
 			while(true) {
 				next = node->Left(tree);
 				if(next == NULL)
@@ -141,7 +149,7 @@ namespace Generic {
 			// TODO: continue search
 			node = this;
 			while(true) {
-				NodeImpl<T,N>* parent = node->Parent(tree);
+				NodeImpl<T,N,K,C>* parent = node->Parent(tree);
 				if(parent == NULL)
 					return NULL;
 				if(parent->Left(tree) == node) {
@@ -153,54 +161,123 @@ namespace Generic {
 		}
 	}
 	
-#define OFF(PTR) (((PTR)!=0)?(((uint64_t)(PTR))-((uint64_t)(tree->origin)))/64:0)
-
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::FindGreaterEqual(T* tree, uint64_t value) {
-		uint64_t thisValue = Value(tree);
-		//printf(" search: %lu ?? %lu\n", OFF(thisValue), OFF(value));
-		if(thisValue == value) {
-			//printf(" search: %lu == %lu\n", OFF(thisValue), OFF(value));
-			return this;
-		} else if(thisValue > value) {
-			NodeImpl<T,N>* left = Left(tree);
-			//printf(" search: %lu > %lu   -> left %lu\n", OFF(thisValue), OFF(value), OFF(left));
-			if(left)
-				return left->FindGreaterEqual(tree, value);
-			//printf(" search ret this\n");
-			return this;
-		} else {
-			NodeImpl<T,N>* right = Right(tree);
-			//printf(" search: %lu < %lu   -> right %lu\n", OFF(thisValue), OFF(value), OFF(right));
-			if(right)
-				return right->FindGreaterEqual(tree, value);
-			NodeImpl<T,N>* next = Next(tree);
-			//printf(" search ret next: %lu\n", OFF(next));
-			return next;//->FindGreaterEqual(tree, value);
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::FindGreaterEqual(T* tree, const K& value) {
+		// single pass down, remembering last node greater than value
+		NodeImpl<T,N,K,C>* node = this, *best = NULL;
+		while(node) {
+			const K v = node->Value(tree);
+			if(KeyOrder<K,C>::Less(value, v)) {
+				best = node;
+				node = node->Left(tree);
+			} else if(KeyOrder<K,C>::Less(v, value)) {
+				node = node->Right(tree);
+			} else {
+				return node;
+			}
 		}
+		// answer may be above this subtree only when it is not whole tree
+		if(best == NULL && Parent(tree))
+			return RightMost(tree)->Next(tree);
+		return best;
 	}
-
 	
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::LeftMost(T* tree) {
-		if(Left(tree))
-			return Left(tree)->LeftMost(tree);
-		return this;
-	}
-	template<typename T, typename N>
-	inline NodeImpl<T,N>* NodeImpl<T,N>::RightMost(T* tree) {
-		if(Right(tree))
-			return Right(tree)->RightMost(tree);
-		return this;
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::LeftMost(T* tree) {
+		NodeImpl<T,N,K,C>* node = this, *next;
+		while((next = node->Left(tree)))
+			node = next;
+		return node;
+	}
+	template<typename T, typename N, typename K, typename C>
+	inline NodeImpl<T,N,K,C>* NodeImpl<T,N,K,C>::RightMost(T* tree) {
+		NodeImpl<T,N,K,C>* node = this, *next;
+		while((next = node->Right(tree)))
+			node = next;
+		return node;
 	}
 	
+	template<typename T, typename N, typename K, typename C>
+	inline uint64_t NodeImpl<T,N,K,C>::MinHeight(T* tree) {
+		// depth of shallowest node that lacks any child
+		struct Entry {
+			NodeImpl<T,N,K,C>* node;
+			uint64_t depth;
+		};
+		std::vector<Entry> stack;
+		stack.reserve(128);
+		stack.push_back({this, 1});
+		uint64_t min = -1;
+		while(!stack.empty()) {
+			Entry e = stack.back();
+			stack.pop_back();
+			if(e.depth >= min)
+				continue;
+			NodeImpl<T,N,K,C>* left = e.node->Left(tree);
+			NodeImpl<T,N,K,C>* right = e.node->Right(tree);
+			if(left && right) {
+				stack.push_back({right, e.depth+1});
+				stack.push_back({left, e.depth+1});
+			} else {
+				min = e.depth;
+			}
+		}
+		return min;
+	}
 	
+	template<typename T, typename N, typename K, typename C>
+	inline uint64_t NodeImpl<T,N,K,C>::Height(T* tree) {
+		struct Entry {
+			NodeImpl<T,N,K,C>* node;
+			uint64_t depth;
+		};
+		std::vector<Entry> stack;
+		stack.reserve(128);
+		stack.push_back({this, 1});
+		uint64_t max = 0;
+		while(!stack.empty()) {
+			Entry e = stack.back();
+			stack.pop_back();
+			max = e.depth > max ? e.depth : max;
+			if(NodeImpl<T,N,K,C>* right = e.node->Right(tree))
+				stack.push_back({right, e.depth+1});
+			if(NodeImpl<T,N,K,C>* left = e.node->Left(tree))
+				stack.push_back({left, e.depth+1});
+		}
+		return max;
+	}
 	
+	template<typename T, typename N, typename K, typename C>
+	inline uint64_t NodeImpl<T,N,K,C>::VerifyParenting(bool print, T* tree) {
+		// walks down child links only, so broken parent links are found
+		struct Entry {
+			NodeImpl<T,N,K,C>* node, *parent;
+			uint64_t depth;
+			char side;
+		};
+		std::vector<Entry> stack;
+		stack.reserve(128);
+		stack.push_back({this, NULL, 0, 'R'});
+		uint64_t sum = 0;
+		while(!stack.empty()) {
+			Entry e = stack.back();
+			stack.pop_back();
+			if(print) {
+				for(uint64_t i=0; i<e.depth; ++i)
+					printf("    ");
+				printf(" %c %p  : parent (%p)\n", e.side, e.node, e.parent);
+			}
+			sum += e.node->Parent(tree) != e.parent;
+			if(NodeImpl<T,N,K,C>* right = e.node->Right(tree))
+				stack.push_back({right, e.node, e.depth+1, 'R'});
+			if(NodeImpl<T,N,K,C>* left = e.node->Left(tree))
+				stack.push_back({left, e.node, e.depth+1, 'L'});
+		}
+		return sum;
+	}
 	
-	
-	
-	template<typename T, typename N>
-	void RedBlackTree<T,N>::InsertImpl(Node* node) {
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T,N,K,C>::InsertImpl(Node* node) {
 		BSTInsert(node);
 // 		return;
 		if(node == Root()) {
@@ -223,11 +300,242 @@ namespace Generic {
 		}
 	}
 	
-	template<typename T, typename N>
-	void RedBlackTree<T, N>::BSTInsert(Node* node) {
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T,N,K,C>::EraseImpl(Node* node) {
+		// x replaces removed black node, it can be NULL so its parent is
+		// tracked separately
+		Node* x, *parent;
+		uint64_t removedColor = Color(node);
+		if(node->Left(tree) == NULL) {
+			x = node->Right(tree);
+			parent = node->Parent(tree);
+			AddCount(parent, -1);
+			Transplant(node, x);
+		} else if(node->Right(tree) == NULL) {
+			x = node->Left(tree);
+			parent = node->Parent(tree);
+			AddCount(parent, -1);
+			Transplant(node, x);
+		} else {
+			// next leaves its place and takes place of node, so subtree of
+			// node loses only one node
+			Node* next = node->Right(tree)->LeftMost(tree);
+			AddCount(next->Parent(tree), -1);
+			removedColor = Color(next);
+			x = next->Right(tree);
+			if(next->Parent(tree) == node) {
+				parent = next;
+			} else {
+				parent = next->Parent(tree);
+				Transplant(next, x);
+				next->Right(tree, node->Right(tree));
+				next->Right(tree)->Parent(tree, next);
+			}
+			Transplant(node, next);
+			next->Left(tree, node->Left(tree));
+			next->Left(tree)->Parent(tree, next);
+			next->Color(tree, node->Color(tree));
+			if constexpr(counted)
+				next->Count(tree, node->Count(tree));
+		}
+		if(removedColor == BLACK)
+			EraseFixUp(x, parent);
+		node->Left(tree, NULL);
+		node->Right(tree, NULL);
+		node->Parent(tree, NULL);
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T,N,K,C>::Transplant(Node* u, Node* v) {
+		Node* parent = u->Parent(tree);
+		if(parent == NULL)
+			Root(v);
+		else if(u == parent->Left(tree))
+			parent->Left(tree, v);
+		else
+			parent->Right(tree, v);
+		if(v)
+			v->Parent(tree, parent);
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T,N,K,C>::EraseFixUp(Node* x, Node* parent) {
+		while(x != Root() && Color(x) == BLACK) {
+			if(x == parent->Left(tree)) {
+				Node* w = parent->Right(tree);
+				if(Color(w) == RED) {
+					w->Color(tree, BLACK);
+					parent->Color(tree, RED);
+					RotateLeft(parent);
+					w = parent->Right(tree);
+				}
+				if(Color(w->Left(tree)) == BLACK && Color(w->Right(tree)) == BLACK) {
+					w->Color(tree, RED);
+					x = parent;
+					parent = x->Parent(tree);
+				} else {
+					if(Color(w->Right(tree)) == BLACK) {
+						w->Left(tree)->Color(tree, BLACK);
+						w->Color(tree, RED);
+						RotateRight(w);
+						w = parent->Right(tree);
+					}
+					w->Color(tree, parent->Color(tree));
+					parent->Color(tree, BLACK);
+					w->Right(tree)->Color(tree, BLACK);
+					RotateLeft(parent);
+					x = Root();
+				}
+			} else {
+				Node* w = parent->Left(tree);
+				if(Color(w) == RED) {
+					w->Color(tree, BLACK);
+					parent->Color(tree, RED);
+					RotateRight(parent);
+					w = parent->Left(tree);
+				}
+				if(Color(w->Right(tree)) == BLACK && Color(w->Left(tree)) == BLACK) {
+					w->Color(tree, RED);
+					x = parent;
+					parent = x->Parent(tree);
+				} else {
+					if(Color(w->Left(tree)) == BLACK) {
+						w->Right(tree)->Color(tree, BLACK);
+						w->Color(tree, RED);
+						RotateLeft(w);
+						w = parent->Left(tree);
+					}
+					w->Color(tree, parent->Color(tree));
+					parent->Color(tree, BLACK);
+					w->Left(tree)->Color(tree, BLACK);
+					RotateRight(parent);
+					x = Root();
+				}
+			}
+		}
+		if(x)
+			x->Color(tree, BLACK);
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	uint64_t RedBlackTree<T, N, K, C>::CountLower(const K& value,
+			bool inclusive) {
+		static_assert(counted, "CountLower() requires counted NodeAccessor");
+		uint64_t ret = 0;
+		Node* node = Root();
+		while(node) {
+			const K v = node->Value(tree);
+			if(inclusive ? KeyOrder<K,C>::Less(value, v)
+					: !KeyOrder<K,C>::Less(v, value)) {
+				node = node->Left(tree);
+			} else {
+				ret += Count(node->Left(tree)) + 1;
+				node = node->Right(tree);
+			}
+		}
+		return ret;
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	NodeImpl<T, N, K, C>* RedBlackTree<T, N, K, C>::SelectImpl(uint64_t id) {
+		static_assert(counted, "Select() requires counted NodeAccessor");
+		Node* node = Root();
+		while(node) {
+			const uint64_t lower = Count(node->Left(tree));
+			if(id < lower) {
+				node = node->Left(tree);
+			} else if(id == lower) {
+				break;
+			} else {
+				id -= lower+1;
+				node = node->Right(tree);
+			}
+		}
+		return node;
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T, N, K, C>::FindGreaterEqualManyImpl(
+			std::span<const K> values, std::span<Node*> out) {
+		const uint64_t group = 16;
+		const uint64_t count = values.size() < out.size() ? values.size()
+			: out.size();
+		Node* node[group], *best[group];
+		uint64_t query[group];
+		uint64_t active = 0, next = 0;
+		for(; active<group && next<count; ++active, ++next) {
+			query[active] = next;
+			node[active] = Root();
+			best[active] = NULL;
+		}
+		while(active) {
+			for(uint64_t i=0; i<active;) {
+				const uint64_t q = query[i];
+				Node* n = node[i];
+				if(n) {
+					const K value = n->Value(tree);
+					const bool greater = KeyOrder<K,C>::Less(values[q], value);
+					if(greater || KeyOrder<K,C>::Less(value, values[q])) {
+						if(greater) {
+							best[i] = n;
+							n = n->Left(tree);
+						} else {
+							n = n->Right(tree);
+						}
+						node[i] = n;
+						if(n) {
+							__builtin_prefetch(n);
+							++i;
+							continue;
+						}
+						n = best[i];
+					}
+				}
+				// lookup finished, slot takes next query or last active one
+				out[q] = n;
+				if(next < count) {
+					query[i] = next++;
+					node[i] = Root();
+					best[i] = NULL;
+					++i;
+				} else {
+					--active;
+					query[i] = query[active];
+					node[i] = node[active];
+					best[i] = best[active];
+				}
+			}
+		}
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	LookupTask RedBlackTree<T, N, K, C>::FindGreaterEqualTask(K value,
+			Node** result) {
+		Node* node = Root(), *best = NULL;
+		while(node) {
+			const K v = node->Value(tree);
+			if(KeyOrder<K,C>::Less(value, v)) {
+				best = node;
+				node = node->Left(tree);
+			} else if(KeyOrder<K,C>::Less(v, value)) {
+				node = node->Right(tree);
+			} else {
+				best = node;
+				break;
+			}
+			if(node)
+				co_await Prefetch{node};
+		}
+		*result = best;
+	}
+	
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T, N, K, C>::BSTInsert(Node* node) {
 		node->Left(tree, NULL);
 		node->Right(tree, NULL);
 		node->Parent(tree, NULL);
+		if constexpr(counted)
+			node->Count(tree, 1);
 		//printf(" inserting: %p (%p) -> (L %p, R %p)\n", node->Parent(tree), node, node->Left(tree), node->Right(tree));
 		if(Root() == NULL) {
 			Root(node);
@@ -254,11 +562,12 @@ namespace Generic {
 					//printf(" inserted 3: %p (%p) -> (L %p, R %p) under %p (%p) -> (L %p, R %p)\n", node->Parent(tree), node, node->Left(tree), node->Right(tree), prev->Parent(tree), prev, prev->Left(tree), prev->Right(tree));
 				}
 			}
+			AddCount(node->Parent(tree), 1);
 		}
 	}
 	
-	template<typename T, typename N>
-	NodeImpl<T, N>* RedBlackTree<T, N>::RBTInsertFixUpForRightChildUncle(Node* node) {
+	template<typename T, typename N, typename K, typename C>
+	NodeImpl<T, N, K, C>* RedBlackTree<T, N, K, C>::RBTInsertFixUpForRightChildUncle(Node* node) {
 		Node* uncle = node->Parent(tree)->Parent(tree)->Right(tree);
 		if(Color(uncle) == RED) {
 			node->Parent(tree)->Color(tree, BLACK);
@@ -277,8 +586,8 @@ namespace Generic {
 		return node;
 	}
 
-	template<typename T, typename N>
-	NodeImpl<T, N>* RedBlackTree<T, N>::RBTInsertFixUpForLeftChildUncle(Node* node) {
+	template<typename T, typename N, typename K, typename C>
+	NodeImpl<T, N, K, C>* RedBlackTree<T, N, K, C>::RBTInsertFixUpForLeftChildUncle(Node* node) {
 		Node* uncle = node->Parent(tree)->Parent(tree)->Left(tree);
 		if(Color(uncle) == RED) {
 			node->Parent(tree)->Color(tree, BLACK);
@@ -297,11 +606,13 @@ namespace Generic {
 		return node;
 	}
 	
-	template<typename T, typename N>
-	void RedBlackTree<T, N>::RotateLeft(Node* x) {
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T, N, K, C>::RotateLeft(Node* x) {
 		Node* y = x->Right(tree);
 		if(y == NULL)
 			return ;
+		if constexpr(counted)
+			y->Count(tree, x->Count(tree));
 		x->Right(tree, y->Left(tree));
 		if(y->Left(tree) != NULL)
 			y->Left(tree)->Parent(tree, x);
@@ -314,13 +625,16 @@ namespace Generic {
 			x->Parent(tree)->Right(tree, y);
 		y->Left(tree, x);
 		x->Parent(tree, y);
+		UpdateCount(x);
 	}
 
-	template<typename T, typename N>
-	void RedBlackTree<T, N>::RotateRight(Node* x) {
+	template<typename T, typename N, typename K, typename C>
+	void RedBlackTree<T, N, K, C>::RotateRight(Node* x) {
 		Node* y = x->Left(tree);
 		if(y == NULL)
 			return ;
+		if constexpr(counted)
+			y->Count(tree, x->Count(tree));
 		x->Left(tree, y->Right(tree));
 		if(y->Right(tree) != NULL)
 			y->Right(tree)->Parent(tree, x);
@@ -333,6 +647,7 @@ namespace Generic {
 			x->Parent(tree)->Left(tree, y);
 		y->Right(tree, x);
 		x->Parent(tree, y);
+		UpdateCount(x);
 	}
 	
 	
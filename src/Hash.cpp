@@ -0,0 +1,271 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Hash.hpp"
+
+#include <immintrin.h>
+
+namespace hash {
+	namespace {
+		
+		using namespace detail;
+		
+		const static uint64_t PRIME32 = 0x9E3779B1llu;
+		const static uint64_t stripesPerBlock = 16;
+		
+		// stripe s of block uses secret[s..s+7], scrambling uses
+		// secret[16..23], splitmix64 sequence
+		const uint64_t secret[24] = {
+			0xE220A8397B1DCDAFllu, 0x6E789E6AA1B965F4llu, 0x06C45D188009454Fllu,
+			0xF88BB8A8724C81ECllu, 0x1B39896A51A8749Bllu, 0x53CB9F0C747EA2EAllu,
+			0x2C829ABE1F4532E1llu, 0xC584133AC916AB3Cllu, 0x3EE5789041C98AC3llu,
+			0xF3B8488C368CB0A6llu, 0x657EECDD3CB13D09llu, 0xC2D326E0055BDEF6llu,
+			0x8621A03FE0BBDB7Bllu, 0x8E1F7555983AA92Fllu, 0xB54E0F1600CC4D19llu,
+			0x84BB3F97971D80ABllu, 0x7D29825C75521255llu, 0xC3CF17102B7F7F86llu,
+			0x3466E9A083914F64llu, 0xD81A8D2B5A4485ACllu, 0xDB01602B100B9ED7llu,
+			0xA9038A921825F10Dllu, 0xEDF5F1D90DCA2F6Allu, 0x54496AD67BD2634Cllu
+		};
+		
+		inline void AccumulateScalar(uint64_t* acc, const uint8_t* p,
+				const uint64_t* key) {
+			for(uint64_t j=0; j<8; ++j) {
+				const uint64_t d = Read64(p + j*8);
+				const uint64_t k = d ^ key[j];
+				acc[j ^ 1] += d;
+				acc[j] += (k & 0xFFFFFFFF) * (k >> 32);
+			}
+		}
+		
+		inline void ScrambleScalar(uint64_t* acc) {
+			for(uint64_t j=0; j<8; ++j) {
+				acc[j] ^= acc[j] >> 47;
+				acc[j] ^= secret[16 + j];
+				acc[j] *= PRIME32;
+			}
+		}
+		
+		void StripesScalar(uint64_t* acc, const uint8_t* p, uint64_t stripes) {
+			for(uint64_t s=0; s<stripes; ++s) {
+				AccumulateScalar(acc, p + s*64, secret + s%stripesPerBlock);
+				if(s%stripesPerBlock == stripesPerBlock-1)
+					ScrambleScalar(acc);
+			}
+		}
+		
+		__attribute__((target("avx2")))
+		void StripesAvx2(uint64_t* acc, const uint8_t* p, uint64_t stripes) {
+			__m256i a[2] = {
+				_mm256_loadu_si256((const __m256i*)acc),
+				_mm256_loadu_si256((const __m256i*)(acc+4))
+			};
+			const __m256i prime = _mm256_set1_epi64x(PRIME32);
+			for(uint64_t s=0; s<stripes; ++s) {
+				const uint64_t* key = secret + s%stripesPerBlock;
+				for(int h=0; h<2; ++h) {
+					const __m256i d = _mm256_loadu_si256(
+							(const __m256i*)(p + s*64 + h*32));
+					const __m256i k = _mm256_xor_si256(d,
+							_mm256_loadu_si256((const __m256i*)(key + h*4)));
+					const __m256i product = _mm256_mul_epu32(k,
+							_mm256_srli_epi64(k, 32));
+					// acc[j] += d[j^1]
+					const __m256i swapped = _mm256_shuffle_epi32(d,
+							_MM_SHUFFLE(1, 0, 3, 2));
+					a[h] = _mm256_add_epi64(a[h],
+							_mm256_add_epi64(product, swapped));
+				}
+				if(s%stripesPerBlock == stripesPerBlock-1) {
+					for(int h=0; h<2; ++h) {
+						__m256i x = _mm256_xor_si256(a[h],
+								_mm256_srli_epi64(a[h], 47));
+						x = _mm256_xor_si256(x, _mm256_loadu_si256(
+									(const __m256i*)(secret + 16 + h*4)));
+						// 64x32 bit multiplication from two 32x32->64 ones
+						const __m256i lo = _mm256_mul_epu32(x, prime);
+						const __m256i hi = _mm256_mul_epu32(
+								_mm256_srli_epi64(x, 32), prime);
+						a[h] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+					}
+				}
+			}
+			_mm256_storeu_si256((__m256i*)acc, a[0]);
+			_mm256_storeu_si256((__m256i*)(acc+4), a[1]);
+		}
+		
+		__attribute__((target("avx512f")))
+		void StripesAvx512(uint64_t* acc, const uint8_t* p, uint64_t stripes) {
+			__m512i a = _mm512_loadu_si512(acc);
+			const __m512i prime = _mm512_set1_epi64(PRIME32);
+			const __m512i scramble = _mm512_loadu_si512(secret + 16);
+			for(uint64_t s=0; s<stripes; ++s) {
+				const __m512i d = _mm512_loadu_si512(p + s*64);
+				const __m512i k = _mm512_xor_si512(d,
+						_mm512_loadu_si512(secret + s%stripesPerBlock));
+				const __m512i product = _mm512_mul_epu32(k,
+						_mm512_srli_epi64(k, 32));
+				const __m512i swapped = _mm512_shuffle_epi32(d,
+						(_MM_PERM_ENUM)_MM_SHUFFLE(1, 0, 3, 2));
+				a = _mm512_add_epi64(a, _mm512_add_epi64(product, swapped));
+				if(s%stripesPerBlock == stripesPerBlock-1) {
+					__m512i x = _mm512_xor_si512(a, _mm512_srli_epi64(a, 47));
+					x = _mm512_xor_si512(x, scramble);
+					const __m512i lo = _mm512_mul_epu32(x, prime);
+					const __m512i hi = _mm512_mul_epu32(
+							_mm512_srli_epi64(x, 32), prime);
+					a = _mm512_add_epi64(lo, _mm512_slli_epi64(hi, 32));
+				}
+			}
+			_mm512_storeu_si512(acc, a);
+		}
+		
+		void HashManyScalar(const uint64_t* in, uint64_t* out, uint64_t n) {
+			for(uint64_t i=0; i<n; ++i)
+				out[i] = mix64(in[i]);
+		}
+		
+		// 64 bit multiplication from three 32x32->64 ones
+		__attribute__((target("avx2")))
+		inline __m256i MulAvx2(__m256i a, __m256i b) {
+			const __m256i cross = _mm256_add_epi64(
+					_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+					_mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+			return _mm256_add_epi64(_mm256_mul_epu32(a, b),
+					_mm256_slli_epi64(cross, 32));
+		}
+		
+		__attribute__((target("avx2")))
+		void HashManyAvx2(const uint64_t* in, uint64_t* out, uint64_t n) {
+			const __m256i golden = _mm256_set1_epi64x(0x9E3779B97F4A7C15llu);
+			const __m256i m1 = _mm256_set1_epi64x(0xBF58476D1CE4E5B9llu);
+			const __m256i m2 = _mm256_set1_epi64x(0x94D049BB133111EBllu);
+			uint64_t i = 0;
+			for(; i+4<=n; i+=4) {
+				__m256i v = _mm256_add_epi64(golden,
+						_mm256_loadu_si256((const __m256i*)(in+i)));
+				v = MulAvx2(_mm256_xor_si256(v, _mm256_srli_epi64(v, 30)), m1);
+				v = MulAvx2(_mm256_xor_si256(v, _mm256_srli_epi64(v, 27)), m2);
+				v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 31));
+				_mm256_storeu_si256((__m256i*)(out+i), v);
+			}
+			HashManyScalar(in+i, out+i, n-i);
+		}
+		
+		__attribute__((target("avx512f,avx512dq")))
+		void HashManyAvx512(const uint64_t* in, uint64_t* out, uint64_t n) {
+			const __m512i golden = _mm512_set1_epi64(0x9E3779B97F4A7C15llu);
+			const __m512i m1 = _mm512_set1_epi64(0xBF58476D1CE4E5B9llu);
+			const __m512i m2 = _mm512_set1_epi64(0x94D049BB133111EBllu);
+			uint64_t i = 0;
+			for(; i+8<=n; i+=8) {
+				__m512i v = _mm512_add_epi64(golden, _mm512_loadu_si512(in+i));
+				v = _mm512_mullo_epi64(
+						_mm512_xor_si512(v, _mm512_srli_epi64(v, 30)), m1);
+				v = _mm512_mullo_epi64(
+						_mm512_xor_si512(v, _mm512_srli_epi64(v, 27)), m2);
+				v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 31));
+				_mm512_storeu_si512(out+i, v);
+			}
+			// remaining keys in one masked step
+			if(i < n) {
+				const __mmask8 mask = (1u << (n-i)) - 1;
+				__m512i v = _mm512_add_epi64(golden,
+						_mm512_maskz_loadu_epi64(mask, in+i));
+				v = _mm512_mullo_epi64(
+						_mm512_xor_si512(v, _mm512_srli_epi64(v, 30)), m1);
+				v = _mm512_mullo_epi64(
+						_mm512_xor_si512(v, _mm512_srli_epi64(v, 27)), m2);
+				v = _mm512_xor_si512(v, _mm512_srli_epi64(v, 31));
+				_mm512_mask_storeu_epi64(out+i, mask, v);
+			}
+		}
+		
+		SimdLevel Supported() {
+			__builtin_cpu_init();
+			// AVX-512 kernels need also 64 bit multiplication from DQ
+			if(__builtin_cpu_supports("avx512f") &&
+					__builtin_cpu_supports("avx512dq"))
+				return AVX512;
+			if(__builtin_cpu_supports("avx2"))
+				return AVX2;
+			return SCALAR;
+		}
+		
+		const SimdLevel supported = Supported();
+		SimdLevel level = supported;
+		
+		void (*Stripes)(uint64_t*, const uint8_t*, uint64_t) =
+			supported==AVX512 ? StripesAvx512 :
+			supported==AVX2 ? StripesAvx2 : StripesScalar;
+		
+		void (*HashMany)(const uint64_t*, uint64_t*, uint64_t) =
+			supported==AVX512 ? HashManyAvx512 :
+			supported==AVX2 ? HashManyAvx2 : HashManyScalar;
+	}
+	
+	namespace detail {
+		uint64_t Hash64Long(const uint8_t* p, uint64_t len, uint64_t seed) {
+			uint64_t acc[8];
+			for(uint64_t j=0; j<8; ++j)
+				acc[j] = secret[j] ^ seed;
+			
+			// last stripe, overlapping previous ones, is always accumulated
+			// separately, so every key ends with the same step
+			const uint64_t stripes = (len-1) / 64;
+			Stripes(acc, p, stripes);
+			AccumulateScalar(acc, p + len - 64, secret + 7);
+			
+			uint64_t r = len * P0;
+			for(uint64_t j=0; j<8; j+=2)
+				r += Mix(acc[j] ^ secret[9+j], acc[j+1] ^ secret[10+j]);
+			r ^= r >> 37;
+			r *= 0x165667919E3779F9llu;
+			return r ^ (r >> 32);
+		}
+	}
+	
+	SimdLevel SupportedSimdLevel() {
+		return supported;
+	}
+	
+	SimdLevel GetSimdLevel() {
+		return level;
+	}
+	
+	void SetSimdLevel(SimdLevel value) {
+		level = value<supported ? value : supported;
+		Stripes = level==AVX512 ? StripesAvx512 :
+			level==AVX2 ? StripesAvx2 : StripesScalar;
+		HashMany = level==AVX512 ? HashManyAvx512 :
+			level==AVX2 ? HashManyAvx2 : HashManyScalar;
+	}
+	
+	void hash_many(const uint64_t* in, uint64_t* out, uint64_t n) {
+		HashMany(in, out, n);
+	}
+	
+	void hash_many(Function function, const uint64_t* in, uint64_t* out,
+			uint64_t n) {
+		if(function == MIX64) {
+			HashMany(in, out, n);
+		} else {
+			for(uint64_t i=0; i<n; ++i)
+				out[i] = hash(function, in[i]);
+		}
+	}
+};
+
@@ -25,16 +25,24 @@
 #define HASH_HPP
 
 #include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
 
 namespace hash {
 	
-	const static uint32_t FNV_32_PRIME= (2<<24) + (2<<8) + 0x93;
-	const static uint64_t FNV_64_PRIME = (2llu<<40) + (2llu<<8) + 0xB3llu;
+	// FNV primes are 2^24 + 2^8 + 0x93 and 2^40 + 2^8 + 0xB3
+	const static uint32_t FNV_32_PRIME = (1u<<24) + (1u<<8) + 0x93;
+	const static uint64_t FNV_64_PRIME = (1llu<<40) + (1llu<<8) + 0xB3llu;
 	
 	const static uint32_t FNV_32_OFFSET_BASIS = 2166136261;
 	const static uint64_t FNV_64_OFFSET_BASIS = 14695981039346656037llu;
 	
-	inline void FNV1a64(uint64_t& hval, uint64_t data) {
+	static_assert(FNV_32_PRIME == 16777619);
+	static_assert(FNV_64_PRIME == 1099511628211llu);
+	
+	// both variants multiply by FNV prime, shift-add one spells out its bits
+	inline constexpr void FNV1a64(uint64_t& hval, uint64_t data) {
 		hval ^= data;
 #if defined(NO_FNV_GCC_OPTIMIZATION)
 		hval *= FNV_64_PRIME;
@@ -44,40 +52,212 @@ namespace hash {
 #endif
 	}
 	
+	inline constexpr void FNV1a32(uint32_t& hval, uint32_t data) {
+		hval ^= data;
+#if defined(NO_FNV_GCC_OPTIMIZATION)
+		hval *= FNV_32_PRIME;
+#else
+		hval += (hval << 1) + (hval << 4) + (hval << 7) + (hval << 8) +
+			(hval << 24);
+#endif
+	}
+	
 	
-	inline uint64_t FNV1a64(uint64_t value) {
+	inline constexpr uint64_t FNV1a64(uint64_t value) {
 		uint64_t hval = FNV_64_OFFSET_BASIS;
 		FNV1a64(hval, value);
 		return hval;
 	}
 	
-	inline uint64_t hash(uint64_t value) {
+	inline constexpr uint64_t hash(uint64_t value) {
 		return FNV1a64(value);
 	}
 	
 	
-	inline uint64_t FNV1a64(const char* str, uint64_t len) {
+	// little endian word from up to 8 bytes, without unaligned access
+	inline constexpr uint64_t LoadWord(const char* str, uint64_t count) {
+		uint64_t v = 0;
+		if(std::is_constant_evaluated()) {
+			for(uint64_t i=0; i<count; ++i)
+				v |= (uint64_t)(uint8_t)str[i] << (i*8);
+		} else {
+			memcpy(&v, str, count);
+		}
+		return v;
+	}
+	
+	// standard FNV-1a, one byte per step
+	inline constexpr uint64_t FNV1a64Bytes(const char* str, uint64_t len) {
 		uint64_t hval = FNV_64_OFFSET_BASIS;
-		uint64_t end = len&(-8);
-		for(uint64_t i=0; i<end; i+=8) {
-			FNV1a64(hval, *(uint64_t*)(str+i));
+		for(uint64_t i=0; i<len; ++i)
+			FNV1a64(hval, (uint8_t)str[i]);
+		return hval;
+	}
+	
+	inline constexpr uint32_t FNV1a32Bytes(const char* str, uint64_t len) {
+		uint32_t hval = FNV_32_OFFSET_BASIS;
+		for(uint64_t i=0; i<len; ++i)
+			FNV1a32(hval, (uint8_t)str[i]);
+		return hval;
+	}
+	
+	// FNV-1a over 8 byte little endian words, last word padded with zeros
+	inline constexpr uint64_t FNV1a64(const char* str, uint64_t len) {
+		uint64_t hval = FNV_64_OFFSET_BASIS;
+		const uint64_t end = len&(-8);
+		for(uint64_t i=0; i<end; i+=8)
+			FNV1a64(hval, LoadWord(str+i, 8));
+		if(len != end)
+			FNV1a64(hval, LoadWord(str+end, len-end));
+		return hval;
+	}
+	
+	inline constexpr uint64_t hash(const char* str, uint64_t len) {
+		return FNV1a64(str, len);
+	}
+	
+	namespace literals {
+		// compile time hash of names, "collection"_fnv
+		inline constexpr uint64_t operator""_fnv(const char* str, size_t len) {
+			return FNV1a64(str, len);
 		}
-		uint64_t rest = len-end;
-		if(rest) {
-			uint64_t v=0;
-			char* ptr = (char*)&v;
-			for(uint64_t i=0; i<rest; ++i) {
-				ptr[i] = str[end+i];
+	};
+	
+	
+	/*
+	 *  hash64 is wyhash style hash: keys up to 256 bytes are folded 16 bytes
+	 *  at a time with 64x64->128 bit multiplication (three independent lanes
+	 *  above 48 bytes), longer keys are consumed in 64 byte stripes by eight
+	 *  32x32->64 bit multiply-accumulate lanes (xxh3 style), which run as
+	 *  one AVX2/AVX-512 loop when CPU supports it.
+	 */
+	
+	namespace detail {
+		const static uint64_t P0 = 0xA0761D6478BD642Fllu;
+		const static uint64_t P1 = 0xE7037ED1A0B428DBllu;
+		const static uint64_t P2 = 0x8EBC6AF09C88C6E3llu;
+		const static uint64_t P3 = 0x589965CC75374CC3llu;
+		
+		inline uint64_t Mix(uint64_t a, uint64_t b) {
+			const __uint128_t r = (__uint128_t)a * b;
+			return (uint64_t)r ^ (uint64_t)(r >> 64);
+		}
+		
+		inline uint64_t Read64(const uint8_t* p) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			return v;
+		}
+		
+		inline uint64_t Read32(const uint8_t* p) {
+			uint32_t v;
+			memcpy(&v, p, 4);
+			return v;
+		}
+		
+		uint64_t Hash64Long(const uint8_t* p, uint64_t len, uint64_t seed);
+	};
+	
+	inline uint64_t hash64(const void* data, uint64_t len, uint64_t seed=0) {
+		using namespace detail;
+		const uint8_t* p = (const uint8_t*)data;
+		if(len > 256)
+			return Hash64Long(p, len, seed);
+		seed ^= Mix(seed ^ P0, P1);
+		uint64_t a, b;
+		if(len <= 16) {
+			if(len >= 4) {
+				const uint64_t o = (len >> 3) << 2;
+				a = (Read32(p) << 32) | Read32(p + o);
+				b = (Read32(p + len - 4) << 32) | Read32(p + len - 4 - o);
+			} else if(len > 0) {
+				a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+					p[len - 1];
+				b = 0;
+			} else {
+				a = b = 0;
+			}
+		} else {
+			uint64_t i = len;
+			if(i > 48) {
+				uint64_t s1 = seed, s2 = seed;
+				do {
+					seed = Mix(Read64(p) ^ P1, Read64(p+8) ^ seed);
+					s1 = Mix(Read64(p+16) ^ P2, Read64(p+24) ^ s1);
+					s2 = Mix(Read64(p+32) ^ P3, Read64(p+40) ^ s2);
+					p += 48;
+					i -= 48;
+				} while(i > 48);
+				seed ^= s1 ^ s2;
 			}
-			FNV1a64(hval, v);
+			while(i > 16) {
+				seed = Mix(Read64(p) ^ P1, Read64(p+8) ^ seed);
+				p += 16;
+				i -= 16;
+			}
+			a = Read64(p + i - 16);
+			b = Read64(p + i - 8);
 		}
-		return hval;
+		const __uint128_t r = (__uint128_t)(a ^ P1) * (b ^ seed);
+		return Mix((uint64_t)r ^ P0 ^ len, (uint64_t)(r >> 64) ^ P1);
 	}
 	
-	inline uint64_t hash(const char* str, uint64_t len) {
-		return FNV1a64(str, len);
+	inline uint64_t hash64(uint64_t value, uint64_t seed=0) {
+		return hash64(&value, 8, seed);
+	}
+	
+	
+	// splitmix64 finalizer, bijective multiply-xorshift mixer of one word
+	inline constexpr uint64_t mix64(uint64_t value) {
+		value += 0x9E3779B97F4A7C15llu;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9llu;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBllu;
+		return value ^ (value >> 31);
 	}
 	
+	// out[i] = mix64(in[i]) for 4 (AVX2) or 8 (AVX-512) keys per step, in
+	// and out can be the same array
+	void hash_many(const uint64_t* in, uint64_t* out, uint64_t n);
+	
+	
+	// hash function stored by indices, FNV1A64 is used by files created
+	// before choice was possible, MIX64 hashes byte strings with hash64
+	enum Function : uint64_t {
+		FNV1A64 = 0,
+		HASH64 = 1,
+		MIX64 = 2
+	};
+	
+	inline uint64_t hash(Function function, uint64_t value) {
+		switch(function) {
+			case HASH64: return hash64(value);
+			case MIX64: return mix64(value);
+			default: return FNV1a64(value);
+		}
+	}
+	
+	inline uint64_t hash(Function function, const char* str, uint64_t len) {
+		return function==FNV1A64 ? FNV1a64(str, len) : hash64(str, len);
+	}
+	
+	// vectorized only for MIX64
+	void hash_many(Function function, const uint64_t* in, uint64_t* out,
+			uint64_t n);
+	
+	
+	// instruction set used by vectorized kernels, by default best supported
+	enum SimdLevel {
+		SCALAR = 0,
+		AVX2 = 1,
+		AVX512 = 2
+	};
+	
+	SimdLevel SupportedSimdLevel();
+	SimdLevel GetSimdLevel();
+	// level is limited to supported one, not thread safe, for tests and
+	// benchmarks
+	void SetSimdLevel(SimdLevel level);
+	
 };
 
 #endif
@@ -100,3 +100,34 @@ bool HeapFile::Pop(uint64_t& result) {
 	Origin()[i] = last;
 	return true;
 }
+
+uint64_t HeapFile::EraseRange(uint64_t min, uint64_t max) {
+	uint64_t size = Origin()[0];
+	uint64_t i, j;
+	for(i=1, j=0; i<=size; ++i) {
+		uint64_t v = Origin()[i];
+		if(v < min || v >= max)
+			Origin()[++j] = v;
+	}
+	Origin()[0] = j;
+	for(i=j>>1; i>0; --i)
+		SiftDown(i);
+	return size-j;
+}
+
+void HeapFile::SiftDown(uint64_t i) {
+	uint64_t size = Origin()[0];
+	uint64_t value = Origin()[i];
+	uint64_t j, v;
+	for(j=i<<1; j<=size; i=j, j<<=1) {
+		v = Origin()[j];
+		if((j < size) && (v > Origin()[j+1])) {
+			++j;
+			v = Origin()[j];
+		}
+		if(value <= v)
+			break;
+		Origin()[i] = v;
+	}
+	Origin()[i] = value;
+}
@@ -40,6 +40,7 @@ public:
 	bool Pop(uint64_t& result);
 	void BuildFromRange(uint64_t min, uint64_t max); // excluding max
 	void BuildFromRange(uint64_t min, uint64_t elements, uint64_t step);
+	uint64_t EraseRange(uint64_t min, uint64_t max); // excluding max, returns erased count
 	
 	inline uint64_t Size() const {return Origin()[0];}
 	
@@ -48,6 +49,8 @@ public:
 	
 private:
 	
+	void SiftDown(uint64_t i);
+	
 	CachedFile file;
 };
 
@@ -0,0 +1,138 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2022 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INTERLEAVED_HPP
+#define INTERLEAVED_HPP
+
+#include <cinttypes>
+#include <coroutine>
+#include <exception>
+#include <new>
+
+/*
+ *  Coroutine support for interleaving independent lookups. A lookup is
+ *  written as plain loop that does co_await Prefetch{next} before touching
+ *  next node, RunInterleaved() resumes group of such lookups round robin,
+ *  so memory latency of one is hidden behind work of others.
+ */
+
+namespace Generic {
+	
+	// recycles coroutine frames of this thread to avoid malloc per lookup
+	class FramePool {
+	public:
+		
+		const static uint64_t frameSize = 256;
+		
+		inline static void* Allocate(std::size_t size) {
+			if(size > frameSize)
+				return ::operator new(size);
+			if(freeFrames) {
+				Frame* frame = freeFrames;
+				freeFrames = frame->next;
+				return frame;
+			}
+			return ::operator new(frameSize);
+		}
+		
+		inline static void Free(void* ptr, std::size_t size) {
+			if(size > frameSize) {
+				::operator delete(ptr);
+			} else {
+				Frame* frame = (Frame*)ptr;
+				frame->next = freeFrames;
+				freeFrames = frame;
+			}
+		}
+		
+	private:
+		
+		struct Frame {
+			Frame* next;
+		};
+		
+		inline static thread_local Frame* freeFrames = NULL;
+	};
+	
+	struct LookupTask {
+		struct promise_type {
+			inline LookupTask get_return_object() {
+				return {std::coroutine_handle<promise_type>::from_promise(*this)};
+			}
+			inline std::suspend_always initial_suspend() noexcept {return {};}
+			inline std::suspend_always final_suspend() noexcept {return {};}
+			inline void return_void() {}
+			inline void unhandled_exception() {std::terminate();}
+			
+			inline static void* operator new(std::size_t size) {
+				return FramePool::Allocate(size);
+			}
+			inline static void operator delete(void* ptr, std::size_t size) {
+				FramePool::Free(ptr, size);
+			}
+		};
+		
+		std::coroutine_handle<promise_type> handle;
+	};
+	
+	// issues prefetch and suspends current lookup
+	struct Prefetch {
+		const void* address;
+		
+		inline bool await_ready() noexcept {
+			__builtin_prefetch(address);
+			return false;
+		}
+		inline void await_suspend(std::coroutine_handle<>) noexcept {}
+		inline void await_resume() noexcept {}
+	};
+	
+	// runs start(0) ... start(count-1) with at most group lookups in flight
+	template<typename Start>
+	void RunInterleaved(uint64_t count, uint64_t group, Start start) {
+		const uint64_t maxGroup = 64;
+		std::coroutine_handle<LookupTask::promise_type> tasks[maxGroup];
+		if(group > maxGroup)
+			group = maxGroup;
+		if(group == 0)
+			group = 1;
+		uint64_t active = 0, next = 0;
+		for(; active<group && next<count; ++active, ++next)
+			tasks[active] = start(next).handle;
+		while(active) {
+			for(uint64_t i=0; i<active;) {
+				tasks[i].resume();
+				if(!tasks[i].done()) {
+					++i;
+					continue;
+				}
+				tasks[i].destroy();
+				if(next < count) {
+					tasks[i] = start(next++).handle;
+					++i;
+				} else {
+					tasks[i] = tasks[--active];
+				}
+			}
+		}
+	}
+}
+
+#endif
+
@@ -18,6 +18,8 @@
 
 #include "LinearAllocator.hpp"
 
+#include <cstring>
+
 LinearAllocator::LinearAllocator() {}
 
 LinearAllocator::LinearAllocator(const char* linearMemoryFile,
@@ -55,18 +57,105 @@ uint64_t LinearAllocator::reserved() {
 
 uint64_t LinearAllocator::used() {
 	uint64_t ret = 0;
-	for(auto it = allocated.begin(); it; ++it) {
-		auto next = it.next();
-		if(!next)
+	TreeSetFile::Cursor it(&allocated);
+	for(bool valid=it.first(); valid; valid=it.next()) {
+		uint64_t begin = it.value();
+		if(!it.next())
+			break;
+		ret += it.value() - begin;
+	}
+	return ret;
+}
+
+std::pmr::vector<uint64_t> LinearAllocator::allocations(
+		std::pmr::memory_resource* resource) {
+	std::pmr::vector<uint64_t> ret(resource);
+	TreeSetFile::Cursor it(&allocated);
+	for(bool valid=it.first(); valid; valid=it.next()) {
+		uint64_t ptr = it.value();
+		if(!it.next())
 			break;
-		ret += *next - *it;
-		it = next.next();
+		// every allocation starts with 8 byte size header
+		for(uint64_t end=it.value(); ptr<end; ptr+=Origin<uint64_t>(ptr)[0])
+			ret.emplace_back(ptr+8);
 	}
 	return ret;
 }
 
 
 
+bool LinearAllocator::Compact(uint64_t maxBytes,
+		const std::function<void(uint64_t, uint64_t)>& relocate) {
+	if(!*this)
+		return true;
+	uint64_t moved = 0;
+	bool done = false;
+	while(moved < maxBytes) {
+		auto first = allocated.begin();
+		if(!first) {
+			done = true;
+			break;
+		}
+		uint64_t gapBegin = 0;
+		auto start = first;
+		if(*first == 0) {
+			auto end = first.next();
+			gapBegin = *end;
+			start = end.next();
+		}
+		if(!start) {
+			done = true;
+			break;
+		}
+		uint64_t from = *start;
+		uint64_t rangeEnd = *start.next();
+		
+		uint64_t bytes = 0;
+		for(uint64_t ptr=from; ptr<rangeEnd;) {
+			uint64_t size = Origin<uint64_t>(ptr)[0];
+			if(bytes && moved+bytes+size > maxBytes)
+				break;
+			bytes += size;
+			ptr += size;
+		}
+		
+		memmove(Origin(gapBegin), Origin(from), bytes);
+		for(uint64_t offset=0; offset<bytes;) {
+			relocate(from+offset+8, gapBegin+offset+8);
+			offset += Origin<uint64_t>(gapBegin+offset)[0];
+		}
+		
+		if(from+bytes == rangeEnd) {
+			allocated.erase(from);
+			allocated.erase(rangeEnd);
+		} else {
+			*allocated.find(from) += bytes;
+		}
+		if(gapBegin) {
+			*allocated.find(gapBegin) += bytes;
+		} else {
+			allocated.insert(0);
+			allocated.insert(bytes);
+		}
+		moved += bytes;
+	}
+	ShrinkToFit();
+	return done;
+}
+
+uint64_t LinearAllocator::ShrinkToFit() {
+	if(!*this)
+		return 0;
+	auto rbegin = allocated.rbegin();
+	uint64_t last = rbegin ? *rbegin : 0;
+	uint64_t newSize = (last+8+allocationUnitSize-1) & (-allocationUnitSize);
+	if(newSize < memoryFile.Size())
+		memoryFile.Resize(newSize);
+	return memoryFile.Size();
+}
+
+
+
 uint64_t LinearAllocator::Allocate(uint64_t size) {
 	if(!*this)
 		return 0;
@@ -80,11 +169,15 @@ uint64_t LinearAllocator::Allocate(uint64_t size) {
 uint64_t LinearAllocator::InternalAllocate(uint64_t size) {
 	auto it = allocated.begin();
 	if(it) {
-		if(*it >= size) {
+		if(*it > size) {
 			allocated.insert(0);
 			allocated.insert(size);
 			Origin<uint64_t>()[0] = size;
 			return 0;
+		} else if(*it == size) {
+			*it = 0;
+			Origin<uint64_t>()[0] = size;
+			return 0;
 		}
 		it = it.next();
 		while(it) {
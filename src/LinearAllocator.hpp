@@ -22,6 +22,10 @@
 #include "CachedFile.hpp"
 #include "TreeSetFile.hpp"
 
+#include <functional>
+#include <vector>
+#include <memory_resource>
+
 /*
  *  LinearAllocator uses NULL pointer invalid value instead of internal
  *  -1 pointer invalid value 
@@ -56,9 +60,27 @@ public:
 	template<typename T=void>
 	inline const T* Origin(uint64_t offset) const {return memoryFile.Origin<T>(offset);}
 	
+	template<typename T=void>
+	inline T*& Data() {return memoryFile.Data<T>();}
+	
 	uint64_t reserved();
 	uint64_t used();
 	
+	// returns pointers of all allocations in ascending order, memory comes
+	// from resource, which can be per request Arena
+	std::pmr::vector<uint64_t> allocations(
+			std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+	
+	/*
+	 *  Moves allocations toward the beginning of the file and calls
+	 *  relocate(oldPtr, newPtr) for every moved allocation. Moves at least one
+	 *  allocation and stops after maxBytes bytes were moved. Truncates unused
+	 *  tail of file. Returns true when there is nothing more to compact.
+	 */
+	bool Compact(uint64_t maxBytes,
+			const std::function<void(uint64_t, uint64_t)>& relocate);
+	uint64_t ShrinkToFit();
+	
 private:
 	
 	uint64_t InternalAllocate(uint64_t size);
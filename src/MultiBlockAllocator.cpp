@@ -0,0 +1,147 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "MultiBlockAllocator.hpp"
+
+#include <cstdio>
+#include <string>
+
+MultiBlockAllocator::MultiBlockAllocator() {
+	preallocatedBlocks = 0;
+	unreleasedSuperblocks = 0;
+}
+
+MultiBlockAllocator::MultiBlockAllocator(const char* fileNameBase) {
+	preallocatedBlocks = 0;
+	unreleasedSuperblocks = 0;
+	Open(fileNameBase);
+}
+
+MultiBlockAllocator::~MultiBlockAllocator() {
+	Close();
+}
+
+bool MultiBlockAllocator::Open(const char* fileNameBase) {
+	Close();
+	std::string base = fileNameBase;
+	bool valid = true;
+	valid &= memory.Open((base+"_memory.raw").c_str());
+	valid &= blockSizeAssociation.Open((base+"_block_size_association.raw").c_str());
+	valid &= liveBlocks.Open((base+"_live_blocks.raw").c_str());
+	valid &= freeSuperblocks.Open((base+"_free_superblocks.raw").c_str());
+	for(uint64_t i=minBlockSizeBits; i<=maxBlockSizeBits; ++i) {
+		valid &= heap[i].Open((base+"_heap"+std::to_string(i)+".raw").c_str());
+	}
+	if(!valid) {
+		Close();
+		return false;
+	}
+	preallocatedBlocks = memory.Size()>>maxBlockSizeBits;
+	unreleasedSuperblocks = 0;
+	return valid;
+}
+
+void MultiBlockAllocator::RemoveFiles(const char* fileNameBase) {
+	std::string base = fileNameBase;
+	std::remove((base+"_memory.raw").c_str());
+	std::remove((base+"_block_size_association.raw").c_str());
+	std::remove((base+"_live_blocks.raw").c_str());
+	std::remove((base+"_free_superblocks.raw").c_str());
+	for(uint64_t i=minBlockSizeBits; i<=maxBlockSizeBits; ++i)
+		std::remove((base+"_heap"+std::to_string(i)+".raw").c_str());
+}
+
+void MultiBlockAllocator::Close() {
+	memory.Close();
+	for(auto& it : heap)
+		it.Close();
+	freeSuperblocks.Close();
+	blockSizeAssociation.Close();
+	liveBlocks.Close();
+	preallocatedBlocks = 0;
+}
+
+uint64_t MultiBlockAllocator::Allocate(uint64_t size) {
+	if(!*this)
+		return -1;
+	if(size == 0 || size > maxBlockSize)
+		return -1;
+	uint64_t i = minBlockSizeBits;
+	for(; i<maxBlockSizeBits && size>(1llu<<i); ++i) {
+	}
+	return InternalAllocate(i);
+}
+
+uint64_t MultiBlockAllocator::InternalAllocate(uint64_t sizeBits) {
+	if(heap[sizeBits].Size() == 0)
+		Reserve(sizeBits);
+	uint64_t ptr = -1;
+	if(heap[sizeBits].Pop(ptr))
+		LiveBlocks(ptr>>maxBlockSizeBits)++;
+	return ptr;
+}
+
+
+void MultiBlockAllocator::Free(uint64_t ptr) {
+	if(!*this || ptr == -1)
+		return;
+	uint64_t superblock = ptr>>maxBlockSizeBits;
+	if(superblock >= preallocatedBlocks)
+		return;
+	uint64_t sizeBits = SizeBits(superblock);
+	if(sizeBits == freeSuperblock)
+		return;
+	heap[sizeBits].Push(ptr);
+	if(--LiveBlocks(superblock) == 0) {
+		// keep last superblock with free blocks of this size to not release
+		// and reacquire it on every allocate/free pair
+		if(heap[sizeBits].Size() > (maxBlockSize>>sizeBits))
+			ReleaseSuperblock(superblock);
+	}
+}
+
+void MultiBlockAllocator::Reserve(uint64_t sizeBits) {
+	HeapFile& heap = this->heap[sizeBits];
+	if(heap.Size() != 0)
+		return;
+	uint64_t superblock;
+	if(!freeSuperblocks.Pop(superblock)) {
+		superblock = preallocatedBlocks;
+		preallocatedBlocks += 1;
+		blockSizeAssociation.Reserve(preallocatedBlocks);
+		liveBlocks.Reserve(preallocatedBlocks*sizeof(uint32_t));
+		memory.Reserve(preallocatedBlocks<<maxBlockSizeBits);
+	}
+	heap.BuildFromRange(superblock<<maxBlockSizeBits,
+			maxBlockSize>>sizeBits,
+			1llu<<sizeBits);
+	SizeBits(superblock) = sizeBits;
+	LiveBlocks(superblock) = 0;
+}
+
+void MultiBlockAllocator::ReleaseSuperblock(uint64_t superblock) {
+	uint64_t begin = superblock<<maxBlockSizeBits;
+	heap[SizeBits(superblock)].EraseRange(begin, begin+maxBlockSize);
+	SizeBits(superblock) = freeSuperblock;
+	LiveBlocks(superblock) = 0;
+	if(!memory.PunchHole(begin, maxBlockSize))
+		++unreleasedSuperblocks;
+	freeSuperblocks.Push(superblock);
+}
+
@@ -0,0 +1,107 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MULTI_BLOCK_ALLOCATOR_HPP
+#define MULTI_BLOCK_ALLOCATOR_HPP
+
+#include "CachedFile.hpp"
+#include "HeapFile.hpp"
+
+/*
+ *  
+ *  Uses -1 instead of NULL pointer
+ *  
+ *  Memory is divided into superblocks of maxBlockSize bytes. Each superblock
+ *  is assigned to single block size class when it is needed and is returned
+ *  to global pool of free superblocks (and its pages are released with hole
+ *  punching) when all of its blocks are freed. When file system does not
+ *  support hole punching superblock is still reused, but its pages stay on
+ *  disk, such superblocks are counted by UnreleasedSuperblocks().
+ *  
+ */
+
+class MultiBlockAllocator {
+public:
+	
+	const static uint64_t maxBlockSize = 1024*1024*16;
+	const static uint64_t minBlockSize = 16;
+	
+	const static uint64_t maxBlockSizeBits = 24;
+	const static uint64_t minBlockSizeBits = 4;
+	
+	const static uint8_t freeSuperblock = 0xFF;
+	
+	MultiBlockAllocator();
+	MultiBlockAllocator(const char* fileNameBase);
+	~MultiBlockAllocator();
+	
+	inline operator bool() const {
+		return (bool)memory && (bool)blockSizeAssociation &&
+			(bool)liveBlocks && (bool)freeSuperblocks;
+	}
+	
+	bool Open(const char* fileNameBase);
+	void Close();
+	
+	// removes all files of allocator opened with fileNameBase
+	static void RemoveFiles(const char* fileNameBase);
+	
+	uint64_t Allocate(uint64_t size);
+	void Free(uint64_t ptr);
+	
+	inline uint64_t Superblocks() const {return preallocatedBlocks;}
+	inline uint64_t FreeSuperblocks() const {return freeSuperblocks.Size();}
+	// superblocks freed since Open() whose pages could not be released
+	inline uint64_t UnreleasedSuperblocks() const {return unreleasedSuperblocks;}
+	
+	template<typename T=void>
+	inline T* Origin() {return memory.Origin<T>();}
+	template<typename T=void>
+	inline const T* Origin() const {return memory.Origin<T>();}
+	
+	template<typename T=void>
+	inline T* Origin(uint64_t offset) {return memory.Origin<T>(offset);}
+	template<typename T=void>
+	inline const T* Origin(uint64_t offset) const {return memory.Origin<T>(offset);}
+	
+private:
+	
+	uint64_t InternalAllocate(uint64_t sizeBits);
+	void Reserve(uint64_t sizeBits);
+	void ReleaseSuperblock(uint64_t superblock);
+	
+	inline uint8_t& SizeBits(uint64_t superblock) {
+		return blockSizeAssociation.Origin<uint8_t>()[superblock];
+	}
+	inline uint32_t& LiveBlocks(uint64_t superblock) {
+		return liveBlocks.Origin<uint32_t>()[superblock];
+	}
+	
+	uint64_t preallocatedBlocks;
+	uint64_t unreleasedSuperblocks;
+	
+	CachedFile memory;
+	HeapFile heap[maxBlockSizeBits+1];
+	HeapFile freeSuperblocks;			// indices of superblocks not assigned to any size
+	CachedFile blockSizeAssociation;	// byte array[reserved max blocks] -> size of block used
+	CachedFile liveBlocks;				// uint32_t array[reserved max blocks] -> allocated blocks
+};
+
+#endif
+
@@ -0,0 +1,122 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OFFSET_PTR_HPP
+#define OFFSET_PTR_HPP
+
+#include <cinttypes>
+#include <cstdlib>
+#include <stdexcept>
+
+/*
+ *  Relative pointer resolved against origin of allocator bound to
+ *  AllocatorTag. It holds only offset so it can be stored inside of mapped
+ *  files. Uses 0 offset as NULL pointer, like LinearAllocator.
+ *  
+ *  Binding stores address of allocator origin, not origin itself, so
+ *  OffsetPtr stays valid after allocator file is resized and remapped.
+ *  
+ *  With 32 bit offsets pointed data need to be aligned to (1<<alignmentBits)
+ *  bytes, which gives 32 GiB address space for 8 byte alignment of
+ *  LinearAllocator. Offsets above maxOffset or not aligned throw
+ *  std::runtime_error instead of silently resolving to other address. Construction from integer offset is explicit, use
+ *  nullptr for NULL.
+ */
+
+template<typename AllocatorTag>
+class OffsetPtrBase {
+public:
+	
+	template<typename Allocator>
+	inline static void Bind(Allocator& allocator) {
+		origin = &allocator.template Data<uint8_t>();
+	}
+	inline static void Unbind() {origin = NULL;}
+	inline static bool Bound() {return origin != NULL;}
+	
+	inline static uint8_t* Origin() {return *origin;}
+	
+private:
+	
+	inline static uint8_t* const* origin = NULL;
+};
+
+template<typename T, typename AllocatorTag, typename OffsetType=uint64_t,
+	uint64_t alignmentBits=(sizeof(OffsetType)<8 ? 3 : 0)>
+class OffsetPtr {
+public:
+	
+	using Base = OffsetPtrBase<AllocatorTag>;
+	
+	const static uint64_t maxOffset =
+		(((uint64_t)(OffsetType)-1)<<alignmentBits) | ((1llu<<alignmentBits)-1);
+	
+	OffsetPtr() = default;
+	OffsetPtr(const OffsetPtr&) = default;
+	OffsetPtr(OffsetPtr&&) = default;
+	explicit OffsetPtr(uint64_t ptr) {*this = ptr;}
+	OffsetPtr(T* ptr) {*this = ptr;}
+	
+	OffsetPtr& operator=(const OffsetPtr&) = default;
+	OffsetPtr& operator=(OffsetPtr&&) = default;
+	inline OffsetPtr& operator=(uint64_t ptr) {
+		if(ptr > maxOffset)
+			throw std::runtime_error("OffsetPtr offset does not fit in OffsetType");
+		if(ptr & ((1llu<<alignmentBits)-1))
+			throw std::runtime_error("OffsetPtr offset is not aligned");
+		offset = ptr>>alignmentBits;
+		return *this;
+	}
+	inline OffsetPtr& operator=(T* ptr) {
+		if(ptr)
+			*this = (uint64_t)((uint8_t*)ptr - Base::Origin());
+		else
+			offset = 0;
+		return *this;
+	}
+	
+	inline T* Get() const {
+		return (T*)(Base::Origin() + (((uint64_t)offset)<<alignmentBits));
+	}
+	inline T& operator*() const {return *Get();}
+	inline T* operator->() const {return Get();}
+	inline T& operator[](uint64_t id) const {return Get()[id];}
+	
+	inline operator bool() const {return offset != 0;}
+	
+	inline bool operator==(const OffsetPtr& other) const {
+		return offset == other.offset;
+	}
+	inline bool operator!=(const OffsetPtr& other) const {
+		return offset != other.offset;
+	}
+	
+	inline uint64_t Ptr() const {return ((uint64_t)offset)<<alignmentBits;}
+	
+private:
+	
+	OffsetType offset;
+};
+
+static_assert(sizeof(OffsetPtr<uint64_t, void>) == 8);
+static_assert(sizeof(OffsetPtr<uint64_t, void, uint32_t>) == 4);
+static_assert(OffsetPtr<uint64_t, void, uint32_t>::maxOffset == (32llu<<30)-1);
+
+#endif
+
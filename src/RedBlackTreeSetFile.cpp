@@ -16,53 +16,40 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <RedBlackTreeSetFile.hpp>
-
-RedBlackTreeSetFile::Iterator& RedBlackTreeSetFile::Iterator::operator++() {
-	(*this) = this->operator++(int);
-	return *this;
-}
-
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::operator++(int) {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::Iterator::next() const {
 	if(!*this)
 		return *this;
 	Iterator r = right();
 	if(r)
 		return r.begin();
-	else
-		return r;
-}
-
-RedBlackTreeSetFile::Iterator& RedBlackTreeSetFile::Iterator::operator--() {
-	(*this) = this->operator--(int);
-	return *this;
+	Iterator c = *this;
+	Iterator p = parent();
+	while(p && p.right() == c) {
+		c = p;
+		p = c.parent();
+	}
+	return p;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::operator--(int) {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::Iterator::prev() const {
 	if(!*this)
 		return *this;
 	Iterator l = left();
 	if(l)
-		return l.begin();
-	else
-		return l;
-}
-
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::sibling() {
-	Iterator parent = parent();
-	if(!parent)
-		return parent;
-	if(parent.left() == *this)
-		return parent.right();
-	return parent.left();
-}
-
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::uncle() {
-	return parent().sibling();
+		return l.rbegin();
+	Iterator c = *this;
+	Iterator p = parent();
+	while(p && p.left() == c) {
+		c = p;
+		p = c.parent();
+	}
+	return p;
 }
 
-
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::begin() {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::Iterator::begin() const {
 	Iterator ret = *this;
 	if(!ret)
 		return ret;
@@ -75,7 +62,8 @@ RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::begin() {
 	return ret;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::rbegin() {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::Iterator::rbegin() const {
 	Iterator ret = *this;
 	if(!ret)
 		return ret;
@@ -90,77 +78,145 @@ RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::Iterator::rbegin() {
 
 
 
-
-
-
-
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::insert(Iterator hint, uint64_t value);
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::insert(uint64_t value) {
-	return insert(find_close(value), value);
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::insert(uint64_t value) {
+	Iterator it = find(value);
+	if(it)
+		return it;
+	// allocate before taking any pointers, allocation may remap file
+	uint64_t block = allocator->AllocateBlock();
+	Origin(block)->value = value;
+	TreeAccessor accessor{this};
+	Tree tree;
+	tree.tree = &accessor;
+	tree.Insert(accessor.Pointer(block));
+	_root().nodes++;
+	return Iterator(block, allocator);
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::erase(Iterator it) {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::erase(Iterator it) {
 	if(!it)
-		return end();
+		return it;
 	Iterator next = it.next();
-	
-	...
-	
+	TreeAccessor accessor{this};
+	Tree tree;
+	tree.tree = &accessor;
+	tree.Erase(accessor.Pointer(it.Ptr()));
+	allocator->FreeBlock(it.Ptr());
+	_root().nodes--;
 	return next;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::erase(uint64_t value) {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::erase(uint64_t value) {
 	return erase(find(value));
 }
 
 
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::find_closest(uint64_t value) {
-	Iterator it = root(), next;
-	while(true) {
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::find(uint64_t value) {
+	Iterator it = root();
+	while(it) {
 		uint64_t v = it.value();
 		if(value == v)
 			break;
 		else if(value < v)
-			next = it.left();
-		else
-			next = it.right();
-		if(next)
-			it = next;
+			it = it.left();
 		else
-			break;
+			it = it.right();
 	}
 	return it;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::find(uint64_t value) {
-	Iterator it = root();
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::find_ge(uint64_t value) {
+	Iterator it = root(), best = end();
 	while(it) {
 		uint64_t v = it.value();
 		if(value == v)
-			break;
-		else if(value < v)
+			return it;
+		else if(value < v) {
+			best = it;
 			it = it.left();
-		else
+		} else {
 			it = it.right();
+		}
 	}
-	return it;
+	return best;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::find_ge(uint64_t value) {
-	Iterator it = find_close(value);
-	if(it.value() < value)
-		return it.next();
-	return it;
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::find_le(uint64_t value) {
+	Iterator it = root(), best = end();
+	while(it) {
+		uint64_t v = it.value();
+		if(value == v)
+			return it;
+		else if(value < v) {
+			it = it.left();
+		} else {
+			best = it;
+			it = it.right();
+		}
+	}
+	return best;
 }
 
-RedBlackTreeSetFile::Iterator RedBlackTreeSetFile::find_le(uint64_t value) {
-	Iterator it = find_close(value);
-	if(it.value() > value)
-		return it.prev();
-	return it;
+
+
+template<typename F>
+uint64_t BasicRedBlackTreeSetFile<F>::rank(uint64_t value) {
+	TreeAccessor accessor{this};
+	Tree tree;
+	tree.tree = &accessor;
+	return tree.CountLower(value);
+}
+
+template<typename F>
+typename BasicRedBlackTreeSetFile<F>::Iterator BasicRedBlackTreeSetFile<F>::select(uint64_t id) {
+	TreeAccessor accessor{this};
+	Tree tree;
+	tree.tree = &accessor;
+	return Iterator(accessor.Offset(tree.Select(id)), allocator);
 }
 
+template<typename F>
+uint64_t BasicRedBlackTreeSetFile<F>::count_range(uint64_t min, uint64_t max) {
+	if(min > max)
+		return 0;
+	TreeAccessor accessor{this};
+	Tree tree;
+	tree.tree = &accessor;
+	return tree.CountLower(max, true) - tree.CountLower(min);
+}
+
+
 
+template<typename F>
+void BasicRedBlackTreeSetFile<F>::InitNewTree() {
+	ptr = allocator->AllocateBlock();
+	_root().root = -1;
+	_root().nodes = 0;
+}
+
+template<typename F>
+void BasicRedBlackTreeSetFile<F>::DestroyTree() {
+	if(ptr != -1) {
+		DestroyBranch(root());
+		allocator->FreeBlock(ptr);
+		ptr = -1;
+	}
+}
 
+template<typename F>
+void BasicRedBlackTreeSetFile<F>::DestroyBranch(Iterator it) {
+	// depth of balanced tree is logarithmic, recursion is safe
+	if(!it)
+		return;
+	DestroyBranch(it.left());
+	DestroyBranch(it.right());
+	allocator->FreeBlock(it.Ptr());
+}
 
@@ -22,125 +22,254 @@
 #include <cinttypes>
 #include <cstdlib>
 
-class RedBlackTreeSetFile {
-public:
+#include "BlockAllocator.hpp"
+#include "GenericRedBlackTree.hpp"
+
+/*
+ *  Node formats of BasicRedBlackTreeSetFile. Links are byte offsets of
+ *  blocks in allocator (-1 is invalid link), lowest bit of parent link holds
+ *  color of node since blocks are 8 byte aligned.
+ *  
+ *  Counted format stores number of nodes in subtree of every node, which is
+ *  required by rank(), select() and count_range().
+ */
+
+namespace RedBlackTreeSetFormat {
 	
-	struct Block {
-		uint64_t value;
-		uint64_t parent;
-		uint64_t left, right;
+	struct Wide {
+		struct Block {
+			uint64_t value;
+			uint64_t parent;
+			uint64_t left, right;
+			
+			inline uint64_t Parent() const {return (parent|1)==-1 ? -1 : parent&-2;}
+			inline void Parent(uint64_t ptr) {parent = (ptr&-2) | (parent&1);}
+			inline uint64_t Color() const {return parent&1;}
+			inline void Color(uint64_t color) {parent = (parent&-2) | color;}
+			
+			inline bool IsRed() const {return Color() == Generic::RED;}
+			inline bool IsBlack() const {return Color() == Generic::BLACK;}
+		};
 		
-		bool IsRed() const {return !(parent&1);}
-		bool IsBlack() const {return parent&1;}
-		uint64_t Parent() {return parent & -2;}
-		void SetRed() {parent &= -2;}
-		void SetBlack() {parent |= 1;}
+		const static uint64_t blockSize = 32;
+		const static bool packed = false;
+		const static bool counted = false;
+	};
+	
+	// Wide with 64 bit subtree size in 40 byte block
+	struct Counted {
+		struct Block : Wide::Block {
+			uint64_t count;
+		};
+		
+		const static uint64_t blockSize = 40;
+		const static bool packed = true;
+		const static bool counted = true;
+	};
+	
+	static_assert(sizeof(Wide::Block) == Wide::blockSize);
+	static_assert(sizeof(Counted::Block) == Counted::blockSize);
+};
+
+/*
+ *  Balanced set of uint64_t values stored in BlockAllocator, balancing is
+ *  done by Generic::RedBlackTree through accessors below.
+ */
+
+template<typename Format>
+class BasicRedBlackTreeSetFile {
+public:
+	
+	using AllocatorType = BlockAllocator<Format::blockSize, Format::packed>;
+	using Block = typename Format::Block;
+	
+	struct Root {
+		uint64_t root;
+		uint64_t nodes;
 	};
 	
 	class Iterator {
 	public:
 		
-		Iterator() : block(-1), set(NULL) {}
-		Iterator(Iterator&& other) : block(other.block), set(other.set) {}
-		Iterator(const Iterator& other) : block(other.block), set(other.set) {}
-		Iterator(uint64_t block, RedBlackTreeSet* set) : block(block), allocator(set.allocator) {}
-		Iterator(uint64_t block, BlockAllocator<32>* allocator) : block(block), allocator(allocator) {}
+		Iterator() : block(-1), allocator(NULL) {}
+		Iterator(const Iterator& other) : block(other.block), allocator(other.allocator) {}
+		Iterator(uint64_t block, AllocatorType* allocator) : block(block), allocator(allocator) {}
 		
 		inline Iterator& operator=(const Iterator& other) {
 			block = other.block;
 			allocator = other.allocator;
 			return *this;
 		}
-		inline Iterator& operator=(Iterator&& other) {
-			block = other.block;
-			allocator = other.allocator;
-			return *this;
-		}
 		
-		inline uint64_t& operator*(int) {return *Origin(block);}
+		inline uint64_t operator*() const {return GetBlock().value;}
 		
-		inline bool operator==(const Iterator<TI>& other) const {
+		inline bool operator==(const Iterator& other) const {
 			return block==other.block;
 		}
-		inline bool operator!=(const Iterator<TI>& other) const {
+		inline bool operator!=(const Iterator& other) const {
 			return block!=other.block;
 		}
 		
 		inline operator bool() const {return block!=-1;}
 		
-		inline Iterator next() const { Iterator ret = *this; return ret++;}
-		inline Iterator& operator++();
-		inline Iterator operator++(int);
+		Iterator next() const;
+		inline Iterator& operator++() {return *this = next();}
+		inline Iterator operator++(int) {Iterator ret = *this; *this = next(); return ret;}
 		
-		inline Iterator prev() const { Iterator ret = *this; return ret--;}
-		inline Iterator& operator--();
-		inline Iterator operator--(int);
+		Iterator prev() const;
+		inline Iterator& operator--() {return *this = prev();}
+		inline Iterator operator--(int) {Iterator ret = *this; *this = prev(); return ret;}
 		
-		inline Block& GetBlock() {return *alocator->Origin<Block>(block);}
+		inline Block& GetBlock() {return *allocator->template Origin<Block>(block);}
+		inline const Block& GetBlock() const {return *allocator->template Origin<Block>(block);}
 		
-		inline uint64_t& value() {return GetBlock().value;}
-		inline Iterator left() {return Iterator(GetBlock().left, allocator);}
-		inline Iterator right() {return Iterator(GetBlock().right, allocator);}
-		inline Iterator parent() {return Iterator(GetBlock().parent, allocator);}
+		// value must not be changed, it is the key
+		inline uint64_t value() const {return GetBlock().value;}
+		inline Iterator left() const {return Iterator(GetBlock().left, allocator);}
+		inline Iterator right() const {return Iterator(GetBlock().right, allocator);}
+		inline Iterator parent() const {return Iterator(GetBlock().Parent(), allocator);}
 		
 		inline bool red() const {return GetBlock().IsRed();}
 		inline bool black() const {return GetBlock().IsBlack();}
 		
-		inline Iterator grandParent() {return parent().parent();}
-		Iterator sibling();
+		// number of nodes in subtree
+		inline uint64_t count() const requires Format::counted {
+			return *this ? GetBlock().count : 0;
+		}
 		
-		Iterator uncle();
+		Iterator begin() const;
+		Iterator rbegin() const;
+		inline Iterator end() const {return Iterator(-1, allocator);}
+		inline Iterator rend() const {return end();}
 		
-		Iterator begin();
-		Iterator rbegin();
-		inline Iterator end() {return Iterator(-1,allocator);}
-		inline Iterator rend() {return end();}
+		inline uint64_t Ptr() const {return block;}
 		
 	private:
 		
 		uint64_t block;
-		BlockAllocator<32>* allocator;
+		AllocatorType* allocator;
 	};
 	
+	BasicRedBlackTreeSetFile() : ptr(-1), allocator(NULL) {}
+	BasicRedBlackTreeSetFile(AllocatorType* allocator) : ptr(-1), allocator(allocator) {}
+	BasicRedBlackTreeSetFile(uint64_t treeManagerNode, AllocatorType* allocator) : ptr(treeManagerNode), allocator(allocator) {}
+	BasicRedBlackTreeSetFile(const BasicRedBlackTreeSetFile& other) : ptr(other.ptr), allocator(other.allocator) {}
 	
-	Iterator insert(Iterator hint, uint64_t value);	// return Iterator to new element
-	Iterator insert(uint64_t value);				// return Iterator to new element
+	inline BasicRedBlackTreeSetFile& operator=(const BasicRedBlackTreeSetFile& other) {ptr=other.ptr; allocator=other.allocator; return*this;}
+	
+	inline operator bool() const {return ptr!=-1 && (bool)allocator && (bool)*allocator;}
+	
+	Iterator insert(uint64_t value);	// return Iterator to new or existing element
 	
 	Iterator erase(Iterator it);		// return Iterator to next element after removed
 	Iterator erase(uint64_t value);		// return Iterator to next element after removed
 	
-	Iterator find_closest(uint64_t value);
 	Iterator find(uint64_t value);
 	Iterator find_ge(uint64_t value);	// returns iterator to first element not lower than value
 	Iterator find_le(uint64_t value);	// returns iterator to first element not grater then value
 	
-	inline Iterator begin() {root().begin();}
-	inline Iterator rbegin() {root().rbegin();}
-	inline Iterator end() {return Iterator(-1,allocator);}
-	inline Iterator rend() {return end();}
+	// order statistics, available only for counted format, O(log n)
+	uint64_t rank(uint64_t value);		// returns number of elements lower than value
+	Iterator select(uint64_t id);		// returns iterator to id-th (from 0) lowest element
+	uint64_t count_range(uint64_t min, uint64_t max);	// returns number of elements in [min, max]
 	
-	inline Iterator root() {return Iterator(ptr, allocator);}
+	inline Iterator begin() {return root().begin();}
+	inline Iterator rbegin() {return root().rbegin();}
+	inline Iterator end() {return Iterator(-1, allocator);}
+	inline Iterator rend() {return end();}
 	
+	inline Iterator root() {return Iterator(_root().root, allocator);}
 	
 	template<typename T=Block>
-	inline T* Origin() {return allocator->Origin<T>();}
+	inline T* Origin() {return allocator->template Origin<T>();}
 	template<typename T=Block>
-	inline const T* Origin() const {return allocator->Origin<T>();}
+	inline const T* Origin() const {return allocator->template Origin<T>();}
 	
 	template<typename T=Block>
-	inline T* Origin(uint64_t offset) {return allocator->Origin<T>(offset);}
+	inline T* Origin(uint64_t offset) {return allocator->template Origin<T>(offset);}
 	template<typename T=Block>
 	inline const T* Origin(uint64_t offset) const {
-		return allocator->Origin<T>(offset);
+		return allocator->template Origin<T>(offset);
 	}
 	
-	Iterator
+	Root& _root() {return *allocator->template Origin<Root>(ptr);}
+	const Root& _root() const {return *allocator->template Origin<Root>(ptr);}
+	
+	void InitNewTree();
+	void DestroyTree();
+	
+	uint64_t size() const {return _root().nodes;}
 	
 private:
 	
+	// adapters for Generic::RedBlackTree, node pointers are valid only until
+	// next allocation in allocator
+	struct TreeAccessor {
+		BasicRedBlackTreeSetFile* set;
+		
+		inline uint8_t* Origin() {return set->allocator->template Origin<uint8_t>();}
+		inline void* Pointer(uint64_t offset) {
+			return offset==-1 ? NULL : Origin()+offset;
+		}
+		inline uint64_t Offset(void* ptr) {
+			return ptr ? (uint8_t*)ptr-Origin() : -1;
+		}
+		
+		inline void* Root() {return Pointer(set->_root().root);}
+		inline void Root(void* newRoot) {set->_root().root = Offset(newRoot);}
+	};
+	
+	struct NodeAccessor {
+		inline static uint64_t Color(TreeAccessor* tree, void* node) {
+			return ((Block*)node)->Color();
+		}
+		inline static void Color(TreeAccessor* tree, void* node, uint64_t newColor) {
+			((Block*)node)->Color(newColor);
+		}
+		inline static void* Left(TreeAccessor* tree, void* node) {
+			return tree->Pointer(((Block*)node)->left);
+		}
+		inline static void Left(TreeAccessor* tree, void* node, void* newLeft) {
+			((Block*)node)->left = tree->Offset(newLeft);
+		}
+		inline static void* Right(TreeAccessor* tree, void* node) {
+			return tree->Pointer(((Block*)node)->right);
+		}
+		inline static void Right(TreeAccessor* tree, void* node, void* newRight) {
+			((Block*)node)->right = tree->Offset(newRight);
+		}
+		inline static void* Parent(TreeAccessor* tree, void* node) {
+			return tree->Pointer(((Block*)node)->Parent());
+		}
+		inline static void Parent(TreeAccessor* tree, void* node, void* newParent) {
+			((Block*)node)->Parent(tree->Offset(newParent));
+		}
+		inline static uint64_t Value(TreeAccessor* tree, void* node) {
+			return ((Block*)node)->value;
+		}
+		inline static uint64_t Count(TreeAccessor* tree, void* node)
+			requires Format::counted {
+			return ((Block*)node)->count;
+		}
+		inline static void Count(TreeAccessor* tree, void* node,
+				uint64_t newCount) requires Format::counted {
+			((Block*)node)->count = newCount;
+		}
+	};
+	
+	using Tree = Generic::RedBlackTree<TreeAccessor, NodeAccessor>;
+	
+	void DestroyBranch(Iterator it);
+	
 	uint64_t ptr;
-	BlockAllocator<32>* allocator;
+	AllocatorType* allocator;
 };
 
+using RedBlackTreeSetFile = BasicRedBlackTreeSetFile<RedBlackTreeSetFormat::Wide>;
+using CountedRedBlackTreeSetFile =
+	BasicRedBlackTreeSetFile<RedBlackTreeSetFormat::Counted>;
+
+#include "RedBlackTreeSetFile.cpp"
+
 #endif
 
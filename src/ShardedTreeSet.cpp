@@ -0,0 +1,284 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ShardedTreeSet.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+
+ShardedTreeSet::Iterator& ShardedTreeSet::Iterator::operator++() {
+	std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+	uint64_t shard = heap.back().shard;
+	heap.pop_back();
+	if(cursors[shard].next())
+		Push(shard);
+	return *this;
+}
+
+void ShardedTreeSet::Iterator::Push(uint64_t shard) {
+	heap.push_back({cursors[shard].value(), shard});
+	std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+}
+
+
+
+ShardedTreeSet::ShardedTreeSet() {
+}
+
+ShardedTreeSet::ShardedTreeSet(const char* prefix, uint64_t shards,
+		Partitioning partitioning) {
+	Open(prefix, shards, partitioning);
+}
+
+ShardedTreeSet::~ShardedTreeSet() {
+	Close();
+}
+
+bool ShardedTreeSet::Open(const char* prefix, uint64_t shardCount,
+		Partitioning partitioning) {
+	Close();
+	base = prefix;
+	if(!meta.Open((base+".meta.raw").c_str()))
+		return false;
+	const bool created = meta.Size() < sizeof(Meta);
+	if(created) {
+		if(shardCount == 0)
+			shardCount = 1;
+		meta.Resize(sizeof(Meta) + shardCount*sizeof(Meta::shard[0]));
+		GetMeta().shards = shardCount;
+		GetMeta().partitioning = partitioning;
+	}
+	
+	shardCount = GetMeta().shards;
+	shards.resize(shardCount);
+	for(uint64_t i=0; i<shardCount; ++i) {
+		shards[i] = std::make_unique<Shard>();
+		Shard& shard = *shards[i];
+		const std::string name = base + "." + std::to_string(i);
+		if(!shard.allocator.Open((name+".mem.raw").c_str(),
+					(name+".heap.raw").c_str())) {
+			Close();
+			return false;
+		}
+		if(created) {
+			shard.set = TreeSetFile(&shard.allocator);
+			shard.set.InitNewTree();
+			// even split of whole uint64_t range
+			GetMeta().shard[i].lowest =
+				((unsigned __int128)i << 64) / shardCount;
+			GetMeta().shard[i].root = shard.set.GetTreeManagerNode();
+		} else {
+			shard.set = TreeSetFile(GetMeta().shard[i].root, &shard.allocator);
+		}
+	}
+	return true;
+}
+
+void ShardedTreeSet::Close() {
+	shards.clear();
+	meta.Close();
+	base.clear();
+}
+
+
+
+uint64_t ShardedTreeSet::ShardOf(uint64_t value) {
+	const Meta& m = GetMeta();
+	if(m.partitioning == HASH) {
+		// multiplicative mixing, then mapping onto [0, shards) without modulo
+		const uint64_t h = value * 0x9E3779B97F4A7C15llu;
+		return ((unsigned __int128)(h ^ (h >> 29)) * m.shards) >> 64;
+	}
+	uint64_t l = 0, r = m.shards;
+	while(r-l > 1) {
+		const uint64_t mid = (l+r) >> 1;
+		if(m.shard[mid].lowest <= value)
+			l = mid;
+		else
+			r = mid;
+	}
+	return l;
+}
+
+bool ShardedTreeSet::insert(uint64_t value) {
+	std::shared_lock lockPartition(partitionMutex);
+	Shard& shard = *shards[ShardOf(value)];
+	std::lock_guard lock(shard.mutex);
+	const uint64_t before = shard.set.size();
+	shard.set.insert(value);
+	return shard.set.size() != before;
+}
+
+bool ShardedTreeSet::erase(uint64_t value) {
+	std::shared_lock lockPartition(partitionMutex);
+	Shard& shard = *shards[ShardOf(value)];
+	std::lock_guard lock(shard.mutex);
+	const uint64_t before = shard.set.size();
+	shard.set.erase(value);
+	return shard.set.size() != before;
+}
+
+bool ShardedTreeSet::find(uint64_t value) {
+	std::shared_lock lockPartition(partitionMutex);
+	Shard& shard = *shards[ShardOf(value)];
+	std::lock_guard lock(shard.mutex);
+	return (bool)shard.set.find(value);
+}
+
+bool ShardedTreeSet::find_ge(uint64_t value, uint64_t& result) {
+	std::shared_lock lockPartition(partitionMutex);
+	bool found = false;
+	if(GetMeta().partitioning == RANGE) {
+		// first shard with an element not lower than value wins
+		for(uint64_t i=ShardOf(value); i<shards.size() && !found; ++i) {
+			std::lock_guard lock(shards[i]->mutex);
+			TreeSetFile::Iterator it = shards[i]->set.find_ge(value);
+			if(it) {
+				result = *it;
+				found = true;
+			}
+		}
+	} else {
+		for(auto& shard : shards) {
+			std::lock_guard lock(shard->mutex);
+			TreeSetFile::Iterator it = shard->set.find_ge(value);
+			if(it && (!found || *it < result)) {
+				result = *it;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+bool ShardedTreeSet::find_le(uint64_t value, uint64_t& result) {
+	std::shared_lock lockPartition(partitionMutex);
+	bool found = false;
+	if(GetMeta().partitioning == RANGE) {
+		for(int64_t i=ShardOf(value); i>=0 && !found; --i) {
+			std::lock_guard lock(shards[i]->mutex);
+			TreeSetFile::Iterator it = shards[i]->set.find_le(value);
+			if(it) {
+				result = *it;
+				found = true;
+			}
+		}
+	} else {
+		for(auto& shard : shards) {
+			std::lock_guard lock(shard->mutex);
+			TreeSetFile::Iterator it = shard->set.find_le(value);
+			if(it && (!found || *it > result)) {
+				result = *it;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+
+
+ShardedTreeSet::Iterator ShardedTreeSet::begin() {
+	Iterator it;
+	it.cursors.reserve(shards.size());
+	it.heap.reserve(shards.size());
+	for(uint64_t i=0; i<shards.size(); ++i) {
+		it.cursors.emplace_back(&shards[i]->set);
+		if(it.cursors[i].first())
+			it.Push(i);
+	}
+	return it;
+}
+
+ShardedTreeSet::Iterator ShardedTreeSet::lower_bound(uint64_t value) {
+	Iterator it;
+	it.cursors.reserve(shards.size());
+	it.heap.reserve(shards.size());
+	for(uint64_t i=0; i<shards.size(); ++i) {
+		it.cursors.emplace_back(&shards[i]->set);
+		if(it.cursors[i].seek(value))
+			it.Push(i);
+	}
+	return it;
+}
+
+
+
+uint64_t ShardedTreeSet::size() {
+	std::shared_lock lockPartition(partitionMutex);
+	uint64_t sum = 0;
+	for(auto& shard : shards) {
+		std::lock_guard lock(shard->mutex);
+		sum += shard->set.size();
+	}
+	return sum;
+}
+
+uint64_t ShardedTreeSet::ShardSize(uint64_t shard) {
+	std::shared_lock lockPartition(partitionMutex);
+	std::lock_guard lock(shards[shard]->mutex);
+	return shards[shard]->set.size();
+}
+
+bool ShardedTreeSet::Rebalance(double maxSkew) {
+	std::unique_lock lockPartition(partitionMutex);
+	Meta& m = GetMeta();
+	if(m.partitioning != RANGE || shards.size() < 2)
+		return false;
+	
+	uint64_t total = 0, largest = 0;
+	for(auto& shard : shards) {
+		total += shard->set.size();
+		largest = std::max(largest, shard->set.size());
+	}
+	if(total == 0 || largest <= maxSkew * total / shards.size())
+		return false;
+	
+	// shards hold consecutive ranges, so concatenation is already sorted
+	std::vector<uint64_t> values;
+	values.reserve(total);
+	for(auto& shard : shards)
+		for(TreeSetFile::Iterator it=shard->set.begin(); it; ++it)
+			values.push_back(*it);
+	
+	const uint64_t count = shards.size();
+	for(uint64_t i=0; i<count; ++i) {
+		const uint64_t begin = total*i/count;
+		const uint64_t end = total*(i+1)/count;
+		if(i > 0)
+			m.shard[i].lowest = values[begin];
+		// BuildFromSorted() appends its batch to memory file, start with
+		// empty allocator files so they do not grow with every rebuild
+		Shard& shard = *shards[i];
+		const std::string name = base + "." + std::to_string(i);
+		shard.allocator.Close();
+		std::remove((name+".mem.raw").c_str());
+		std::remove((name+".heap.raw").c_str());
+		if(!shard.allocator.Open((name+".mem.raw").c_str(),
+					(name+".heap.raw").c_str()))
+			throw std::runtime_error("ShardedTreeSet: cannot reopen " + name);
+		shard.set = TreeSetFile(&shard.allocator);
+		shard.set.InitNewTree();
+		shard.set.BuildFromSorted(values.begin()+begin, values.begin()+end);
+		m.shard[i].root = shard.set.GetTreeManagerNode();
+	}
+	return true;
+}
+
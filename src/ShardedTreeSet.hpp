@@ -0,0 +1,140 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARDED_TREE_SET_HPP
+#define SHARDED_TREE_SET_HPP
+
+#include "TreeSetFile.hpp"
+#include "CachedFile.hpp"
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+/*
+ *  Set of uint64_t values split into independent TreeSetFile shards, every
+ *  shard has its own allocator files and mutex, so writers to different
+ *  shards do not contend. Files:
+ *    - <prefix>.meta.raw: shard count, partitioning, then for every shard
+ *      lowest value of its range and pointer of its tree root
+ *    - <prefix>.<i>.mem.raw, <prefix>.<i>.heap.raw: allocator of shard i
+ *  
+ *  Range partitioning keeps ordered ranges in shards and can be rebalanced,
+ *  hash partitioning spreads any key distribution evenly. Ordered
+ *  iteration merges shards in both cases.
+ */
+
+class ShardedTreeSet {
+public:
+	
+	enum Partitioning : uint64_t {
+		RANGE = 0,
+		HASH = 1
+	};
+	
+	// k-way merge of shard cursors, writers must not modify set meanwhile
+	class Iterator {
+	public:
+		
+		inline operator bool() const {return !heap.empty();}
+		inline uint64_t operator*() const {return heap.front().value;}
+		Iterator& operator++();
+		
+		friend class ShardedTreeSet;
+		
+	private:
+		
+		struct Entry {
+			uint64_t value;
+			uint64_t shard;
+			inline bool operator>(const Entry& other) const {
+				return value > other.value;
+			}
+		};
+		
+		void Push(uint64_t shard);
+		
+		std::vector<TreeSetFile::Cursor> cursors;
+		std::vector<Entry> heap;
+	};
+	
+	ShardedTreeSet();
+	ShardedTreeSet(const char* prefix, uint64_t shards=8,
+			Partitioning partitioning=RANGE);
+	~ShardedTreeSet();
+	
+	// shards and partitioning are used only when set is created
+	bool Open(const char* prefix, uint64_t shards=8,
+			Partitioning partitioning=RANGE);
+	void Close();
+	
+	inline operator bool() const {return (bool)meta;}
+	
+	bool insert(uint64_t value);	// returns false if value was present
+	bool erase(uint64_t value);		// returns false if value was not present
+	
+	bool find(uint64_t value);
+	bool find_ge(uint64_t value, uint64_t& result);	// first element not lower than value
+	bool find_le(uint64_t value, uint64_t& result);	// first element not grater then value
+	
+	Iterator begin();
+	Iterator lower_bound(uint64_t value);
+	
+	uint64_t size();
+	inline uint64_t ShardCount() const {return shards.size();}
+	uint64_t ShardSize(uint64_t shard);
+	
+	/*
+	 *  Range partitioning only. When largest shard holds more than maxSkew
+	 *  times average number of elements, moves shard boundaries to equal
+	 *  quantiles and rebuilds shards as balanced trees in new allocator
+	 *  files. Blocks all other operations, returns true if shards were
+	 *  rebuilt. Not crash safe, interrupted rebalance loses elements.
+	 */
+	bool Rebalance(double maxSkew=1.5);
+	
+private:
+	
+	struct Shard {
+		TreeSetFile::AllocatorType allocator;
+		TreeSetFile set;
+		std::mutex mutex;
+	};
+	
+	struct Meta {
+		uint64_t shards;
+		uint64_t partitioning;
+		struct {
+			uint64_t lowest;
+			uint64_t root;
+		} shard[];
+	};
+	
+	inline Meta& GetMeta() {return *meta.Origin<Meta>();}
+	uint64_t ShardOf(uint64_t value);
+	
+	std::string base;
+	CachedFile meta;
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::shared_mutex partitionMutex;	// exclusive only during Rebalance
+};
+
+#endif
+
@@ -0,0 +1,274 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "SortedArrayFile.hpp"
+
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace {
+	
+	// number of elements in 16 element block lower than value
+	
+	inline uint64_t CountLessScalar(const uint64_t* block, uint64_t value) {
+		uint64_t count = 0;
+		for(uint64_t i=0; i<16; ++i)
+			count += block[i] < value;
+		return count;
+	}
+	
+	__attribute__((target("avx2")))
+	uint64_t CountLessAvx2(const uint64_t* block, uint64_t value) {
+		// unsigned comparison with signed instruction
+		const __m256i sign = _mm256_set1_epi64x(0x8000000000000000ull);
+		const __m256i v = _mm256_xor_si256(_mm256_set1_epi64x(value), sign);
+		uint32_t mask = 0;
+		for(int i=0; i<4; ++i) {
+			__m256i b = _mm256_xor_si256(sign,
+					_mm256_loadu_si256((const __m256i*)(block+i*4)));
+			mask |= (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+						_mm256_cmpgt_epi64(v, b))) << (i*4);
+		}
+		return __builtin_popcount(mask);
+	}
+	
+	__attribute__((target("avx512f")))
+	uint64_t CountLessAvx512(const uint64_t* block, uint64_t value) {
+		const __m512i v = _mm512_set1_epi64(value);
+		uint32_t mask = _mm512_cmplt_epu64_mask(_mm512_loadu_si512(block), v);
+		mask |= (uint32_t)_mm512_cmplt_epu64_mask(
+				_mm512_loadu_si512(block+8), v) << 8;
+		return __builtin_popcount(mask);
+	}
+	
+	uint64_t (*const CountLess)(const uint64_t*, uint64_t) = []() {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f"))
+			return CountLessAvx512;
+		if(__builtin_cpu_supports("avx2"))
+			return CountLessAvx2;
+		return +[](const uint64_t* block, uint64_t value)->uint64_t {
+				return CountLessScalar(block, value);
+			};
+	}();
+	
+	inline uint64_t Padded(uint64_t n) {
+		return (n + 15) & ~15llu;
+	}
+}
+
+SortedArrayFile::SortedArrayFile() : mergeThreshold(4096) {
+}
+
+SortedArrayFile::SortedArrayFile(const char* fileName,
+		const char* deltaFileName) : mergeThreshold(4096) {
+	Open(fileName, deltaFileName);
+}
+
+SortedArrayFile::~SortedArrayFile() {
+	Close();
+}
+
+bool SortedArrayFile::Open(const char* fileName, const char* deltaFileName) {
+	Close();
+	if(!file.Open(fileName) || !delta.Open(deltaFileName)) {
+		Close();
+		return false;
+	}
+	if(file.Size() < 64)
+		Resize(0);
+	if(delta.Size() < 8) {
+		delta.Resize(8);
+		delta.Origin<uint64_t>()[0] = 0;
+	}
+	BuildIndex();
+	return true;
+}
+
+void SortedArrayFile::Close() {
+	file.Close();
+	delta.Close();
+	index.clear();
+	levels.clear();
+}
+
+bool SortedArrayFile::insert(uint64_t value) {
+	const uint64_t* begin = Delta();
+	const uint64_t* end = begin + DeltaSize();
+	const uint64_t* it = std::lower_bound(begin, end, value);
+	if((it != end && *it == value) || find(value))
+		return false;
+	uint64_t pos = it - begin;
+	uint64_t count = DeltaSize();
+	if(delta.Size() < (count+2)<<3)
+		delta.Reserve((count+2)<<4);
+	uint64_t* values = delta.Origin<uint64_t>(8);
+	memmove(values+pos+1, values+pos, (count-pos)<<3);
+	values[pos] = value;
+	delta.Origin<uint64_t>()[0] = count+1;
+	if(count+1 >= mergeThreshold)
+		Merge();
+	return true;
+}
+
+void SortedArrayFile::Merge() {
+	const uint64_t m = DeltaSize();
+	if(m == 0)
+		return;
+	const uint64_t n = MainSize();
+	Resize(n+m);
+	uint64_t* values = file.Origin<uint64_t>(64);
+	const uint64_t* add = Delta();
+	// merge from the back, in place
+	uint64_t i = n, j = m, k = n+m;
+	while(j) {
+		if(i && values[i-1] > add[j-1])
+			values[--k] = values[--i];
+		else
+			values[--k] = add[--j];
+	}
+	delta.Origin<uint64_t>()[0] = 0;
+	BuildIndex();
+}
+
+bool SortedArrayFile::find(uint64_t value) const {
+	uint64_t result;
+	return find_ge(value, result) && result == value;
+}
+
+bool SortedArrayFile::find_ge(uint64_t value, uint64_t& result) const {
+	const uint64_t* begin = Delta();
+	const uint64_t* end = begin + DeltaSize();
+	const uint64_t* it = std::lower_bound(begin, end, value);
+	uint64_t i = lower_bound(value);
+	if(i < MainSize()) {
+		result = Main()[i];
+		if(it != end && *it < result)
+			result = *it;
+		return true;
+	} else if(it != end) {
+		result = *it;
+		return true;
+	}
+	return false;
+}
+
+bool SortedArrayFile::find_le(uint64_t value, uint64_t& result) const {
+	const uint64_t* begin = Delta();
+	const uint64_t* end = begin + DeltaSize();
+	const uint64_t* it = std::upper_bound(begin, end, value);
+	uint64_t i = value==~0ull ? MainSize() : lower_bound(value+1);
+	if(i) {
+		result = Main()[i-1];
+		if(it != begin && it[-1] > result)
+			result = it[-1];
+		return true;
+	} else if(it != begin) {
+		result = it[-1];
+		return true;
+	}
+	return false;
+}
+
+void SortedArrayFile::find_ge(const uint64_t* values, uint64_t count,
+		uint64_t* results, bool* found) const {
+	const uint64_t n = MainSize();
+	const uint64_t* main = Main();
+	const uint64_t* begin = Delta();
+	const uint64_t* end = begin + DeltaSize();
+	for(uint64_t g=0; g<count; g+=blockElements) {
+		const uint64_t group = std::min(count-g, blockElements);
+		const uint64_t* query = values+g;
+		uint64_t pos[blockElements] = {0};
+		bool over[blockElements];
+		uint64_t last = n ? main[n-1] : 0;
+		for(uint64_t q=0; q<group; ++q)
+			over[q] = n==0 || query[q] > last;
+		// descend all queries level by level, prefetching next blocks first,
+		// empty main array has no blocks to descend
+		const uint64_t depth = n ? levels.size()+1 : 0;
+		for(uint64_t l=0; l<depth; ++l) {
+			const uint64_t* level = l<levels.size() ? index.data()+levels[l] : main;
+			for(uint64_t q=0; q<group; ++q) {
+				__builtin_prefetch(level + (pos[q]<<4));
+				__builtin_prefetch(level + (pos[q]<<4) + 8);
+			}
+			for(uint64_t q=0; q<group; ++q) {
+				uint64_t v = over[q] ? 0 : query[q];
+				pos[q] = (pos[q]<<4) + CountLess(level + (pos[q]<<4), v);
+			}
+		}
+		for(uint64_t q=0; q<group; ++q) {
+			const uint64_t* it = std::lower_bound(begin, end, query[q]);
+			found[g+q] = true;
+			if(!over[q]) {
+				results[g+q] = main[pos[q]];
+				if(it != end && *it < results[g+q])
+					results[g+q] = *it;
+			} else if(it != end) {
+				results[g+q] = *it;
+			} else {
+				found[g+q] = false;
+			}
+		}
+	}
+}
+
+uint64_t SortedArrayFile::lower_bound(uint64_t value) const {
+	const uint64_t n = MainSize();
+	const uint64_t* main = Main();
+	if(n == 0 || value > main[n-1])
+		return n;
+	uint64_t pos = 0;
+	for(uint64_t offset : levels) {
+		const uint64_t* block = index.data() + offset + (pos<<4);
+		pos = (pos<<4) + CountLess(block, value);
+	}
+	return (pos<<4) + CountLess(main + (pos<<4), value);
+}
+
+void SortedArrayFile::Resize(uint64_t n) {
+	uint64_t oldSize = file.Size() >= 64 ? MainSize() : 0;
+	file.Resize(64 + (Padded(n)<<3));
+	uint64_t* values = file.Origin<uint64_t>(64);
+	for(uint64_t i=std::min(n, oldSize); i<Padded(n); ++i)
+		values[i] = ~0ull;
+	file.Origin<uint64_t>()[0] = n;
+}
+
+void SortedArrayFile::BuildIndex() {
+	index.clear();
+	levels.clear();
+	const uint64_t* level = Main();
+	uint64_t elements = MainSize();
+	// every level holds last element of each block of level below
+	while(elements > blockElements) {
+		uint64_t blocks = (elements+15)>>4;
+		uint64_t offset = index.size();
+		index.resize(offset + Padded(blocks), ~0ull);
+		level = offset ? index.data() + offset - Padded(elements) : Main();
+		for(uint64_t i=0; i<blocks; ++i)
+			index[offset+i] = level[std::min((i<<4)+15, elements-1)];
+		levels.emplace_back(offset);
+		elements = blocks;
+	}
+	std::reverse(levels.begin(), levels.end());
+}
+
@@ -0,0 +1,114 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SORTED_ARRAY_FILE_HPP
+#define SORTED_ARRAY_FILE_HPP
+
+#include "CachedFile.hpp"
+
+#include <vector>
+#include <algorithm>
+
+/*
+ *  Append-mostly set of uint64_t values stored as sorted array:
+ *    - main file: 64B header (first 8B: number of elements n), then values
+ *      padded with UINT64_MAX to multiple of 16
+ *    - delta file: 8B number of elements, then sorted values inserted since
+ *      last merge
+ *  
+ *  Search uses in-memory S-tree index: every level holds maximum of each
+ *  16 element block of level below, blocks are searched with AVX-512, AVX2
+ *  or scalar code selected at runtime.
+ */
+
+class SortedArrayFile {
+public:
+	
+	const static uint64_t blockElements = 16;
+	
+	SortedArrayFile();
+	SortedArrayFile(const char* fileName, const char* deltaFileName);
+	~SortedArrayFile();
+	
+	bool Open(const char* fileName, const char* deltaFileName);
+	void Close();
+	
+	inline operator bool() const {return (bool)file && (bool)delta;}
+	
+	// replaces content with sorted range, duplicates are skipped
+	template<typename It>
+	void Build(It begin, It end);
+	
+	// delta buffer is merged into main array when it reaches threshold
+	bool insert(uint64_t value);
+	void Merge();
+	inline void SetMergeThreshold(uint64_t value) {mergeThreshold = value;}
+	
+	bool find(uint64_t value) const;
+	bool find_ge(uint64_t value, uint64_t& result) const;	// first element not lower than value
+	bool find_le(uint64_t value, uint64_t& result) const;	// first element not grater then value
+	
+	// batched find_ge, interleaves memory accesses of up to 16 queries
+	void find_ge(const uint64_t* values, uint64_t count, uint64_t* results,
+			bool* found) const;
+	
+	inline uint64_t size() const {return MainSize() + DeltaSize();}
+	
+	// index in main array of first element not lower than value
+	uint64_t lower_bound(uint64_t value) const;
+	
+private:
+	
+	inline uint64_t MainSize() const {return file.Origin<uint64_t>()[0];}
+	inline uint64_t DeltaSize() const {return delta.Origin<uint64_t>()[0];}
+	inline const uint64_t* Main() const {return file.Origin<uint64_t>(64);}
+	inline const uint64_t* Delta() const {return delta.Origin<uint64_t>(8);}
+	
+	void Resize(uint64_t n);
+	void BuildIndex();
+	
+	CachedFile file;
+	CachedFile delta;
+	uint64_t mergeThreshold;
+	
+	// levels[0] is top level with at most 16 elements
+	std::vector<uint64_t> index;
+	std::vector<uint64_t> levels;
+};
+
+template<typename It>
+void SortedArrayFile::Build(It begin, It end) {
+	uint64_t n = 0;
+	for(It it=begin, prev=begin; it!=end; prev=it, ++it) {
+		if(it==begin || *prev != *it)
+			++n;
+	}
+	Resize(n);
+	uint64_t* values = file.Origin<uint64_t>(64);
+	uint64_t i = 0;
+	for(It it=begin, prev=begin; it!=end; prev=it, ++it) {
+		if(it==begin || *prev != *it)
+			values[i++] = *it;
+	}
+	delta.Origin<uint64_t>()[0] = 0;
+	BuildIndex();
+}
+
+#endif
+
@@ -0,0 +1,81 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "StaticTreeSetFile.hpp"
+
+StaticTreeSetFile::StaticTreeSetFile() {
+}
+
+StaticTreeSetFile::StaticTreeSetFile(const char* fileName) {
+	Open(fileName);
+}
+
+StaticTreeSetFile::~StaticTreeSetFile() {
+	Close();
+}
+
+bool StaticTreeSetFile::Open(const char* fileName) {
+	Close();
+	if(!file.Open(fileName))
+		return false;
+	if(file.Size() < 8) {
+		file.Resize(8);
+		file.Origin<uint64_t>()[0] = 0;
+	}
+	return true;
+}
+
+void StaticTreeSetFile::Close() {
+	file.Close();
+}
+
+bool StaticTreeSetFile::find(uint64_t value) const {
+	uint64_t result;
+	return find_ge(value, result) && result == value;
+}
+
+bool StaticTreeSetFile::find_ge(uint64_t value, uint64_t& result) const {
+	const uint64_t* values = file.Origin<uint64_t>();
+	const uint64_t n = values[0];
+	uint64_t k = 1;
+	while(k <= n) {
+		// 8 descendants three levels below k, 8k..8k+7, share a cache line
+		__builtin_prefetch(values + (k<<3));
+		k = (k<<1) + (values[k] < value);
+	}
+	// remove right turns and last left turn from path
+	k >>= __builtin_ffsll(~k);
+	result = values[k];
+	return k;
+}
+
+bool StaticTreeSetFile::find_le(uint64_t value, uint64_t& result) const {
+	const uint64_t* values = file.Origin<uint64_t>();
+	const uint64_t n = values[0];
+	uint64_t k = 1;
+	while(k <= n) {
+		__builtin_prefetch(values + (k<<3));
+		k = (k<<1) + (values[k] <= value);
+	}
+	// remove left turns and last right turn from path
+	k >>= __builtin_ffsll(k);
+	result = values[k];
+	return k;
+}
+
@@ -0,0 +1,121 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STATIC_TREE_SET_FILE_HPP
+#define STATIC_TREE_SET_FILE_HPP
+
+#include "CachedFile.hpp"
+#include "TreeSetFile.hpp"
+
+/*
+ *  Immutable set of uint64_t values stored in one file in Eytzinger layout
+ *  (implicit complete binary search tree in breadth first order):
+ *    - 8B: number of elements n
+ *    - n*8B: values, children of element k are at 2k and 2k+1
+ *  
+ *  Search is branch free and prefetches descendants three levels ahead,
+ *  which are in single cache line.
+ */
+
+class StaticTreeSetFile {
+public:
+	
+	StaticTreeSetFile();
+	StaticTreeSetFile(const char* fileName);
+	~StaticTreeSetFile();
+	
+	bool Open(const char* fileName);
+	void Close();
+	
+	inline operator bool() const {return (bool)file;}
+	
+	// builds from sorted range, duplicates are skipped
+	template<typename It>
+	void Build(It begin, It end);
+	template<typename Format>
+	void Build(BasicTreeSetFile<Format>& set);
+	
+	bool find(uint64_t value) const;
+	bool find_ge(uint64_t value, uint64_t& result) const;	// first element not lower than value
+	bool find_le(uint64_t value, uint64_t& result) const;	// first element not grater then value
+	
+	inline uint64_t size() const {return file.Origin<uint64_t>()[0];}
+	
+private:
+	
+	template<typename Generator>
+	void Build(uint64_t n, Generator next);
+	
+	CachedFile file;
+};
+
+template<typename It>
+void StaticTreeSetFile::Build(It begin, It end) {
+	uint64_t n = 0;
+	for(It it=begin, prev=begin; it!=end; prev=it, ++it) {
+		if(it==begin || *prev != *it)
+			++n;
+	}
+	It it = begin, prev = begin;
+	Build(n, [&]()->uint64_t {
+				while(it!=begin && *prev == *it)
+					++it;
+				prev = it;
+				++it;
+				return *prev;
+			});
+}
+
+template<typename Format>
+void StaticTreeSetFile::Build(BasicTreeSetFile<Format>& set) {
+	typename BasicTreeSetFile<Format>::Cursor cursor(&set);
+	cursor.first();
+	Build(set.size(), [&]()->uint64_t {
+				uint64_t value = cursor.value();
+				cursor.next();
+				return value;
+			});
+}
+
+template<typename Generator>
+void StaticTreeSetFile::Build(uint64_t n, Generator next) {
+	file.Resize((n+1)<<3);
+	uint64_t* values = file.Origin<uint64_t>();
+	values[0] = n;
+	if(n == 0)
+		return;
+	uint64_t k = 1;
+	while((k<<1) <= n)
+		k <<= 1;
+	for(uint64_t i=0; i<n; ++i) {
+		values[k] = next();
+		if((k<<1)+1 <= n) {
+			k = (k<<1)+1;
+			while((k<<1) <= n)
+				k <<= 1;
+		} else {
+			while(k & 1)
+				k >>= 1;
+			k >>= 1;
+		}
+	}
+}
+
+#endif
+
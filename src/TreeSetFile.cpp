@@ -16,9 +16,8 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "TreeSetFile.hpp"
-
-TreeSetFile::Iterator TreeSetFile::Iterator::next() const {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::next() const {
 	if(!*this)
 		return *this;
 	Iterator r = right();
@@ -38,19 +37,22 @@ TreeSetFile::Iterator TreeSetFile::Iterator::next() const {
 	return p.right().begin();
 }
 
-TreeSetFile::Iterator& TreeSetFile::Iterator::operator++() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator& BasicTreeSetFile<F>::Iterator::operator++() {
 	(*this) = next();
 	return *this;
 }
 
-TreeSetFile::Iterator TreeSetFile::Iterator::operator++(int) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::operator++(int) {
 	Iterator ret = *this;
 	(*this) = next();
 	return ret;
 }
 
 
-TreeSetFile::Iterator TreeSetFile::Iterator::prev() const {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::prev() const {
 	if(!*this)
 		return *this;
 	Iterator r = left();
@@ -81,19 +83,22 @@ TreeSetFile::Iterator TreeSetFile::Iterator::prev() const {
 		return l;
 }
 
-TreeSetFile::Iterator& TreeSetFile::Iterator::operator--() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator& BasicTreeSetFile<F>::Iterator::operator--() {
 	(*this) = prev();
 	return *this;
 }
 
-TreeSetFile::Iterator TreeSetFile::Iterator::operator--(int) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::operator--(int) {
 	Iterator ret = *this;
 	(*this) = prev();
 	return ret;
 }
 
 
-TreeSetFile::Iterator TreeSetFile::Iterator::sibling() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::sibling() {
 	Iterator parent = this->parent();
 	if(!parent)
 		return parent;
@@ -102,12 +107,14 @@ TreeSetFile::Iterator TreeSetFile::Iterator::sibling() {
 	return parent.left();
 }
 
-TreeSetFile::Iterator TreeSetFile::Iterator::uncle() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::uncle() {
 	return parent().sibling();
 }
 
 
-TreeSetFile::Iterator TreeSetFile::Iterator::begin() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::begin() {
 	Iterator ret = *this;
 	if(!ret)
 		return ret;
@@ -120,7 +127,8 @@ TreeSetFile::Iterator TreeSetFile::Iterator::begin() {
 	return ret;
 }
 
-TreeSetFile::Iterator TreeSetFile::Iterator::rbegin() {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::Iterator::rbegin() {
 	Iterator ret = *this;
 	if(!ret)
 		return ret;
@@ -137,24 +145,156 @@ TreeSetFile::Iterator TreeSetFile::Iterator::rbegin() {
 
 
 
-TreeSetFile::Iterator TreeSetFile::insert(Iterator hint, uint64_t value) {
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::first() {
+	depth = 0;
+	truncated = false;
+	for(uint64_t block = set->_root().root; block!=-1; block=F::Left(Get(block)))
+		Push(block);
+	return depth;
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::last() {
+	depth = 0;
+	truncated = false;
+	for(uint64_t block = set->_root().root; block!=-1; block=F::Right(Get(block)))
+		Push(block);
+	return depth;
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::seek(uint64_t value) {
+	Seek(value, false);
+	return depth;
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::seek_le(uint64_t value) {
+	Seek(value, true);
+	return depth;
+}
+
+template<typename F>
+void BasicTreeSetFile<F>::Cursor::Seek(uint64_t value, bool lower) {
+	depth = 0;
+	truncated = false;
+	uint64_t best = -1;
+	int64_t bestDepth = 0;
+	for(uint64_t block = set->_root().root; block!=-1;) {
+		if(Push(block))
+			bestDepth -= stackSize/2;
+		const Block& b = Get(block);
+		if(b.value == value) {
+			return;
+		} else if((b.value > value) != lower) {
+			best = block;
+			bestDepth = depth;
+		}
+		block = b.value > value ? F::Left(b) : F::Right(b);
+	}
+	if(best == -1) {
+		depth = 0;
+	} else if(bestDepth > 0) {
+		depth = bestDepth;
+	} else {
+		path[0] = best;
+		depth = 1;
+		truncated = true;
+	}
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::next() {
+	if(!depth)
+		return false;
+	uint64_t block = F::Right(Get(path[depth-1]));
+	if(block != -1) {
+		for(; block!=-1; block=F::Left(Get(block)))
+			Push(block);
+		return true;
+	}
+	for(;;) {
+		uint64_t child = path[depth-1];
+		uint64_t parent = PopToParent();
+		if(parent == -1)
+			return false;
+		if(F::Left(Get(parent)) == child)
+			return true;
+	}
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::prev() {
+	if(!depth)
+		return false;
+	uint64_t block = F::Left(Get(path[depth-1]));
+	if(block != -1) {
+		for(; block!=-1; block=F::Right(Get(block)))
+			Push(block);
+		return true;
+	}
+	for(;;) {
+		uint64_t child = path[depth-1];
+		uint64_t parent = PopToParent();
+		if(parent == -1)
+			return false;
+		if(F::Right(Get(parent)) == child)
+			return true;
+	}
+}
+
+template<typename F>
+bool BasicTreeSetFile<F>::Cursor::Push(uint64_t block) {
+	bool shifted = false;
+	if(depth == stackSize) {
+		for(uint64_t i=0; i<stackSize/2; ++i)
+			path[i] = path[i+stackSize/2];
+		depth -= stackSize/2;
+		truncated = true;
+		shifted = true;
+	}
+	path[depth++] = block;
+	return shifted;
+}
+
+template<typename F>
+uint64_t BasicTreeSetFile<F>::Cursor::PopToParent() {
+	uint64_t child = path[--depth];
+	if(depth)
+		return path[depth-1];
+	if(truncated) {
+		uint64_t parent = F::Parent(Get(child));
+		if(parent != -1) {
+			path[depth++] = parent;
+			return parent;
+		}
+		truncated = false;
+	}
+	return -1;
+}
+
+
+
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::insert(Iterator hint, uint64_t value) {
 	if(hint && hint.value()==value) {
 		return hint;
 	}
 	Iterator it(allocator->AllocateBlock(), allocator);
 	it.value() = value;
-	it.GetBlock().parent = hint.block;
-	it.GetBlock().left = -1;
-	it.GetBlock().right = -1;
+	it.SetParent(hint.block);
+	it.SetLeft(-1);
+	it.SetRight(-1);
 	if(!hint) {
 		_root().root = it.block;
 	} else {
 		uint64_t hv = hint.value();
 		
 		if(hv < value)
-			hint.GetBlock().right = it.block;
+			hint.SetRight(it.block);
 		else
-			hint.GetBlock().left = it.block;
+			hint.SetLeft(it.block);
 	}
 	
 	_root().nodes++;
@@ -162,16 +302,17 @@ TreeSetFile::Iterator TreeSetFile::insert(Iterator hint, uint64_t value) {
 	return it;
 }
 
-TreeSetFile::Iterator TreeSetFile::insert(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::insert(uint64_t value) {
 	return insert(find_closest(value), value);
 }
 
-TreeSetFile::Iterator TreeSetFile::erase(Iterator it) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::erase(Iterator it) {
 	if(!it)
 		return it;
 	Iterator next = it.next();
-	_root().nodes--;
-	if(it.GetBlock().left!=-1 && it.GetBlock().right!=-1) {
+	if(it.left() && it.right()) {
 		uint64_t next_value = next.value();
 		erase(next);
 		it.value() = next_value;
@@ -182,34 +323,36 @@ TreeSetFile::Iterator TreeSetFile::erase(Iterator it) {
 		r = it.right();
 		
 		Iterator parent = it.parent();
-		const bool itWasLeft = (parent&&parent.GetBlock().left==it.block) ? true : false;
+		const bool itWasLeft = (parent&&parent.left()==it) ? true : false;
+		
+		_root().nodes--;
 		
 		if(l) {
-			l.GetBlock().parent = parent.block;
+			l.SetParent(parent.block);
 			if(parent) {
 				if(itWasLeft)
-					parent.GetBlock().left = l.block;
+					parent.SetLeft(l.block);
 				else
-					parent.GetBlock().right = l.block;
+					parent.SetRight(l.block);
 			} else {
 				_root().root = l.block;
 			}
 		} else if(r) {
-			r.GetBlock().parent = parent.block;
+			r.SetParent(parent.block);
 			if(parent) {
 				if(itWasLeft)
-					parent.GetBlock().left = r.block;
+					parent.SetLeft(r.block);
 				else
-					parent.GetBlock().right = r.block;
+					parent.SetRight(r.block);
 			} else {
 				_root().root = r.block;
 			}
 		} else {
 			if(parent) {
 				if(itWasLeft)
-					parent.GetBlock().left = -1;
+					parent.SetLeft(-1);
 				else
-					parent.GetBlock().right = -1;
+					parent.SetRight(-1);
 			} else {
 				_root().root = -1;
 			}
@@ -220,13 +363,15 @@ TreeSetFile::Iterator TreeSetFile::erase(Iterator it) {
 	return next;
 }
 
-TreeSetFile::Iterator TreeSetFile::erase(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::erase(uint64_t value) {
 	return erase(find(value));
 }
 
 
 
-TreeSetFile::Iterator TreeSetFile::find_closest(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::find_closest(uint64_t value) {
 	Iterator it = root(), next;
 	if(!it)
 		return it;
@@ -246,7 +391,8 @@ TreeSetFile::Iterator TreeSetFile::find_closest(uint64_t value) {
 	return it;
 }
 
-TreeSetFile::Iterator TreeSetFile::find(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::find(uint64_t value) {
 	Iterator it = root();
 	if(!it)
 		return it;
@@ -262,7 +408,8 @@ TreeSetFile::Iterator TreeSetFile::find(uint64_t value) {
 	return it;
 }
 
-TreeSetFile::Iterator TreeSetFile::find_ge(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::find_ge(uint64_t value) {
 	if(!root())
 		return end();
 	Iterator it = find_closest(value);
@@ -271,7 +418,8 @@ TreeSetFile::Iterator TreeSetFile::find_ge(uint64_t value) {
 	return it;
 }
 
-TreeSetFile::Iterator TreeSetFile::find_le(uint64_t value) {
+template<typename F>
+typename BasicTreeSetFile<F>::Iterator BasicTreeSetFile<F>::find_le(uint64_t value) {
 	if(!root())
 		return end();
 	Iterator it = find_closest(value);
@@ -280,15 +428,122 @@ TreeSetFile::Iterator TreeSetFile::find_le(uint64_t value) {
 	return it;
 }
 
+template<typename F>
+void BasicTreeSetFile<F>::find_many(std::span<const uint64_t> values,
+		std::span<Iterator> out) {
+	const uint64_t group = 16;
+	const uint64_t count = std::min(values.size(), out.size());
+	const uint64_t rootBlock = _root().root;
+	uint64_t block[group], query[group];
+	uint64_t active = 0, next = 0;
+	for(; active<group && next<count; ++active, ++next) {
+		query[active] = next;
+		block[active] = rootBlock;
+	}
+	while(active) {
+		for(uint64_t i=0; i<active;) {
+			const uint64_t q = query[i];
+			uint64_t b = block[i];
+			if(b != -1) {
+				const Block& node = *Origin(b);
+				if(node.value != values[q]) {
+					b = values[q] < node.value ? F::Left(node) : F::Right(node);
+					block[i] = b;
+					if(b != -1) {
+						__builtin_prefetch(Origin(b));
+						++i;
+						continue;
+					}
+				}
+			}
+			// lookup finished, slot takes next query or last active one
+			out[q] = Iterator(b, allocator);
+			if(next < count) {
+				query[i] = next++;
+				block[i] = rootBlock;
+				++i;
+			} else {
+				--active;
+				query[i] = query[active];
+				block[i] = block[active];
+			}
+		}
+	}
+}
+
+
+
+template<typename F>
+std::pmr::vector<uint64_t> BasicTreeSetFile<F>::range(uint64_t min,
+		uint64_t max, std::pmr::memory_resource* resource) {
+	std::pmr::vector<uint64_t> ret(resource);
+	Cursor cursor(this);
+	for(bool valid=cursor.seek(min); valid && cursor.value()<=max;
+			valid=cursor.next())
+		ret.emplace_back(cursor.value());
+	return ret;
+}
 
+template<typename F>
+template<typename It>
+void BasicTreeSetFile<F>::BuildFromSorted(It begin, It end) {
+	DestroyBranch(root());
+	_root().root = -1;
+	_root().nodes = 0;
+	
+	uint64_t n = 0;
+	for(It it=begin, prev=begin; it!=end; prev=it, ++it) {
+		if(it==begin || *prev != *it)
+			++n;
+	}
+	if(n == 0)
+		return;
+	
+	// node k (from 1) of implicit complete tree is placed at base+(k-1)*size
+	const uint64_t base = allocator->AllocateContiguousBlocks(n);
+	const uint64_t size = AllocatorType::blockSize;
+	Block* blocks = allocator->template Origin<Block>(base) - 1;
+	
+	// assign values in order
+	uint64_t k = 1;
+	while((k<<1) <= n)
+		k <<= 1;
+	for(It it=begin, prev=begin; it!=end; prev=it, ++it) {
+		if(it!=begin && *prev == *it)
+			continue;
+		blocks[k].value = *it;
+		if((k<<1)+1 <= n) {
+			k = (k<<1)+1;
+			while((k<<1) <= n)
+				k <<= 1;
+		} else {
+			while(k & 1)
+				k >>= 1;
+			k >>= 1;
+		}
+	}
+	
+	for(k=n; k>0; --k) {
+		Block& b = blocks[k];
+		const uint64_t l = k<<1, r = l+1;
+		F::Parent(b, k>1 ? base+((k>>1)-1)*size : -1);
+		F::Left(b, l<=n ? base+(l-1)*size : -1);
+		F::Right(b, r<=n ? base+(r-1)*size : -1);
+	}
+	
+	_root().root = base;
+	_root().nodes = n;
+}
 
-void TreeSetFile::InitNewTree() {
+template<typename F>
+void BasicTreeSetFile<F>::InitNewTree() {
 	ptr = allocator->AllocateBlock();
 	_root().root = -1;
 	_root().nodes = 0;
 }
 
-void TreeSetFile::DestroyTree() {
+template<typename F>
+void BasicTreeSetFile<F>::DestroyTree() {
 	if(ptr != -1) {
 		DestroyBranch(root());
 		allocator->FreeBlock(ptr);
@@ -296,7 +551,8 @@ void TreeSetFile::DestroyTree() {
 	}
 }
 
-void TreeSetFile::DestroyBranch(Iterator it) {
+template<typename F>
+void BasicTreeSetFile<F>::DestroyBranch(Iterator it) {
 	if(!it)
 		return;
 	DestroyBranch(it.left());
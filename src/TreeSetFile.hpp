@@ -16,33 +16,103 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+
 #ifndef TREE_SET_FILE_HPP
 #define TREE_SET_FILE_HPP
 
 #include "BlockAllocator.hpp"
 
-class TreeSetFile {
+#include <span>
+#include <algorithm>
+#include <vector>
+#include <memory_resource>
+#include <stdexcept>
+
+/*
+ *  Node formats of BasicTreeSetFile. Every format provides Block structure,
+ *  its size and accessors converting links to and from byte offsets of
+ *  blocks in allocator (-1 is invalid link). Packed formats are stored in
+ *  packed BlockAllocator, which does not round block size to power of two.
+ */
+
+namespace TreeSetFormat {
+	
+	// 64 bit byte offsets in 32 byte block
+	struct Wide {
+		struct Block {
+			uint64_t value;
+			uint64_t parent;
+			uint64_t left, right;
+		};
+		
+		const static uint64_t blockSize = 32;
+		const static bool packed = false;
+		
+		inline static uint64_t Parent(const Block& b) {return b.parent;}
+		inline static uint64_t Left(const Block& b) {return b.left;}
+		inline static uint64_t Right(const Block& b) {return b.right;}
+		inline static void Parent(Block& b, uint64_t ptr) {b.parent = ptr;}
+		inline static void Left(Block& b, uint64_t ptr) {b.left = ptr;}
+		inline static void Right(Block& b, uint64_t ptr) {b.right = ptr;}
+	};
+	
+	// 32 bit block indices in 24 byte block, addresses up to 96 GiB of nodes
+	struct Compact {
+		struct Block {
+			uint64_t value;
+			uint32_t parent;
+			uint32_t left, right;
+			uint32_t reserved;
+		};
+		
+		const static uint64_t blockSize = 24;
+		const static bool packed = true;
+		
+		inline static uint64_t Decode(uint32_t id) {
+			return id==(uint32_t)-1 ? -1 : id*blockSize;
+		}
+		// index -1 is reserved for invalid link
+		inline static uint32_t Encode(uint64_t ptr) {
+			if(ptr == -1)
+				return -1;
+			if(ptr/blockSize >= (uint32_t)-1)
+				throw std::runtime_error("CompactTreeSetFile: block index does "
+						"not fit in 32 bits");
+			return ptr/blockSize;
+		}
+		
+		inline static uint64_t Parent(const Block& b) {return Decode(b.parent);}
+		inline static uint64_t Left(const Block& b) {return Decode(b.left);}
+		inline static uint64_t Right(const Block& b) {return Decode(b.right);}
+		inline static void Parent(Block& b, uint64_t ptr) {b.parent = Encode(ptr);}
+		inline static void Left(Block& b, uint64_t ptr) {b.left = Encode(ptr);}
+		inline static void Right(Block& b, uint64_t ptr) {b.right = Encode(ptr);}
+	};
+	
+	static_assert(sizeof(Wide::Block) == Wide::blockSize);
+	static_assert(sizeof(Compact::Block) == Compact::blockSize);
+};
+
+template<typename Format>
+class BasicTreeSetFile {
 public:
 	
+	using AllocatorType = BlockAllocator<Format::blockSize, Format::packed>;
+	using Block = typename Format::Block;
+	
 	struct Root {
 		uint64_t root;
 		uint64_t nodes;
 	};
 	
-	struct Block {
-		uint64_t value;
-		uint64_t parent;
-		uint64_t left, right;
-	};
-	
 	class Iterator {
 	public:
 		
 		Iterator() : block(-1), allocator(NULL) {}
 		Iterator(Iterator&& other) : block(other.block), allocator(other.allocator) {}
 		Iterator(const Iterator& other) : block(other.block), allocator(other.allocator) {}
-		Iterator(uint64_t block, TreeSetFile* set) : block(block), allocator(set->allocator) {}
-		Iterator(uint64_t block, BlockAllocator<32>* allocator) : block(block), allocator(allocator) {}
+		Iterator(uint64_t block, BasicTreeSetFile* set) : block(block), allocator(set->allocator) {}
+		Iterator(uint64_t block, AllocatorType* allocator) : block(block), allocator(allocator) {}
 		
 		inline Iterator& operator=(const Iterator& other) {
 			block = other.block;
@@ -74,14 +144,18 @@ public:
 		Iterator& operator--();
 		Iterator operator--(int);
 		
-		inline Block& GetBlock() {return *allocator->Origin<Block>(block);}
-		inline const Block& GetBlock() const {return *allocator->Origin<Block>(block);}
+		inline Block& GetBlock() {return *allocator->template Origin<Block>(block);}
+		inline const Block& GetBlock() const {return *allocator->template Origin<Block>(block);}
 		
 		inline uint64_t& value() {return GetBlock().value;}
 		inline uint64_t value() const {return GetBlock().value;}
-		inline Iterator left() const {return Iterator(GetBlock().left, allocator);}
-		inline Iterator right() const {return Iterator(GetBlock().right, allocator);}
-		inline Iterator parent() const {return Iterator(GetBlock().parent, allocator);}
+		inline Iterator left() const {return Iterator(Format::Left(GetBlock()), allocator);}
+		inline Iterator right() const {return Iterator(Format::Right(GetBlock()), allocator);}
+		inline Iterator parent() const {return Iterator(Format::Parent(GetBlock()), allocator);}
+		
+		inline void SetLeft(uint64_t ptr) {Format::Left(GetBlock(), ptr);}
+		inline void SetRight(uint64_t ptr) {Format::Right(GetBlock(), ptr);}
+		inline void SetParent(uint64_t ptr) {Format::Parent(GetBlock(), ptr);}
 		
 		inline Iterator grandParent() {return parent().parent();}
 		Iterator sibling();
@@ -93,7 +167,9 @@ public:
 		inline Iterator end() {return Iterator(-1,allocator);}
 		inline Iterator rend() {return end();}
 		
-		friend class TreeSetFile;
+		inline uint64_t Ptr() const {return block;}
+		
+		friend class BasicTreeSetFile;
 		
 		void Print(uint64_t tab) {
 			if(!*this)
@@ -119,20 +195,66 @@ public:
 	private:
 		
 		uint64_t block;
-		BlockAllocator<32>* allocator;
+		AllocatorType* allocator;
+	};
+	
+	/*
+	 *  Cursor keeps path from root to current element on fixed size stack,
+	 *  so next() and prev() touch only nodes on that path and take amortized
+	 *  O(1) steps. When tree is deeper than stack, the part of path closest
+	 *  to root is dropped and restored from parent links when needed.
+	 */
+	class Cursor {
+	public:
+		
+		const static uint64_t stackSize = 64;
+		
+		Cursor() : depth(0), truncated(false), set(NULL) {}
+		Cursor(BasicTreeSetFile* set) : depth(0), truncated(false), set(set) {}
+		
+		bool first();
+		bool last();
+		bool seek(uint64_t value);		// moves to first element not lower than value
+		bool seek_le(uint64_t value);	// moves to first element not grater then value
+		
+		bool next();
+		bool prev();
+		
+		inline operator bool() const {return depth!=0;}
+		
+		inline uint64_t value() const {return Get(path[depth-1]).value;}
+		inline Iterator iterator() const {
+			return Iterator(depth ? path[depth-1] : -1, set->allocator);
+		}
+		
+	private:
+		
+		inline const Block& Get(uint64_t block) const {
+			return *set->allocator->template Origin<Block>(block);
+		}
+		
+		bool Push(uint64_t block);	// returns true if stack was shifted
+		uint64_t PopToParent();
+		void Seek(uint64_t value, bool lower);
+		
+		uint64_t path[stackSize];
+		uint64_t depth;
+		bool truncated;
+		BasicTreeSetFile* set;
 	};
 	
-	TreeSetFile() : ptr(0), allocator(NULL) {}
-	TreeSetFile(BlockAllocator<32>* allocator) : ptr(0), allocator(allocator) {}
-	TreeSetFile(uint64_t treeManagerNode, BlockAllocator<32>* allocator) : ptr(treeManagerNode), allocator(allocator) {}
-	TreeSetFile(TreeSetFile&& other) : ptr(other.ptr), allocator(other.allocator) {}
-	TreeSetFile(const TreeSetFile& other) : ptr(other.ptr), allocator(other.allocator) {}
-	~TreeSetFile() {ptr=0; allocator=NULL;}
+	BasicTreeSetFile() : ptr(0), allocator(NULL) {}
+	BasicTreeSetFile(AllocatorType* allocator) : ptr(0), allocator(allocator) {}
+	BasicTreeSetFile(uint64_t treeManagerNode, AllocatorType* allocator) : ptr(treeManagerNode), allocator(allocator) {}
+	BasicTreeSetFile(BasicTreeSetFile&& other) : ptr(other.ptr), allocator(other.allocator) {}
+	BasicTreeSetFile(const BasicTreeSetFile& other) : ptr(other.ptr), allocator(other.allocator) {}
+	~BasicTreeSetFile() {ptr=0; allocator=NULL;}
 	
-	inline TreeSetFile& operator=(TreeSetFile&& other) {ptr=other.ptr; allocator=other.allocator; return*this;}
-	inline TreeSetFile& operator=(const TreeSetFile& other) {ptr=other.ptr; allocator=other.allocator; return*this;}
+	inline BasicTreeSetFile& operator=(BasicTreeSetFile&& other) {ptr=other.ptr; allocator=other.allocator; return*this;}
+	inline BasicTreeSetFile& operator=(const BasicTreeSetFile& other) {ptr=other.ptr; allocator=other.allocator; return*this;}
 	
 	inline operator bool() const {return ptr!=-1 && (bool)allocator && (bool)*allocator;}
+	inline uint64_t GetTreeManagerNode() const {return ptr;}
 	
 	
 	Iterator insert(Iterator hint, uint64_t value);	// return Iterator to new element
@@ -146,6 +268,18 @@ public:
 	Iterator find_ge(uint64_t value);	// returns iterator to first element not lower than value
 	Iterator find_le(uint64_t value);	// returns iterator to first element not grater then value
 	
+	/*
+	 *  Batched find(), out[i] is set to result for values[i]. Up to 16
+	 *  lookups walk down the tree in lockstep, next node of each one is
+	 *  prefetched before others are advanced.
+	 */
+	void find_many(std::span<const uint64_t> values, std::span<Iterator> out);
+	
+	// returns all values in [min, max], memory comes from resource, which
+	// can be per request Arena
+	std::pmr::vector<uint64_t> range(uint64_t min, uint64_t max,
+			std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+	
 	inline Iterator begin() {return root().begin();}
 	inline Iterator rbegin() {return root().rbegin();}
 	inline Iterator end() {return Iterator(-1,allocator);}
@@ -155,19 +289,32 @@ public:
 	
 	
 	template<typename T=Block>
-	inline T* Origin() {return allocator->Origin<T>();}
+	inline T* Origin() {return allocator->template Origin<T>();}
 	template<typename T=Block>
-	inline const T* Origin() const {return allocator->Origin<T>();}
+	inline const T* Origin() const {return allocator->template Origin<T>();}
 	
 	template<typename T=Block>
-	inline T* Origin(uint64_t offset) {return allocator->Origin<T>(offset);}
+	inline T* Origin(uint64_t offset) {return allocator->template Origin<T>(offset);}
 	template<typename T=Block>
 	inline const T* Origin(uint64_t offset) const {
-		return allocator->Origin<T>(offset);
+		return allocator->template Origin<T>(offset);
 	}
 	
-	Root& _root() {return *allocator->Origin<Root>(ptr);}
-	const Root& _root() const {return *allocator->Origin<Root>(ptr);}
+	Root& _root() {return *allocator->template Origin<Root>(ptr);}
+	const Root& _root() const {return *allocator->template Origin<Root>(ptr);}
+	
+	/*
+	 *  Replaces content of tree with perfectly balanced tree built from
+	 *  sorted range (duplicates are skipped). Nodes are allocated as one
+	 *  contiguous batch and placed in breadth first order.
+	 *  
+	 *  The batch is always appended at the end of memory file. Old nodes
+	 *  are freed one by one and reused by later insert(), but not by later
+	 *  BuildFromSorted(), so every rebuild grows the file by one node per
+	 *  value.
+	 */
+	template<typename It>
+	void BuildFromSorted(It begin, It end);
 	
 	void InitNewTree();
 	void DestroyTree();
@@ -178,8 +325,13 @@ public:
 private:
 	
 	uint64_t ptr;
-	BlockAllocator<32>* allocator;
+	AllocatorType* allocator;
 };
 
+using TreeSetFile = BasicTreeSetFile<TreeSetFormat::Wide>;
+using CompactTreeSetFile = BasicTreeSetFile<TreeSetFormat::Compact>;
+
+#include "TreeSetFile.cpp"
+
 #endif
 
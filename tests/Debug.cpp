@@ -20,3 +20,11 @@
 
 std::chrono::high_resolution_clock::time_point beg, end;
 
+std::atomic<uint64_t> errors = 0;
+
+void RemoveFiles(const std::string& prefix,
+		std::initializer_list<const char*> suffixes) {
+	for(const char* suffix : suffixes)
+		std::remove((prefix+suffix).c_str());
+}
+
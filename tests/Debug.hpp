@@ -25,6 +25,10 @@
 #include <cmath>
 #include <cstdlib>
 
+#include <atomic>
+#include <initializer_list>
+#include <string>
+
 constexpr bool enableDebug =
 #ifdef RELEASE_BUILD
 	false;
@@ -46,5 +50,19 @@ extern std::chrono::high_resolution_clock::time_point beg, end;
 #define Rand64() ((Rand32()<<32) | Rand32())
 #define RandMinMax(MIN, MAX) ((Rand64()%(MAX-MIN+1))+MIN)
 
+// number of failed CHECKs, first few are printed, safe to use from many
+// threads
+extern std::atomic<uint64_t> errors;
+
+#define CHECK(CONDITION, ...) \
+	do { \
+		if(!(CONDITION) && ++errors < 10) \
+			printf("\n error: " __VA_ARGS__); \
+	} while(0)
+
+// removes files named prefix followed by every suffix
+void RemoveFiles(const std::string& prefix,
+		std::initializer_list<const char*> suffixes);
+
 #endif
 
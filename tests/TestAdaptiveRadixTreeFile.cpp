@@ -0,0 +1,284 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "AdaptiveRadixTreeFile.hpp"
+#include "TreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <string>
+
+#include <map>
+#include <vector>
+
+const uint64_t testValues = 200000;
+const uint64_t benchmarkValues = 1000000;
+
+inline std::string Key(const AdaptiveRadixTreeFile::Cursor& cursor) {
+	return std::string((const char*)cursor.key(), cursor.length());
+}
+
+void Verify(const char* name, AdaptiveRadixTreeFile& tree,
+		const std::map<uint64_t, uint64_t>& ref) {
+	CHECK(tree.size() == ref.size(), "%s size %lu != %lu", name, tree.size(),
+			ref.size());
+	
+	uint64_t n = 0;
+	auto r = ref.begin();
+	AdaptiveRadixTreeFile::Cursor cursor(&tree);
+	for(bool valid=cursor.first(); valid; valid=cursor.next(), ++r, ++n) {
+		if(r == ref.end() || cursor.integer() != r->first ||
+				cursor.value() != r->second) {
+			CHECK(false, "%s iteration differs at %lu", name, n);
+			break;
+		}
+	}
+	CHECK(n == ref.size(), "%s iterated %lu of %lu", name, n, ref.size());
+	
+	std::vector<uint64_t> keys;
+	for(auto& it : ref)
+		keys.push_back(it.first);
+	for(uint64_t i=0; i<10000 && keys.size(); ++i) {
+		const uint64_t k = keys[Rand64()%keys.size()] + (Rand64()%5) - 2;
+		uint64_t value;
+		auto it = ref.find(k);
+		bool found = tree.find(k, value);
+		CHECK(found == (it!=ref.end()) && (!found || value==it->second),
+				"%s find(%lu)", name, k);
+		auto ge = ref.lower_bound(k);
+		found = cursor.seek(k);
+		CHECK(found == (ge!=ref.end()) && (!found || cursor.integer()==ge->first),
+				"%s seek(%lu)", name, k);
+	}
+}
+
+void Verify(const char* name, AdaptiveRadixTreeFile& tree,
+		const std::map<std::string, uint64_t>& ref) {
+	CHECK(tree.size() == ref.size(), "%s size %lu != %lu", name, tree.size(),
+			ref.size());
+	
+	uint64_t n = 0;
+	auto r = ref.begin();
+	AdaptiveRadixTreeFile::Cursor cursor(&tree);
+	for(bool valid=cursor.first(); valid; valid=cursor.next(), ++r, ++n) {
+		if(r == ref.end() || Key(cursor) != r->first ||
+				cursor.value() != r->second) {
+			CHECK(false, "%s iteration differs at %lu", name, n);
+			break;
+		}
+	}
+	CHECK(n == ref.size(), "%s iterated %lu of %lu", name, n, ref.size());
+	
+	for(uint64_t i=0; i<3000; ++i) {
+		std::string k;
+		for(uint64_t l=Rand64()%8; l; --l)
+			k += "abc"[Rand64()%3];
+		uint64_t value;
+		auto it = ref.find(k);
+		bool found = tree.find(k.data(), k.size(), value);
+		CHECK(found == (it!=ref.end()) && (!found || value==it->second),
+				"%s find(%s)", name, k.c_str());
+		auto ge = ref.lower_bound(k);
+		found = cursor.seek(k.data(), k.size());
+		CHECK(found == (ge!=ref.end()) && (!found || Key(cursor)==ge->first),
+				"%s seek(%s)", name, k.c_str());
+		
+		std::vector<std::string> expected, scanned;
+		for(; ge!=ref.end() && ge->first.compare(0, k.size(), k)==0; ++ge)
+			expected.push_back(ge->first);
+		tree.scan_prefix(k.data(), k.size(), [&](auto& c) {
+					scanned.push_back(Key(c));
+				});
+		CHECK(expected == scanned, "%s scan_prefix(%s) %lu != %lu", name,
+				k.c_str(), scanned.size(), expected.size());
+		
+		const std::string max = k + "b";
+		expected.clear();
+		scanned.clear();
+		for(auto it=ref.lower_bound(k); it!=ref.upper_bound(max); ++it)
+			expected.push_back(it->first);
+		tree.scan_range(k.data(), k.size(), max.data(), max.size(),
+				[&](auto& c) {scanned.push_back(Key(c));});
+		CHECK(expected == scanned, "%s scan_range(%s)", name, k.c_str());
+	}
+}
+
+void TestIntegers() {
+	const char* base = "art_integers";
+	MultiBlockAllocator::RemoveFiles(base);
+	std::map<uint64_t, uint64_t> ref;
+	uint64_t header;
+	{
+		MultiBlockAllocator allocator(base);
+		AdaptiveRadixTreeFile tree(&allocator);
+		tree.InitNewTree();
+		header = tree.GetTreeManagerNode();
+		for(uint64_t i=0; i<testValues; ++i) {
+			// dense, sparse and clustered keys stress all node types
+			uint64_t k;
+			switch(i % 3) {
+				case 0: k = Rand64() % (testValues*2); break;
+				case 1: k = Rand64(); break;
+				default: k = (Rand64() & 0xFFFF000000000000llu) | (Rand64()&0xFF);
+			}
+			const uint64_t v = Rand64();
+			CHECK(tree.insert(k, v) == ref.emplace(k, v).second, "insert(%lu)", k);
+		}
+		Verify("integers", tree, ref);
+		
+		std::vector<uint64_t> keys;
+		for(auto& it : ref)
+			keys.push_back(it.first);
+		for(uint64_t i=0; i<keys.size(); ++i) {
+			if(i%3 == 0)
+				continue;
+			CHECK(tree.erase(keys[i]), "erase(%lu)", keys[i]);
+			ref.erase(keys[i]);
+		}
+		CHECK(!tree.erase(keys[1]), "erased missing key");
+		Verify("integers erased", tree, ref);
+	}
+	{
+		MultiBlockAllocator allocator(base);
+		AdaptiveRadixTreeFile tree(header, &allocator);
+		Verify("integers reopened", tree, ref);
+		for(auto& it : ref)
+			CHECK(tree.erase(it.first), "erase(%lu)", it.first);
+		CHECK(tree.size() == 0 && !AdaptiveRadixTreeFile::Cursor(&tree).first(),
+				"erased tree is not empty");
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles(base);
+}
+
+void TestStrings() {
+	const char* base = "art_strings";
+	MultiBlockAllocator::RemoveFiles(base);
+	MultiBlockAllocator allocator(base);
+	AdaptiveRadixTreeFile tree(&allocator);
+	tree.InitNewTree();
+	std::map<std::string, uint64_t> ref;
+	
+	// short keys from small alphabet are often prefixes of each other, long
+	// keys share long prefixes
+	for(uint64_t i=0; i<testValues; ++i) {
+		std::string k;
+		if(i % 4 == 0) {
+			k = "common/long/prefix/" + std::to_string(Rand64()%100000);
+		} else {
+			for(uint64_t l=Rand64()%10; l; --l)
+				k += "abc"[Rand64()%3];
+		}
+		const uint64_t v = Rand64();
+		CHECK(tree.insert(k.data(), k.size(), v) == ref.emplace(k, v).second,
+				"insert(%s)", k.c_str());
+	}
+	Verify("strings", tree, ref);
+	
+	std::vector<std::string> keys;
+	for(auto& it : ref)
+		keys.push_back(it.first);
+	for(uint64_t i=0; i<keys.size(); i+=2) {
+		CHECK(tree.erase(keys[i].data(), keys[i].size()), "erase(%s)",
+				keys[i].c_str());
+		ref.erase(keys[i]);
+	}
+	Verify("strings erased", tree, ref);
+	tree.DestroyTree();
+	MultiBlockAllocator::RemoveFiles(base);
+}
+
+void Benchmark() {
+	std::vector<uint64_t> keys(benchmarkValues);
+	for(uint64_t& k : keys)
+		k = Rand64();
+	
+	const char* base = "art_bench";
+	MultiBlockAllocator::RemoveFiles(base);
+	{
+		MultiBlockAllocator allocator(base);
+		AdaptiveRadixTreeFile tree(&allocator);
+		tree.InitNewTree();
+		Start();
+		for(uint64_t k : keys)
+			tree.insert(k, k);
+		End();
+		printf("\n\n AdaptiveRadixTreeFile: %10.0f inserts/s",
+				keys.size()/DeltaTime());
+		uint64_t sum = 0, value;
+		Start();
+		for(uint64_t k : keys)
+			sum += tree.find(k, value);
+		End();
+		printf("\n AdaptiveRadixTreeFile: %10.0f finds/s", keys.size()/DeltaTime());
+		CHECK(sum == keys.size(), "benchmark found %lu", sum);
+		
+		uint64_t scanned = 0;
+		Start();
+		for(uint64_t i=0; i<65536; ++i)
+			scanned += tree.scan_prefix(&i, 2, [](auto&) {});
+		End();
+		printf("\n AdaptiveRadixTreeFile: %10.0f keys/s in 2 byte prefix scans",
+				scanned/DeltaTime());
+		CHECK(scanned == keys.size(), "prefix scans visited %lu", scanned);
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles(base);
+	
+	{
+		TreeSetFile::AllocatorType allocator("art_bench_tree_mem.raw",
+				"art_bench_tree_heap.raw");
+		TreeSetFile set(&allocator);
+		set.InitNewTree();
+		Start();
+		for(uint64_t k : keys)
+			set.insert(k);
+		End();
+		printf("\n TreeSetFile:           %10.0f inserts/s", keys.size()/DeltaTime());
+		uint64_t sum = 0;
+		Start();
+		for(uint64_t k : keys)
+			sum += (bool)set.find(k);
+		End();
+		printf("\n TreeSetFile:           %10.0f finds/s", keys.size()/DeltaTime());
+		CHECK(sum == keys.size(), "benchmark found %lu", sum);
+		set.DestroyTree();
+	}
+	std::remove("art_bench_tree_mem.raw");
+	std::remove("art_bench_tree_heap.raw");
+}
+
+int main() {
+	try {
+		TestIntegers();
+		TestStrings();
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
+
@@ -0,0 +1,191 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "Arena.hpp"
+#include "LinearAllocator.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <set>
+#include <vector>
+
+std::set<uint64_t> stdSet;
+
+uint64_t TestArena() {
+	uint64_t invalid = 0;
+	Arena arena(4096);
+	std::set<std::pair<uint64_t, uint64_t>> ranges;
+	for(uint64_t i=0; i<10000; ++i) {
+		uint64_t bytes = Rand64()%(i%100 ? 100 : 10000) + 1;
+		uint64_t alignment = 1llu << (Rand64()%7);
+		uint64_t ptr = (uint64_t)arena.allocate(bytes, alignment);
+		if(ptr % alignment)
+			++invalid;
+		auto it = ranges.lower_bound({ptr, 0});
+		if(it != ranges.end() && it->first < ptr+bytes)
+			++invalid;
+		if(it != ranges.begin() && (--it)->second > ptr)
+			++invalid;
+		ranges.insert({ptr, ptr+bytes});
+	}
+	
+	uint64_t used = arena.used(), reserved = arena.reserved();
+	{
+		Arena::Scope scope(arena);
+		std::pmr::vector<uint64_t> vec(&scope.arena);
+		for(uint64_t i=0; i<100000; ++i)
+			vec.emplace_back(i);
+		for(uint64_t i=0; i<100000; ++i)
+			if(vec[i] != i)
+				++invalid;
+	}
+	if(arena.used() != used)
+		++invalid;
+	reserved = arena.reserved();
+	{
+		// kept chunks are reused
+		Arena::Scope scope(arena);
+		std::pmr::vector<uint64_t> vec(&scope.arena);
+		for(uint64_t i=0; i<100000; ++i)
+			vec.emplace_back(i);
+	}
+	if(arena.reserved() != reserved)
+		++invalid;
+	arena.Reset();
+	if(arena.used() != 0)
+		++invalid;
+	arena.Release();
+	if(arena.reserved() != 0)
+		++invalid;
+	return invalid;
+}
+
+uint64_t TestQueries(TreeSetFile& set, LinearAllocator& linear) {
+	uint64_t invalid = 0;
+	for(uint64_t i=0; i<100000; ++i) {
+		uint64_t v = Rand64()%1000000;
+		stdSet.insert(v);
+		set.insert(v);
+	}
+	for(uint64_t i=0; i<1000; ++i) {
+		Arena::Scope scope;
+		uint64_t min = Rand64()%1000000, max = min + Rand64()%10000;
+		auto result = set.range(min, max, &scope.arena);
+		std::vector<uint64_t> expected(stdSet.lower_bound(min),
+				stdSet.upper_bound(max));
+		if(!std::equal(result.begin(), result.end(), expected.begin(),
+					expected.end()))
+			++invalid;
+	}
+	
+	std::set<uint64_t> pointers;
+	for(uint64_t i=0; i<1000; ++i)
+		pointers.insert(linear.Allocate(Rand64()%1000 + 1));
+	for(uint64_t i=0; i<300; ++i) {
+		auto it = pointers.lower_bound(Rand64()%linear.reserved());
+		if(it != pointers.end()) {
+			linear.Free(*it);
+			pointers.erase(it);
+		}
+	}
+	Arena::Scope scope;
+	auto result = linear.allocations(&scope.arena);
+	if(!std::equal(result.begin(), result.end(), pointers.begin(),
+				pointers.end()))
+		++invalid;
+	return invalid;
+}
+
+void Benchmark(TreeSetFile& set, uint64_t requests) {
+	uint64_t sum = 0;
+	std::vector<uint64_t> mins(requests);
+	for(auto& v : mins)
+		v = Rand64()%1000000;
+	
+	Start();
+	for(uint64_t i=0; i<requests; ++i) {
+		auto result = set.range(mins[i], mins[i]+1000);
+		sum += result.size();
+	}
+	End();
+	double time = DeltaTime();
+	printf("\n range() with default resource %10.0f requests/s", requests/time);
+	Start();
+	for(uint64_t i=0; i<requests; ++i) {
+		Arena::Scope scope;
+		auto result = set.range(mins[i], mins[i]+1000, &scope.arena);
+		sum += result.size();
+	}
+	End();
+	printf("\n range() with Arena::Scope     %10.0f requests/s (%.2fx)",
+			requests/DeltaTime(), time/DeltaTime());
+	
+	std::vector<uint64_t> sizes(requests*16);
+	for(auto& v : sizes)
+		v = Rand64()%256 + 8;
+	Start();
+	for(uint64_t i=0; i<requests; ++i) {
+		void* ptrs[16];
+		for(uint64_t j=0; j<16; ++j)
+			ptrs[j] = std::pmr::get_default_resource()->allocate(sizes[i*16+j]);
+		for(uint64_t j=0; j<16; ++j)
+			std::pmr::get_default_resource()->deallocate(ptrs[j], sizes[i*16+j]);
+		sum += (uint64_t)ptrs[i&15];
+	}
+	End();
+	time = DeltaTime();
+	printf("\n 16 allocations with new/delete %10.0f requests/s", requests/time);
+	Start();
+	for(uint64_t i=0; i<requests; ++i) {
+		void* ptrs[16];
+		Arena::Scope scope;
+		for(uint64_t j=0; j<16; ++j)
+			ptrs[j] = scope.arena.allocate(sizes[i*16+j]);
+		sum += (uint64_t)ptrs[i&15];
+	}
+	End();
+	printf("\n 16 allocations with Arena     %10.0f requests/s (%.2fx)",
+			requests/DeltaTime(), time/DeltaTime());
+	printf("\n sum = %lu", sum&1);
+}
+
+int main() {
+	try {
+		BlockAllocator<32> ballocator("32byte_block_mem.raw", "32byte_heap.raw");
+		TreeSetFile fileSet(&ballocator), ranges(&ballocator);
+		fileSet.InitNewTree();
+		ranges.InitNewTree();
+		LinearAllocator linear("linear_memory.raw", ranges);
+		
+		uint64_t invalid = TestArena() + TestQueries(fileSet, linear);
+		if(invalid)
+			printf("\n invalid: %lu ... FAULT\n", invalid);
+		else
+			printf("\n arena ... OK\n");
+		Benchmark(fileSet, 100000);
+		
+		fileSet.DestroyTree();
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
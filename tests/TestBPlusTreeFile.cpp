@@ -0,0 +1,233 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "BPlusTreeFile.hpp"
+#include "AdaptiveRadixTreeFile.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <string>
+
+#include <map>
+#include <vector>
+
+const uint64_t testValues = 200000;
+const uint64_t benchmarkValues = 1000000;
+
+// short keys over small alphabet with zero byte are often prefixes of each
+// other, long keys share prefixes longer than inline limit
+std::string RandomKey() {
+	std::string key;
+	switch(Rand64() % 4) {
+		case 0:
+			for(uint64_t l=Rand64()%10; l; --l)
+				key += "a\0b"[Rand64()%3];
+			break;
+		case 1:
+			key = "tenant/" + std::to_string(Rand64()%100) + "/user/" +
+				std::to_string(Rand64()%100000);
+			break;
+		case 2:
+			key = std::string(300, 'x') + std::to_string(Rand64()%10000);
+			break;
+		default:
+			for(uint64_t l=Rand64()%2000; l; --l)
+				key += 'a' + Rand64()%26;
+	}
+	return key;
+}
+
+void Verify(const char* name, BPlusTreeFile& tree,
+		const std::map<std::string, uint64_t>& ref) {
+	CHECK(tree.size() == ref.size(), "%s size %lu != %lu", name, tree.size(),
+			ref.size());
+	
+	uint64_t n = 0;
+	auto r = ref.begin();
+	BPlusTreeFile::Cursor cursor(&tree);
+	for(bool valid=cursor.first(); valid; valid=cursor.next(), ++r, ++n) {
+		if(r == ref.end() || cursor.key() != r->first ||
+				cursor.value() != r->second) {
+			CHECK(false, "%s iteration differs at %lu", name, n);
+			break;
+		}
+	}
+	CHECK(n == ref.size(), "%s iterated %lu of %lu", name, n, ref.size());
+	
+	std::vector<std::string> keys;
+	for(auto& it : ref)
+		keys.push_back(it.first);
+	for(uint64_t i=0; i<10000; ++i) {
+		std::string k = i%2 || keys.empty() ? RandomKey() :
+			keys[Rand64()%keys.size()];
+		if(i%3 == 0 && k.size())
+			k.pop_back();
+		uint64_t value;
+		auto it = ref.find(k);
+		bool found = tree.find(k, value);
+		CHECK(found == (it!=ref.end()) && (!found || value==it->second),
+				"%s find(%s)", name, k.c_str());
+		auto ge = ref.lower_bound(k);
+		found = cursor.seek(k.data(), k.size());
+		CHECK(found == (ge!=ref.end()) && (!found || cursor.key()==ge->first),
+				"%s seek(%s)", name, k.c_str());
+	}
+}
+
+void Test() {
+	const char* base = "bplus";
+	MultiBlockAllocator::RemoveFiles(base);
+	std::map<std::string, uint64_t> ref;
+	uint64_t header;
+	{
+		MultiBlockAllocator allocator(base);
+		BPlusTreeFile tree(&allocator);
+		tree.InitNewTree();
+		header = tree.GetTreeManagerNode();
+		for(uint64_t i=0; i<testValues; ++i) {
+			const std::string k = RandomKey();
+			const uint64_t v = Rand64();
+			CHECK(tree.insert(k, v) == ref.emplace(k, v).second, "insert(%s)",
+					k.c_str());
+		}
+		printf("\n %lu keys, height: %lu", tree.size(), tree.height());
+		Verify("inserted", tree, ref);
+		
+		std::vector<std::string> keys;
+		for(auto& it : ref)
+			keys.push_back(it.first);
+		for(uint64_t i=0; i<keys.size(); i+=2) {
+			CHECK(tree.erase(keys[i]), "erase(%s)", keys[i].c_str());
+			ref.erase(keys[i]);
+		}
+		CHECK(!tree.erase(keys[0]), "erased missing key");
+		Verify("erased", tree, ref);
+		
+		// inserts into pages with erased keys reuse their space
+		for(uint64_t i=0; i<testValues/2; ++i) {
+			const std::string k = RandomKey();
+			const uint64_t v = Rand64();
+			CHECK(tree.insert(k, v) == ref.emplace(k, v).second, "insert(%s)",
+					k.c_str());
+		}
+		Verify("reinserted", tree, ref);
+	}
+	{
+		MultiBlockAllocator allocator(base);
+		BPlusTreeFile tree(header, &allocator);
+		Verify("reopened", tree, ref);
+		for(auto& it : ref)
+			CHECK(tree.erase(it.first), "erase(%s)", it.first.c_str());
+		CHECK(tree.size() == 0 && !BPlusTreeFile::Cursor(&tree).first(),
+				"erased tree is not empty");
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles(base);
+}
+
+// keys below page prefix are routed to slot 0 of a leaf sharing only part of
+// that prefix, lookups must not match them by suffix alone
+void TestPrefix() {
+	const char* base = "bplus_prefix";
+	MultiBlockAllocator::RemoveFiles(base);
+	{
+		MultiBlockAllocator allocator(base);
+		BPlusTreeFile tree(&allocator);
+		tree.InitNewTree();
+		char key[64];
+		for(uint64_t i=0; i<5000; ++i) {
+			sprintf(key, "tenant/1/user/%06lu", i);
+			CHECK(tree.insert(key, i), "insert(%s)", key);
+		}
+		for(uint64_t i=0; i<5000; ++i) {
+			uint64_t value;
+			sprintf(key, "tenant/0/user/%06lu", i);
+			CHECK(!tree.find(key, value), "found %s", key);
+			CHECK(!tree.erase(key), "erased %s", key);
+			sprintf(key, "tenant/2/user/%06lu", i);
+			CHECK(!tree.find(key, value), "found %s", key);
+		}
+		CHECK(tree.size() == 5000, "size %lu != 5000", tree.size());
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles(base);
+}
+
+template<typename Tree>
+void Benchmark(const char* name, Tree& tree, const std::vector<std::string>& keys) {
+	Start();
+	for(uint64_t i=0; i<keys.size(); ++i)
+		tree.insert(keys[i].data(), keys[i].size(), i);
+	End();
+	printf("\n %-22s %10.0f inserts/s", name, keys.size()/DeltaTime());
+	uint64_t found = 0, value;
+	Start();
+	for(const std::string& k : keys)
+		found += tree.find(k.data(), k.size(), value);
+	End();
+	printf("\n %-22s %10.0f finds/s", name, keys.size()/DeltaTime());
+	CHECK(found == keys.size(), "%s found %lu", name, found);
+}
+
+void Benchmark() {
+	std::vector<std::string> keys(benchmarkValues);
+	char buffer[64];
+	for(std::string& k : keys) {
+		sprintf(buffer, "user/%016lx/profile", Rand64());
+		k = buffer;
+	}
+	printf("\n\n %lu keys like %s", keys.size(), keys[0].c_str());
+	
+	MultiBlockAllocator::RemoveFiles("bplus_bench");
+	{
+		MultiBlockAllocator allocator("bplus_bench");
+		BPlusTreeFile tree(&allocator);
+		tree.InitNewTree();
+		Benchmark("BPlusTreeFile:", tree, keys);
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles("bplus_bench");
+	{
+		MultiBlockAllocator allocator("bplus_bench");
+		AdaptiveRadixTreeFile tree(&allocator);
+		tree.InitNewTree();
+		Benchmark("AdaptiveRadixTreeFile:", tree, keys);
+		tree.DestroyTree();
+	}
+	MultiBlockAllocator::RemoveFiles("bplus_bench");
+}
+
+int main() {
+	try {
+		Test();
+		TestPrefix();
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
+
@@ -30,6 +30,12 @@
 
 std::map<uint64_t, int64_t> allocated, full;
 
+static_assert(BlockAllocator<1>::blockSize == 8);
+static_assert(BlockAllocator<24>::blockSize == 32);
+static_assert(BlockAllocator<40>::blockSize == 64);
+static_assert(BlockAllocator<24, true>::blockSize == 24);
+static_assert(BlockAllocator<36, true>::blockSize == 40);
+
 template<typename T>
 bool GetRandomAllocated(T& allocator, uint64_t& ptr) {
 	if(allocated.size() == 0)
@@ -0,0 +1,203 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "FilteredSet.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+const uint64_t filterKeys = 100000;
+const uint64_t setValues = 1000000;
+
+std::vector<uint64_t> RandomValues(uint64_t count) {
+	std::vector<uint64_t> values(count);
+	for(uint64_t& v : values)
+		v = Rand64();
+	return values;
+}
+
+void TestFilter() {
+	std::remove("bloom.raw");
+	std::vector<uint64_t> keys = RandomValues(filterKeys);
+	{
+		BloomFilterFile filter("bloom.raw", filterKeys);
+		filter.insert_many(keys.data(), keys.size()/2);
+		for(uint64_t i=keys.size()/2; i<keys.size(); ++i)
+			filter.insert(keys[i]);
+		CHECK(filter.Keys() == filterKeys, "keys %lu", filter.Keys());
+	}
+	
+	BloomFilterFile filter("bloom.raw");
+	for(uint64_t key : keys)
+		CHECK(filter.may_contain(key), "false negative %lu", key);
+	
+	std::vector<uint64_t> absent = RandomValues(1000000);
+	std::vector<uint8_t> batch(absent.size());
+	filter.may_contain_many(absent.data(), (bool*)batch.data(), absent.size());
+	uint64_t positives = 0;
+	for(uint64_t i=0; i<absent.size(); ++i) {
+		const bool single = filter.may_contain(absent[i]);
+		CHECK(single == (bool)batch[i], "may_contain_many differs at %lu", i);
+		positives += single;
+	}
+	const double rate = (double)positives / absent.size();
+	printf("\n %lu keys in %lu blocks, false positive rate: %.4f%%"
+			" (expected %.4f%%)", filter.Keys(), filter.Blocks(), rate*100,
+			filter.FalsePositiveRate()*100);
+	CHECK(rate < filter.FalsePositiveRate()*1.3 + 0.0005,
+			"false positive rate %f", rate);
+	
+	filter.Reset(10);
+	CHECK(filter.Keys() == 0 && !filter.may_contain(keys[0]), "Reset");
+	filter.Close();
+	std::remove("bloom.raw");
+}
+
+void TestFilteredSet() {
+	RemoveFiles("bloom_set", {".raw", "_mem.raw", "_heap.raw"});
+	std::set<uint64_t> ref;
+	uint64_t rebuilds = 0;
+	{
+		TreeSetFile::AllocatorType allocator("bloom_set_mem.raw",
+				"bloom_set_heap.raw");
+		TreeSetFile tree(&allocator);
+		tree.InitNewTree();
+		BloomFilterFile filter("bloom_set.raw", 16);
+		FilteredSet set(tree, &filter);
+		uint64_t blocks = filter.Blocks();
+		for(uint64_t i=0; i<200000; ++i) {
+			const uint64_t v = Rand64() % 100000;
+			if(Rand64() % 3) {
+				set.insert(v);
+				ref.insert(v);
+			} else {
+				set.erase(v);
+				ref.erase(v);
+			}
+			if(filter.Blocks() != blocks || filter.Stale() == 0) {
+				rebuilds += filter.Blocks() != blocks;
+				blocks = filter.Blocks();
+			}
+		}
+		CHECK(set.size() == ref.size(), "size %lu != %lu", set.size(), ref.size());
+		
+		std::vector<uint64_t> queries(100000);
+		for(uint64_t& q : queries)
+			q = Rand64() % 120000;
+		std::vector<uint8_t> found(queries.size());
+		set.contains_many(queries.data(), (bool*)found.data(), queries.size());
+		for(uint64_t i=0; i<queries.size(); ++i) {
+			const bool expected = ref.count(queries[i]);
+			CHECK(set.contains(queries[i]) == expected, "contains(%lu)",
+					queries[i]);
+			CHECK((bool)found[i] == expected, "contains_many(%lu)", queries[i]);
+		}
+		printf("\n FilteredSet: %lu values, filter resized %lu times,"
+				" stale keys %lu", set.size(), rebuilds, filter.Stale());
+		CHECK(set.FilteredLookups() > 0, "filter never answered");
+		
+		// lost filter file is rebuilt from tree
+		filter.Close();
+		std::remove("bloom_set.raw");
+		BloomFilterFile fresh("bloom_set.raw");
+		FilteredSet reopened(tree, &fresh);
+		for(uint64_t v : ref)
+			CHECK(reopened.contains(v), "rebuilt filter misses %lu", v);
+		tree.DestroyTree();
+	}
+	RemoveFiles("bloom_set", {".raw", "_mem.raw", "_heap.raw"});
+}
+
+void Benchmark() {
+	RemoveFiles("bloom_bench", {".raw", "_mem.raw", "_heap.raw"});
+	TreeSetFile::AllocatorType allocator("bloom_bench_mem.raw",
+			"bloom_bench_heap.raw");
+	TreeSetFile tree(&allocator);
+	tree.InitNewTree();
+	std::vector<uint64_t> values = RandomValues(setValues);
+	for(uint64_t v : values)
+		tree.insert(v);
+	BloomFilterFile filter("bloom_bench.raw");
+	FilteredSet set(tree, &filter);
+	
+	std::vector<uint64_t> absent = RandomValues(setValues);
+	std::vector<uint8_t> found(setValues);
+	uint64_t hits = 0;
+	
+	printf("\n\n %lu values, filter %lu KiB:", setValues,
+			filter.Blocks()*BloomFilterFile::blockSize/1024);
+	Start();
+	for(uint64_t v : absent)
+		hits += (bool)tree.find(v);
+	End();
+	printf("\n TreeSetFile::find          negative %7.1f ns/lookup",
+			DeltaTime()*1e9/setValues);
+	Start();
+	for(uint64_t v : absent)
+		hits += set.contains(v);
+	End();
+	printf("\n FilteredSet::contains      negative %7.1f ns/lookup",
+			DeltaTime()*1e9/setValues);
+	Start();
+	set.contains_many(absent.data(), (bool*)found.data(), absent.size());
+	End();
+	printf("\n FilteredSet::contains_many negative %7.1f ns/lookup",
+			DeltaTime()*1e9/setValues);
+	
+	Start();
+	for(uint64_t v : values)
+		hits += (bool)tree.find(v);
+	End();
+	printf("\n TreeSetFile::find          positive %7.1f ns/lookup",
+			DeltaTime()*1e9/setValues);
+	Start();
+	for(uint64_t v : values)
+		hits += set.contains(v);
+	End();
+	printf("\n FilteredSet::contains      positive %7.1f ns/lookup",
+			DeltaTime()*1e9/setValues);
+	if(hits == 0)
+		printf(" ");
+	
+	tree.DestroyTree();
+	filter.Close();
+	RemoveFiles("bloom_bench", {".raw", "_mem.raw", "_heap.raw"});
+}
+
+int main() {
+	try {
+		TestFilter();
+		TestFilteredSet();
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "ConcurrentHashMapFile.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+const uint64_t stableKeys = 50000;
+const uint64_t stableOffset = 1llu << 40;
+const uint64_t benchmarkKeys = 1000000;
+
+std::atomic<bool> stop;
+
+inline uint64_t Next(uint64_t& seed) {
+	seed = seed*6364136223846793005llu + 1442695040888963407llu;
+	return seed >> 16;
+}
+
+void Verify(ConcurrentHashMapFile& map,
+		const std::unordered_map<uint64_t, uint64_t>& ref, uint64_t range) {
+	CHECK(map.size() == ref.size(), "size %lu != %lu", map.size(), ref.size());
+	for(uint64_t key=0; key<range; ++key) {
+		uint64_t value;
+		auto it = ref.find(key);
+		bool found = map.get(key, value);
+		CHECK(found == (it!=ref.end()) && (!found || value==it->second),
+				"get(%lu)", key);
+	}
+}
+
+void TestSingleThread(hash::Function function) {
+	std::remove("hash_map.raw");
+	const uint64_t range = 100000;
+	std::unordered_map<uint64_t, uint64_t> ref;
+	{
+		ConcurrentHashMapFile map("hash_map.raw", function);
+		uint64_t seed = 1;
+		for(uint64_t i=0; i<range*3; ++i) {
+			const uint64_t key = Next(seed) % range;
+			if(Next(seed) % 4) {
+				const bool inserted = ref.find(key) == ref.end();
+				CHECK(map.put(key, i) == inserted, "put(%lu)", key);
+				ref[key] = i;
+			} else {
+				CHECK(map.erase(key) == (ref.erase(key)==1), "erase(%lu)", key);
+			}
+		}
+		Verify(map, ref, range);
+		printf("\n single thread: %lu entries, capacity %lu", map.size(),
+				map.capacity());
+	}
+	// stored hash function is used regardless of argument
+	ConcurrentHashMapFile map("hash_map.raw",
+			function==hash::HASH64 ? hash::FNV1A64 : hash::HASH64);
+	CHECK(map.GetHashFunction() == function, "hash function not stored");
+	Verify(map, ref, range);
+	map.Close();
+	std::remove("hash_map.raw");
+}
+
+// sliding window of live keys, overflow marks left by erased keys must not
+// accumulate until every probe walks whole table
+void TestChurn() {
+	std::remove("hash_map.raw");
+	const uint64_t window = 40000, operations = 2000000;
+	{
+		ConcurrentHashMapFile map("hash_map.raw");
+		for(uint64_t key=0; key<window; ++key)
+			map.put(key, key);
+		const uint64_t capacity = map.capacity();
+		uint64_t maxOverflowed = 0;
+		for(uint64_t key=window; key<operations; ++key) {
+			CHECK(map.erase(key-window), "erase(%lu)", key-window);
+			CHECK(map.put(key, key), "put(%lu)", key);
+			maxOverflowed = std::max(maxOverflowed, map.overflowed());
+		}
+		std::unordered_map<uint64_t, uint64_t> ref;
+		for(uint64_t key=operations-window; key<operations; ++key)
+			ref[key] = key;
+		Verify(map, ref, operations);
+		CHECK(map.capacity() == capacity, "capacity %lu != %lu",
+				map.capacity(), capacity);
+		CHECK(maxOverflowed <= capacity/3*3/4, "%lu of %lu groups overflowed",
+				maxOverflowed, capacity/3);
+		printf("\n churn: %lu entries, capacity %lu, overflowed groups "
+				"%lu (max %lu)", map.size(), map.capacity(), map.overflowed(),
+				maxOverflowed);
+	}
+	std::remove("hash_map.raw");
+}
+
+// EMPTY key matches free slots, it must be rejected instead of stored
+void TestEmptyKey() {
+	std::remove("hash_map.raw");
+	{
+		ConcurrentHashMapFile map("hash_map.raw");
+		for(uint64_t key=0; key<100; ++key)
+			map.put(key, key);
+		uint64_t value = 0;
+		CHECK(!map.get(ConcurrentHashMapFile::EMPTY, value), "get(EMPTY)");
+		CHECK(!map.erase(ConcurrentHashMapFile::EMPTY), "erase(EMPTY)");
+		bool thrown = false;
+		try {
+			map.put(ConcurrentHashMapFile::EMPTY, 1);
+		} catch(std::runtime_error&) {
+			thrown = true;
+		}
+		CHECK(thrown, "put(EMPTY) not rejected");
+		CHECK(map.size() == 100, "size %lu after EMPTY key", map.size());
+		printf("\n EMPTY key: %lu entries", map.size());
+	}
+	std::remove("hash_map.raw");
+}
+
+// thread t owns keys equal t modulo threads, stable keys must stay visible
+// with their values while table is resized
+void TestConcurrent(uint64_t threads) {
+	std::remove("hash_map.raw");
+	ConcurrentHashMapFile map("hash_map.raw");
+	for(uint64_t i=0; i<stableKeys; ++i)
+		map.put(stableOffset+i, i*3);
+	
+	const uint64_t range = 400000;
+	std::vector<std::unordered_map<uint64_t, uint64_t>> refs(threads);
+	std::vector<std::thread> workers;
+	stop = false;
+	for(uint64_t t=0; t<threads; ++t) {
+		workers.emplace_back([&, t]() {
+				uint64_t seed = t+1;
+				auto& ref = refs[t];
+				for(uint64_t i=0; i<range/threads*2; ++i) {
+					const uint64_t key = (Next(seed) % (range/threads))*threads + t;
+					if(Next(seed) % 3) {
+						map.put(key, key+i);
+						ref[key] = key+i;
+					} else {
+						map.erase(key);
+						ref.erase(key);
+					}
+				}
+			});
+	}
+	std::thread reader([&]() {
+			uint64_t seed = 12345;
+			while(!stop.load(std::memory_order_relaxed)) {
+				const uint64_t i = Next(seed) % stableKeys;
+				uint64_t value;
+				CHECK(map.get(stableOffset+i, value) && value==i*3,
+						"stable key %lu lost", i);
+			}
+		});
+	for(auto& w : workers)
+		w.join();
+	stop = true;
+	reader.join();
+	
+	std::unordered_map<uint64_t, uint64_t> ref;
+	for(uint64_t i=0; i<stableKeys; ++i)
+		ref[stableOffset+i] = i*3;
+	for(auto& r : refs)
+		ref.insert(r.begin(), r.end());
+	Verify(map, ref, range);
+	printf("\n %lu writers: %lu entries, capacity %lu", threads, map.size(),
+			map.capacity());
+	map.Close();
+	std::remove("hash_map.raw");
+}
+
+template<typename Get, typename Put, typename Erase>
+void Run(const char* name, uint64_t threads, uint64_t readPercent, Get get,
+		Put put, Erase erase) {
+	std::vector<uint64_t> operations(threads);
+	std::vector<std::thread> workers;
+	stop = false;
+	Start();
+	for(uint64_t t=0; t<threads; ++t) {
+		workers.emplace_back([&, t]() {
+				uint64_t seed = t*7919 + 1, ops = 0, value;
+				while(!stop.load(std::memory_order_relaxed)) {
+					const uint64_t r = Next(seed);
+					const uint64_t key = r % (benchmarkKeys*2);
+					if((r>>40) % 100 < readPercent)
+						get(key, value);
+					else if(r & (1llu<<62))
+						put(key, r);
+					else
+						erase(key);
+					++ops;
+				}
+				operations[t] = ops;
+			});
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	stop = true;
+	for(auto& w : workers)
+		w.join();
+	End();
+	uint64_t sum = 0;
+	for(uint64_t ops : operations)
+		sum += ops;
+	printf("\n %-28s %2lu%% reads  threads: %2lu %11.0f ops/s", name,
+			readPercent, threads, sum/DeltaTime());
+}
+
+void Benchmark() {
+	printf("\n\n hardware threads: %u", std::thread::hardware_concurrency());
+	std::remove("hash_map_bench.raw");
+	ConcurrentHashMapFile map("hash_map_bench.raw");
+	std::unordered_map<uint64_t, uint64_t> locked;
+	std::shared_mutex mutex;
+	uint64_t seed = 7;
+	for(uint64_t i=0; i<benchmarkKeys; ++i) {
+		const uint64_t key = Next(seed) % (benchmarkKeys*2);
+		map.put(key, i);
+		locked[key] = i;
+	}
+	for(uint64_t readPercent : {95, 50, 5}) {
+		for(uint64_t threads : {1, 2, 4, 8, 16, 32}) {
+			Run("ConcurrentHashMapFile", threads, readPercent,
+					[&](uint64_t key, uint64_t& value) {return map.get(key, value);},
+					[&](uint64_t key, uint64_t value) {map.put(key, value);},
+					[&](uint64_t key) {map.erase(key);});
+		}
+		for(uint64_t threads : {1, 8, 32}) {
+			Run("unordered_map+shared_mutex", threads, readPercent,
+					[&](uint64_t key, uint64_t& value) {
+						std::shared_lock lock(mutex);
+						auto it = locked.find(key);
+						if(it == locked.end())
+							return false;
+						value = it->second;
+						return true;
+					},
+					[&](uint64_t key, uint64_t value) {
+						std::unique_lock lock(mutex);
+						locked[key] = value;
+					},
+					[&](uint64_t key) {
+						std::unique_lock lock(mutex);
+						locked.erase(key);
+					});
+		}
+	}
+	map.Close();
+	std::remove("hash_map_bench.raw");
+}
+
+int main() {
+	try {
+		TestSingleThread(hash::FNV1A64);
+		TestSingleThread(hash::HASH64);
+		TestChurn();
+		TestEmptyKey();
+		TestConcurrent(1);
+		TestConcurrent(4);
+		TestConcurrent(16);
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "ConcurrentSkipList.hpp"
+#include "TreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+const uint64_t testValues = 200000;
+const uint64_t benchmarkValues = 1000000;
+const uint64_t stableStep = 1024;
+
+void Verify(const char* name, ConcurrentSkipList& list,
+		const std::set<uint64_t>& ref) {
+	CHECK(list.size() == ref.size(), "%s size %lu != %lu", name, list.size(),
+			ref.size());
+	std::pmr::vector<uint64_t> all = list.range(0, -1);
+	CHECK(std::equal(all.begin(), all.end(), ref.begin(), ref.end()),
+			"%s range differs", name);
+	
+	std::vector<uint64_t> values(ref.begin(), ref.end());
+	for(uint64_t i=0; i<10000 && values.size(); ++i) {
+		const uint64_t v = values[Rand64()%values.size()] + (Rand64()%5) - 2;
+		uint64_t result;
+		auto ge = ref.lower_bound(v);
+		bool found = list.find_ge(v, result);
+		CHECK(found == (ge!=ref.end()) && (!found || result==*ge),
+				"%s find_ge(%lu)", name, v);
+		auto le = ref.upper_bound(v);
+		found = list.find_le(v, result);
+		CHECK(found == (le!=ref.begin()) && (!found || result==*std::prev(le)),
+				"%s find_le(%lu)", name, v);
+		CHECK(list.find(v) == (ref.count(v)!=0), "%s find(%lu)", name, v);
+	}
+}
+
+void TestSequential() {
+	ConcurrentSkipList list;
+	std::set<uint64_t> ref;
+	uint64_t result;
+	CHECK(!list.find_ge(0, result) && !list.find_le(-1, result),
+			"found value in empty list");
+	for(uint64_t i=0; i<testValues; ++i) {
+		const uint64_t v = Rand64() % (testValues*2);
+		if(Rand64() % 3) {
+			CHECK(list.insert(v) == ref.insert(v).second, "insert(%lu)", v);
+		} else {
+			CHECK(list.erase(v) == (ref.erase(v)!=0), "erase(%lu)", v);
+		}
+	}
+	Verify("sequential", list, ref);
+	CHECK(list.insert(0) == ref.insert(0).second, "insert(0)");
+	CHECK(list.insert(-1) == ref.insert(-1).second, "insert(-1)");
+	Verify("bounds", list, ref);
+	for(uint64_t v : std::vector<uint64_t>(ref.begin(), ref.end()))
+		CHECK(list.erase(v), "erase(%lu)", v);
+	CHECK(list.size() == 0 && !list.find_ge(0, result), "erased list not empty");
+}
+
+/*
+ *  Every writer owns values equal to its index modulo writer count and
+ *  tracks them locally. Multiples of stableStep are never erased, readers
+ *  check they stay visible while everything around them changes.
+ */
+void TestConcurrent(uint64_t writers, uint64_t readers) {
+	ConcurrentSkipList list;
+	const uint64_t range = testValues*4;
+	for(uint64_t v=0; v<range; v+=stableStep)
+		list.insert(v);
+	
+	std::vector<std::set<uint64_t>> owned(writers);
+	std::atomic<bool> stop = false;
+	std::vector<std::thread> threads;
+	for(uint64_t t=0; t<writers; ++t)
+		threads.emplace_back([&, t]() {
+				uint64_t seed = t*0x9E3779B97F4A7C15llu + 1;
+				std::set<uint64_t>& own = owned[t];
+				for(uint64_t i=0; i<testValues/writers*2; ++i) {
+					seed = seed*6364136223846793005llu + 1442695040888963407llu;
+					uint64_t v = ((seed>>20) % (range/writers))*writers + t;
+					if(v % stableStep == 0)
+						continue;
+					if((seed>>8) % 3) {
+						CHECK(list.insert(v) == own.insert(v).second,
+								"concurrent insert(%lu)", v);
+					} else {
+						CHECK(list.erase(v) == (own.erase(v)!=0),
+								"concurrent erase(%lu)", v);
+					}
+				}
+			});
+	for(uint64_t t=0; t<readers; ++t)
+		threads.emplace_back([&]() {
+				while(!stop.load()) {
+					const uint64_t v = Rand64() % range;
+					const uint64_t stable = v / stableStep * stableStep;
+					uint64_t result;
+					CHECK(list.find(stable), "stable %lu not found", stable);
+					CHECK(list.find_le(v, result) && result >= stable &&
+							result <= v, "find_le(%lu) = %lu", v, result);
+					if(stable+stableStep < range)
+						CHECK(list.find_ge(v, result) && result >= v &&
+								result <= stable+stableStep,
+								"find_ge(%lu) = %lu", v, result);
+				}
+			});
+	for(uint64_t t=0; t<writers; ++t)
+		threads[t].join();
+	stop = true;
+	for(uint64_t t=writers; t<threads.size(); ++t)
+		threads[t].join();
+	
+	std::set<uint64_t> ref;
+	for(auto& own : owned)
+		ref.insert(own.begin(), own.end());
+	for(uint64_t v=0; v<range; v+=stableStep)
+		ref.insert(v);
+	Verify("concurrent", list, ref);
+}
+
+// thread t inserts count values from its own random sequence
+template<typename Insert>
+void Inserter(Insert insert, uint64_t t, uint64_t count) {
+	uint64_t seed = t*0x9E3779B97F4A7C15llu + 1;
+	for(uint64_t i=0; i<count; ++i) {
+		seed = seed*6364136223846793005llu + 1442695040888963407llu;
+		insert(seed ^ (seed>>31));
+	}
+}
+
+template<typename Insert>
+double InsertParallel(Insert insert, uint64_t threads, uint64_t count) {
+	std::vector<std::thread> workers;
+	Start();
+	for(uint64_t t=0; t<threads; ++t)
+		workers.emplace_back(Inserter<Insert>, insert, t, count/threads);
+	for(auto& w : workers)
+		w.join();
+	End();
+	return DeltaTime();
+}
+
+void Benchmark() {
+	printf("\n\n insert %lu random values, hardware threads: %u",
+			benchmarkValues, std::thread::hardware_concurrency());
+	for(uint64_t threads : {1, 2, 4, 8, 16}) {
+		{
+			ConcurrentSkipList list;
+			double t = InsertParallel([&list](uint64_t v) {list.insert(v);},
+					threads, benchmarkValues);
+			printf("\n ConcurrentSkipList       threads: %2lu %10.0f inserts/s",
+					threads, benchmarkValues/t);
+		}
+		{
+			TreeSetFile::AllocatorType allocator("skiplist_bench_mem.raw",
+					"skiplist_bench_heap.raw");
+			TreeSetFile set(&allocator);
+			set.InitNewTree();
+			std::mutex mutex;
+			double t = InsertParallel([&](uint64_t v) {
+						std::lock_guard lock(mutex);
+						set.insert(v);
+					}, threads, benchmarkValues);
+			printf("\n TreeSetFile with mutex   threads: %2lu %10.0f inserts/s",
+					threads, benchmarkValues/t);
+			set.DestroyTree();
+		}
+		std::remove("skiplist_bench_mem.raw");
+		std::remove("skiplist_bench_heap.raw");
+	}
+}
+
+int main() {
+	try {
+		TestSequential();
+		TestConcurrent(1, 1);
+		TestConcurrent(4, 2);
+		TestConcurrent(16, 4);
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
+
@@ -0,0 +1,199 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "ConcurrentTreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+const uint64_t stableValues = 200000;
+const uint64_t range = stableValues*2;
+
+std::atomic<bool> stop;
+std::atomic<uint64_t> invalid;
+
+// even values are never erased, odd values are inserted and erased by writer
+template<typename Insert, typename Erase>
+void Writer(Insert insert, Erase erase, uint64_t* operations) {
+	uint64_t ops = 0;
+	while(!stop.load(std::memory_order_relaxed)) {
+		uint64_t v = (Rand64()%stableValues)*2 + 1;
+		if(Rand64()%3)
+			insert(v);
+		else
+			erase(v);
+		++ops;
+	}
+	*operations = ops;
+}
+
+template<typename Find>
+void Reader(Find find, uint64_t* operations) {
+	uint64_t ops = 0, errors = 0;
+	uint64_t seed = Rand64();
+	while(!stop.load(std::memory_order_relaxed)) {
+		seed = seed*6364136223846793005llu + 1442695040888963407llu;
+		uint64_t v = (seed>>20) % (range-1);
+		uint64_t result;
+		if(v & 1) {
+			// nearest stable value bounds the result
+			if(!find(v, result) || result < v || result > v+1)
+				++errors;
+		} else if(!find(v, result) || result != v) {
+			++errors;
+		}
+		++ops;
+	}
+	invalid += errors;
+	*operations = ops;
+}
+
+template<typename Find, typename Insert, typename Erase>
+void Run(const char* name, uint64_t readers, Find find, Insert insert,
+		Erase erase) {
+	std::vector<uint64_t> operations(readers+1);
+	std::vector<std::thread> threads;
+	stop = false;
+	Start();
+	threads.emplace_back(Writer<Insert, Erase>, insert, erase,
+			&operations[readers]);
+	for(uint64_t i=0; i<readers; ++i)
+		threads.emplace_back(Reader<Find>, find, &operations[i]);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+	stop = true;
+	for(auto& t : threads)
+		t.join();
+	End();
+	uint64_t reads = 0;
+	for(uint64_t i=0; i<readers; ++i)
+		reads += operations[i];
+	printf("\n %-32s readers: %2lu %10.0f reads/s %10.0f writes/s", name,
+			readers, reads/DeltaTime(), operations[readers]/DeltaTime());
+}
+
+// blocks retired by sets sharing EpochManager return to their own allocators
+void TestSharedEpochs() {
+	BlockAllocator<32> allocator1("shared_mem1.raw", "shared_heap1.raw");
+	BlockAllocator<32> allocator2("shared_mem2.raw", "shared_heap2.raw");
+	EpochManager epochs;
+	ConcurrentTreeSetFile set1(&allocator1, &epochs);
+	ConcurrentTreeSetFile set2(&allocator2, &epochs);
+	set1.InitNewTree();
+	set2.InitNewTree();
+	const uint64_t values = 1000;
+	for(uint64_t i=0; i<values; ++i) {
+		set1.insert(i);
+		set2.insert(i+values);
+	}
+	const uint64_t free1 = allocator1.FreeBlocks();
+	const uint64_t free2 = allocator2.FreeBlocks();
+	for(uint64_t i=0; i<values; ++i)
+		set1.erase(i);
+	for(uint64_t i=0; i<values/2; ++i)
+		set2.erase(i+values);
+	epochs.Collect();
+	if(epochs.Pending() || allocator1.FreeBlocks() != free1+values ||
+			allocator2.FreeBlocks() != free2+values/2) {
+		printf("\n shared EpochManager freed %lu and %lu blocks ... FAULT\n",
+				allocator1.FreeBlocks()-free1, allocator2.FreeBlocks()-free2);
+		++invalid;
+	}
+	set1.DestroyTree();
+	set2.DestroyTree();
+}
+
+int main() {
+	try {
+		TestSharedEpochs();
+		
+		BlockAllocator<32> allocator("32byte_block_mem.raw", "32byte_heap.raw");
+		// small reservations force remapping while readers run
+		allocator.SetReservingBlocksCount(256);
+		EpochManager epochs;
+		ConcurrentTreeSetFile set(&allocator, &epochs);
+		set.InitNewTree();
+		
+		std::vector<uint64_t> values;
+		for(uint64_t i=0; i<stableValues; ++i)
+			values.emplace_back(i*2);
+		std::mt19937_64 rd;
+		std::shuffle(values.begin(), values.end(), rd);
+		for(uint64_t v : values)
+			set.insert(v);
+		
+		printf("\n hardware threads: %u", std::thread::hardware_concurrency());
+		for(uint64_t readers : {1, 2, 4, 8}) {
+			Run("ConcurrentTreeSetFile::find_ge", readers,
+					[&set](uint64_t v, uint64_t& result) {
+						return set.find_ge(v, result);
+					},
+					[&set](uint64_t v) {set.insert(v);},
+					[&set](uint64_t v) {set.erase(v);});
+		}
+		
+		// baseline: TreeSetFile behind reader-writer lock
+		BlockAllocator<32> allocator2("32byte_block_mem2.raw", "32byte_heap2.raw");
+		TreeSetFile locked(&allocator2);
+		locked.InitNewTree();
+		for(uint64_t v : values)
+			locked.insert(v);
+		std::shared_mutex mutex;
+		for(uint64_t readers : {1, 2, 4, 8}) {
+			Run("TreeSetFile with shared_mutex", readers,
+					[&](uint64_t v, uint64_t& result) {
+						std::shared_lock lock(mutex);
+						auto it = locked.find_ge(v);
+						if(it)
+							result = *it;
+						return (bool)it;
+					},
+					[&](uint64_t v) {
+						std::unique_lock lock(mutex);
+						locked.insert(v);
+					},
+					[&](uint64_t v) {
+						std::unique_lock lock(mutex);
+						locked.erase(v);
+					});
+		}
+		locked.DestroyTree();
+		
+		printf("\n size: %lu, retired blocks pending: %lu", set.size(),
+				epochs.Pending());
+		set.DestroyTree();
+		
+		if(invalid)
+			printf("\n invalid reads: %lu ... FAULT\n", invalid.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
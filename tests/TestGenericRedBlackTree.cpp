@@ -0,0 +1,175 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2022 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "GenericRedBlackTree.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+#include <compare>
+#include <functional>
+#include <set>
+#include <vector>
+
+const uint64_t testValues = 100000;
+
+// composite key ordered by both fields, without packing into one integer
+struct Pair {
+	uint64_t first, second;
+	auto operator<=>(const Pair&) const = default;
+};
+
+static_assert(Generic::KeyOrder<uint64_t, std::less<uint64_t>>::builtin);
+static_assert(Generic::KeyOrder<double, std::less<double>>::Less(-1.5, 2.0));
+static_assert(!Generic::KeyOrder<Pair, std::less<Pair>>::builtin);
+static_assert(Generic::KeyOrder<Pair, std::less<Pair>>::Less({1, 9}, {2, 0}));
+static_assert(Generic::KeyOrder<double, std::greater<double>>::Less(2.0, -1.5));
+
+struct TreeRoot {
+	void* root = NULL;
+	
+	inline void* Root() {return root;}
+	inline void Root(void* newRoot) {root = newRoot;}
+};
+
+template<typename Key>
+struct Node {
+	Node* left, *right, *parent;
+	uint64_t color;
+	Key key;
+	
+	inline static uint64_t Color(TreeRoot* tree, void* node) {
+		return ((Node*)node)->color;
+	}
+	inline static void Color(TreeRoot* tree, void* node, uint64_t newColor) {
+		((Node*)node)->color = newColor;
+	}
+	inline static void* Left(TreeRoot* tree, void* node) {
+		return ((Node*)node)->left;
+	}
+	inline static void Left(TreeRoot* tree, void* node, void* newLeft) {
+		((Node*)node)->left = (Node*)newLeft;
+	}
+	inline static void* Right(TreeRoot* tree, void* node) {
+		return ((Node*)node)->right;
+	}
+	inline static void Right(TreeRoot* tree, void* node, void* newRight) {
+		((Node*)node)->right = (Node*)newRight;
+	}
+	inline static void* Parent(TreeRoot* tree, void* node) {
+		return ((Node*)node)->parent;
+	}
+	inline static void Parent(TreeRoot* tree, void* node, void* newParent) {
+		((Node*)node)->parent = (Node*)newParent;
+	}
+	inline static const Key& Value(TreeRoot* tree, void* node) {
+		return ((Node*)node)->key;
+	}
+};
+
+/*
+ *  Inserts keys with duplicates, erases part of them and compares order,
+ *  FindGreaterEqual and its batched versions with std::multiset using the
+ *  same comparator.
+ */
+template<typename Key, typename Compare, typename Generator>
+void Test(const char* name, Generator random) {
+	using Tree = Generic::RedBlackTree<TreeRoot, Node<Key>, Key, Compare>;
+	using TreeNode = typename Tree::Node;
+	TreeRoot root;
+	Tree tree;
+	tree.tree = &root;
+	std::vector<Node<Key>> nodes(testValues);
+	std::multiset<Key, Compare> ref;
+	for(auto& node : nodes) {
+		node.key = random();
+		tree.Insert((TreeNode*)&node);
+		ref.insert(node.key);
+	}
+	for(uint64_t i=0; i<nodes.size(); i+=3) {
+		tree.Erase((TreeNode*)&nodes[i]);
+		ref.erase(ref.find(nodes[i].key));
+	}
+	
+	Compare less;
+	auto equivalent = [&](const Key& a, const Key& b) {
+		return !less(a, b) && !less(b, a);
+	};
+	uint64_t n = 0;
+	auto r = ref.begin();
+	for(auto it=tree.begin(); it!=tree.end(); ++it, ++r, ++n) {
+		if(r == ref.end() || !equivalent(((Node<Key>*)*it)->key, *r)) {
+			CHECK(false, "%s iteration differs at %lu", name, n);
+			break;
+		}
+	}
+	CHECK(n == ref.size(), "%s iterated %lu of %lu", name, n, ref.size());
+	
+	std::vector<Key> queries(10000);
+	for(Key& q : queries)
+		q = Rand64()%2 ? random() : nodes[Rand64()%nodes.size()].key;
+	std::vector<TreeNode*> found(queries.size()), many(queries.size()),
+		interleaved(queries.size());
+	for(uint64_t i=0; i<queries.size(); ++i) {
+		found[i] = tree.FindGreaterEqual(queries[i]);
+		auto ge = ref.lower_bound(queries[i]);
+		CHECK((found[i]!=NULL) == (ge!=ref.end()) && (found[i]==NULL ||
+					equivalent(((Node<Key>*)found[i])->key, *ge)),
+				"%s FindGreaterEqual at %lu", name, i);
+	}
+	tree.FindGreaterEqualMany(queries, many);
+	tree.FindGreaterEqualInterleaved(queries, interleaved);
+	CHECK(many == found, "%s FindGreaterEqualMany", name);
+	CHECK(interleaved == found, "%s FindGreaterEqualInterleaved", name);
+	
+	Start();
+	for(uint64_t i=0; i<queries.size(); ++i)
+		found[i] = tree.FindGreaterEqual(queries[i]);
+	End();
+	printf("\n %-28s %10.0f lookups/s", name, queries.size()/DeltaTime());
+}
+
+int main() {
+	try {
+		Test<uint64_t, std::less<uint64_t>>("uint64_t", []() {
+					return Rand64() % (testValues*4);
+				});
+		Test<double, std::less<double>>("double", []() {
+					return (double)(int64_t)Rand64() / (1llu<<40);
+				});
+		Test<double, std::greater<double>>("double descending", []() {
+					return (double)(Rand64() % 1000) / 7;
+				});
+		Test<Pair, std::less<Pair>>("(uint64_t, uint64_t)", []() {
+					return Pair{Rand64() % 1000, Rand64() % (testValues*4)};
+				});
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
+
@@ -0,0 +1,265 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "Hash.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+const char* levelNames[] = {"scalar", "AVX2", "AVX-512"};
+
+std::vector<uint8_t> RandomBytes(uint64_t count) {
+	std::vector<uint8_t> bytes(count);
+	for(uint8_t& b : bytes)
+		b = Rand16();
+	return bytes;
+}
+
+// reference vectors of byte-wise FNV-1a
+static_assert(hash::FNV1a64Bytes("", 0) == 0xCBF29CE484222325llu);
+static_assert(hash::FNV1a64Bytes("a", 1) == 0xAF63DC4C8601EC8Cllu);
+static_assert(hash::FNV1a64Bytes("foobar", 6) == 0x85944171F73967E8llu);
+static_assert(hash::FNV1a32Bytes("a", 1) == 0xE40C292Cu);
+static_assert(hash::FNV1a32Bytes("foobar", 6) == 0xBF9CF968u);
+
+using namespace hash::literals;
+static_assert("collection"_fnv == hash::FNV1a64("collection", 10));
+
+void TestFNV() {
+	std::vector<uint8_t> data = RandomBytes(1000);
+	for(uint64_t len=0; len<=1000; ++len) {
+		// word-wise variant with explicit multiplication by prime
+		uint64_t expected = hash::FNV_64_OFFSET_BASIS;
+		for(uint64_t i=0; i<len; i+=8) {
+			uint64_t word = 0;
+			memcpy(&word, data.data()+i, std::min<uint64_t>(8, len-i));
+			expected = (expected ^ word) * hash::FNV_64_PRIME;
+		}
+		CHECK(hash::FNV1a64((const char*)data.data(), len) == expected,
+				"word-wise FNV-1a differs for length %lu", len);
+		
+		uint64_t bytes64 = hash::FNV_64_OFFSET_BASIS;
+		uint32_t bytes32 = hash::FNV_32_OFFSET_BASIS;
+		for(uint64_t i=0; i<len; ++i) {
+			bytes64 = (bytes64 ^ data[i]) * hash::FNV_64_PRIME;
+			bytes32 = (bytes32 ^ data[i]) * hash::FNV_32_PRIME;
+		}
+		CHECK(hash::FNV1a64Bytes((const char*)data.data(), len) == bytes64,
+				"byte-wise FNV-1a 64 differs for length %lu", len);
+		CHECK(hash::FNV1a32Bytes((const char*)data.data(), len) == bytes32,
+				"byte-wise FNV-1a 32 differs for length %lu", len);
+	}
+}
+
+void TestCorrectness() {
+	std::vector<uint8_t> data = RandomBytes(8192+1);
+	
+	// every kernel gives the same result, also for unaligned input
+	const hash::SimdLevel supported = hash::SupportedSimdLevel();
+	std::vector<uint64_t> expected;
+	hash::SetSimdLevel(hash::SCALAR);
+	for(uint64_t len=0; len<=8192; len+=7)
+		expected.push_back(hash::hash64(data.data(), len, len));
+	for(int level=hash::SCALAR; level<=supported; ++level) {
+		hash::SetSimdLevel((hash::SimdLevel)level);
+		std::vector<uint8_t> shifted(data.begin(), data.end());
+		shifted.insert(shifted.begin(), 0);
+		uint64_t i = 0;
+		for(uint64_t len=0; len<=8192; len+=7, ++i) {
+			CHECK(hash::hash64(data.data(), len, len) == expected[i],
+					"%s kernel differs for length %lu", levelNames[level], len);
+			CHECK(hash::hash64(shifted.data()+1, len, len) == expected[i],
+					"%s unaligned input differs for length %lu",
+					levelNames[level], len);
+		}
+	}
+	hash::SetSimdLevel(supported);
+	
+	// every prefix, seed and single bit change gives different hash
+	std::set<uint64_t> hashes;
+	for(uint64_t len=0; len<=4096; ++len) {
+		const uint64_t h = hash::hash64(data.data(), len);
+		CHECK(hashes.insert(h).second, "prefix %lu collides", len);
+		CHECK(hash::hash64(data.data(), len, 1) != h, "seed ignored for %lu", len);
+		if(len == 0 || (len > 600 && len%61))
+			continue;
+		const uint64_t bit = Rand64() % (len*8);
+		data[bit/8] ^= 1 << (bit%8);
+		CHECK(hash::hash64(data.data(), len) != h,
+				"bit %lu of length %lu does not change hash", bit, len);
+		data[bit/8] ^= 1 << (bit%8);
+	}
+	
+	// one flipped input bit changes on average half of output bits
+	uint64_t flipped = 0, samples = 0;
+	for(uint64_t i=0; i<10000; ++i) {
+		const uint64_t v = Rand64();
+		const uint64_t h = hash::hash64(v);
+		for(uint64_t bit=0; bit<64; ++bit, ++samples)
+			flipped += __builtin_popcountll(h ^ hash::hash64(v ^ (1llu<<bit)));
+	}
+	const double avalanche = (double)flipped / samples;
+	CHECK(avalanche > 31 && avalanche < 33, "avalanche %f", avalanche);
+	CHECK(hash::hash64(12345llu) == hash::hash64(&"\x39\x30\0\0\0\0\0\0", 8),
+			"word and byte hash differ");
+	
+	CHECK(hash::hash(hash::FNV1A64, 777) == hash::FNV1a64(777),
+			"FNV1A64 selection");
+	CHECK(hash::hash(hash::HASH64, (const char*)data.data(), 100) ==
+			hash::hash64(data.data(), 100), "HASH64 selection");
+}
+
+void TestHashMany() {
+	static_assert(hash::mix64(0) == 0xE220A8397B1DCDAFllu);
+	std::vector<uint64_t> in(1000), out(1000);
+	for(uint64_t& v : in)
+		v = Rand64();
+	for(int level=hash::SCALAR; level<=hash::SupportedSimdLevel(); ++level) {
+		hash::SetSimdLevel((hash::SimdLevel)level);
+		// every length checks tail handling, offset checks unaligned arrays
+		for(uint64_t n=0; n<=40; ++n) {
+			std::fill(out.begin(), out.end(), 0);
+			hash::hash_many(in.data()+1, out.data()+1, n);
+			for(uint64_t i=0; i<n; ++i)
+				CHECK(out[i+1] == hash::mix64(in[i+1]),
+						"%s hash_many differs at %lu of %lu",
+						levelNames[level], i, n);
+			CHECK(out[n+1] == 0, "%s hash_many wrote past %lu",
+					levelNames[level], n);
+		}
+		std::vector<uint64_t> inplace = in;
+		hash::hash_many(inplace.data(), inplace.data(), inplace.size());
+		for(uint64_t i=0; i<in.size(); ++i)
+			CHECK(inplace[i] == hash::mix64(in[i]), "%s in place hash_many",
+					levelNames[level]);
+	}
+	hash::SetSimdLevel(hash::SupportedSimdLevel());
+	
+	for(hash::Function function : {hash::FNV1A64, hash::HASH64, hash::MIX64}) {
+		hash::hash_many(function, in.data(), out.data(), in.size());
+		for(uint64_t i=0; i<in.size(); ++i)
+			CHECK(out[i] == hash::hash(function, in[i]),
+					"hash_many of function %lu", (uint64_t)function);
+	}
+}
+
+template<typename Hash>
+void BenchmarkMany(const char* name, Hash hash) {
+	static std::vector<uint64_t> in(1<<16), out(1<<16);
+	for(uint64_t& v : in)
+		v = Rand64();
+	double best = 0;
+	for(int run=0; run<3; ++run) {
+		Start();
+		for(uint64_t i=0; i<256; ++i)
+			hash(in.data(), out.data(), in.size());
+		End();
+		best = std::max(best, 256*in.size()/DeltaTime()/1e6);
+	}
+	printf("\n %-22s %8.0f Mkeys/s", name, best);
+}
+
+template<typename Hash>
+void Benchmark(const char* name, Hash hash) {
+	const uint64_t bufferSize = 1<<20;
+	static std::vector<uint8_t> data = RandomBytes(bufferSize + 4096);
+	printf("\n %-22s", name);
+	for(uint64_t len=8; len<=4096; len*=2) {
+		const uint64_t count = (32llu<<20) / len + 100000;
+		double best = 0;
+		for(int run=0; run<3; ++run) {
+			uint64_t sum = 0, offset = 0;
+			Start();
+			for(uint64_t i=0; i<count; ++i) {
+				sum += hash(data.data() + offset, len);
+				offset = (offset + len + 8) & (bufferSize-1);
+			}
+			End();
+			if(sum == 1)
+				printf(" ");
+			best = std::max(best, count*len/DeltaTime()/1e9);
+		}
+		printf(" %6.2f", best);
+	}
+}
+
+int main() {
+	try {
+		TestFNV();
+		TestCorrectness();
+		TestHashMany();
+		
+		printf("\n GB/s for key length: ");
+		printf("\n %-22s", "");
+		for(uint64_t len=8; len<=4096; len*=2)
+			printf(" %6lu", len);
+		Benchmark("FNV1a64Bytes", [](const uint8_t* p, uint64_t len) {
+				return hash::FNV1a64Bytes((const char*)p, len);
+			});
+		Benchmark("FNV1a64", [](const uint8_t* p, uint64_t len) {
+				return hash::FNV1a64((const char*)p, len);
+			});
+		for(int level=hash::SCALAR; level<=hash::SupportedSimdLevel(); ++level) {
+			hash::SetSimdLevel((hash::SimdLevel)level);
+			char name[64];
+			sprintf(name, "hash64 (%s)", levelNames[level]);
+			Benchmark(name, [](const uint8_t* p, uint64_t len) {
+					return hash::hash64(p, len);
+				});
+		}
+		hash::SetSimdLevel(hash::SupportedSimdLevel());
+		
+		printf("\n\n uint64_t keys:");
+		BenchmarkMany("FNV1a64 loop", [](const uint64_t* in, uint64_t* out,
+					uint64_t n) {
+				for(uint64_t i=0; i<n; ++i)
+					out[i] = hash::hash(in[i]);
+			});
+		BenchmarkMany("hash64 loop", [](const uint64_t* in, uint64_t* out,
+					uint64_t n) {
+				for(uint64_t i=0; i<n; ++i)
+					out[i] = hash::hash64(in[i]);
+			});
+		for(int level=hash::SCALAR; level<=hash::SupportedSimdLevel(); ++level) {
+			hash::SetSimdLevel((hash::SimdLevel)level);
+			char name[64];
+			sprintf(name, "hash_many (%s)", levelNames[level]);
+			BenchmarkMany(name, [](const uint64_t* in, uint64_t* out,
+						uint64_t n) {
+					hash::hash_many(in, out, n);
+				});
+		}
+		hash::SetSimdLevel(hash::SupportedSimdLevel());
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
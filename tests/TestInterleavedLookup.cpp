@@ -0,0 +1,96 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2022 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "Debug.hpp"
+
+#include "GenericRedBlackTree.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <vector>
+
+using Tree = Generic::Prototypes::Tree;
+using Node = Generic::Prototypes::Node;
+using RBTree = Generic::RedBlackTree<Tree, Node>;
+using TreeNode = RBTree::Node;
+
+void Test(uint64_t elements, uint64_t queries) {
+	printf("\n elements: %lu, queries: %lu\n", elements, queries);
+	std::vector<Node> nodes(elements);
+	Tree tree;
+	tree.root = NULL;
+	RBTree rbtree;
+	rbtree.tree = &tree;
+	
+	Start();
+	for(auto& node : nodes) {
+		node.value = Rand64();
+		rbtree.Insert((TreeNode*)&node);
+	}
+	End();
+	printf(" build %.2fs\n", DeltaTime());
+	
+	std::vector<uint64_t> values(queries);
+	std::vector<TreeNode*> expected(queries), result(queries);
+	for(auto& v : values)
+		v = Rand64()%2 ? Rand64() : nodes[Rand64()%elements].value;
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i)
+		expected[i] = rbtree.FindGreaterEqual(values[i]);
+	End();
+	double time = DeltaTime();
+	printf(" iterative FindGreaterEqual     %10.0f lookups/s\n", queries/time);
+	
+	uint64_t invalid = 0;
+	
+	Start();
+	rbtree.FindGreaterEqualMany(values, result);
+	End();
+	printf(" FindGreaterEqualMany           %10.0f lookups/s (%.2fx)\n",
+			queries/DeltaTime(), time/DeltaTime());
+	invalid += result != expected;
+	
+	for(uint64_t group : {1, 4, 8, 16, 32}) {
+		Start();
+		rbtree.FindGreaterEqualInterleaved(values, result, group);
+		End();
+		printf(" FindGreaterEqualInterleaved %2lu %10.0f lookups/s (%.2fx)\n",
+				group, queries/DeltaTime(), time/DeltaTime());
+		invalid += result != expected;
+	}
+	
+	if(invalid)
+		printf(" invalid results ... FAULT\n");
+	else
+		printf(" ... OK\n");
+}
+
+int main(int argc, char** argv) {
+	// optional argument: number of nodes in millions
+	if(argc > 1) {
+		Test(atoll(argv[1])*1000000llu, 4000000);
+	} else {
+		Test(1000000, 4000000);
+		Test(16000000, 4000000);
+	}
+	printf("\n");
+	return 0;
+}
@@ -19,6 +19,7 @@
 #include "Debug.hpp"
 
 #include "LinearAllocator.hpp"
+#include "OffsetPtr.hpp"
 
 #include <cstdio>
 #include <chrono>
@@ -34,7 +35,8 @@ struct Ptr {
 	uint64_t linearPtr;
 	uint64_t* regular_ptr;
 	uint64_t bytes;
-	Ptr() {linearPtr=0;bytes=0;regular_ptr=NULL;}
+	uint64_t checksum;
+	Ptr() {linearPtr=0;bytes=0;regular_ptr=NULL;checksum=0;}
 };
 std::map<uint64_t, Ptr> allocated;
 
@@ -66,6 +68,7 @@ void AllocateNew(uint64_t elements) {
 	uint64_t* regular = ptr.regular_ptr;
 	for(uint64_t i=0; i<elements; ++i) {
 		linear[i] = Rand64();
+		ptr.checksum += linear[i];
 		if(useRegularMemory)
 			regular[i] = linear[i];
 	}
@@ -122,6 +125,114 @@ void Test(uint64_t make, uint64_t minSize, uint64_t sizeVariance, uint64_t remov
 	}
 }
 
+uint64_t Checksum(Ptr ptr) {
+	uint64_t* linear = allocator.Origin<uint64_t>(ptr.linearPtr);
+	uint64_t ret = 0;
+	for(uint64_t i=0; i<(ptr.bytes>>3); ++i)
+		ret += linear[i];
+	return ret;
+}
+
+void TestCompaction(uint64_t bytesPerStep) {
+	uint64_t used = allocator.used();
+	uint64_t reserved = allocator.reserved();
+	printf(" before compaction: used %lu / %lu (%.2f%%) \n", used, reserved,
+			100.0*used/(double)reserved);
+	
+	uint64_t steps = 1;
+	Start();
+	while(!allocator.Compact(bytesPerStep, [](uint64_t from, uint64_t to) {
+				auto node = allocated.extract(from);
+				node.key() = to;
+				node.mapped().linearPtr = to;
+				allocated.insert(std::move(node));
+			})) {
+		++steps;
+	}
+	End();
+	
+	uint64_t invalid = 0;
+	for(auto ptr : allocated) {
+		if(Checksum(ptr.second) != ptr.second.checksum)
+			++invalid;
+	}
+	used = allocator.used();
+	reserved = allocator.reserved();
+	printf(" after %lu compaction steps in %.3f s: used %lu / %lu (%.2f%%) \n",
+			steps, DeltaTime(), used, reserved, 100.0*used/(double)reserved);
+	
+	if(invalid == 0 && reserved-used <= LinearAllocator::allocationUnitSize) {
+		printf(" ... OK\n\n");
+	} else {
+		printf(" invalid allocations: %lu ... FAULT\n\n", invalid);
+	}
+}
+
+struct ListTag {};
+struct ListNode {
+	OffsetPtr<ListNode, ListTag, uint32_t> next;
+	uint32_t value;
+};
+
+void TestOffsetPtr(uint64_t elements) {
+	OffsetPtrBase<ListTag>::Bind(allocator);
+	OffsetPtr<ListNode, ListTag, uint32_t> head = nullptr;
+	for(uint64_t i=0; i<elements; ++i) {
+		OffsetPtr<ListNode, ListTag, uint32_t> node(
+			allocator.Allocate(sizeof(ListNode)));
+		node->value = i;
+		node->next = head;
+		head = node;
+	}
+	// force remapping of memory file
+	uint64_t big = allocator.Allocate(LinearAllocator::allocationUnitSize*4);
+	
+	uint64_t invalid = 0, count = 0;
+	for(auto node = head; node; ++count) {
+		if(node->value != elements-1-count)
+			++invalid;
+		auto next = node->next;
+		allocator.Free(node.Ptr());
+		node = next;
+	}
+	allocator.Free(big);
+	OffsetPtrBase<ListTag>::Unbind();
+	
+	// offsets past 32 bit range must not wrap
+	using Ptr = OffsetPtr<ListNode, ListTag, uint32_t>;
+	try {
+		Ptr ptr(Ptr::maxOffset+1);
+		++invalid;
+	} catch(std::runtime_error&) {
+	}
+	if(Ptr(Ptr::maxOffset & ~7llu).Ptr() != (Ptr::maxOffset & ~7llu))
+		++invalid;
+	// dropped low bits would resolve to other address
+	const uint64_t misaligned[] = {1, 4, 8+7, Ptr::maxOffset};
+	for(uint64_t offset : misaligned) {
+		try {
+			Ptr ptr(offset);
+			++invalid;
+		} catch(std::runtime_error&) {
+		}
+	}
+	OffsetPtrBase<ListTag>::Bind(allocator);
+	try {
+		Ptr ptr((ListNode*)(OffsetPtrBase<ListTag>::Origin() + 4));
+		++invalid;
+	} catch(std::runtime_error&) {
+	}
+	OffsetPtrBase<ListTag>::Unbind();
+	
+	printf(" OffsetPtr list of %lu nodes (%lu bytes per pointer)",
+			count, sizeof(head));
+	if(invalid == 0 && count == elements) {
+		printf(" ... OK\n\n");
+	} else {
+		printf(" invalid nodes: %lu ... FAULT\n\n", invalid);
+	}
+}
+
 int main() {
 	BlockAllocator<32> ballocator("32byte_block_mem.raw", "32byte_heap.raw");
 	TreeSetFile fileSet(&ballocator);
@@ -146,6 +257,11 @@ int main() {
 		Test(23457, 48, 48, 2000);
 		Test(123, 432, 4325, 123455);
 		
+		Test(12345, 1200, 1200, 6000);
+		TestCompaction(1024*1024);
+		Test(12345, 80, 64, 2000);
+		TestOffsetPtr(123456);
+		
 		
 		fileSet.DestroyTree();
 	} catch(std::exception& e) {
@@ -0,0 +1,130 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "Debug.hpp"
+
+#include "MultiBlockAllocator.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <sys/stat.h>
+
+#include <map>
+#include <set>
+
+MultiBlockAllocator allocator;
+std::map<uint64_t, uint64_t> allocated;
+std::set<uint64_t> usedSizes;
+
+bool AllocateNew(uint64_t size) {
+	uint64_t ptr = allocator.Allocate(size);
+	if(ptr == -1)
+		return false;
+	auto next = allocated.lower_bound(ptr);
+	if(next != allocated.end() && next->first < ptr+size)
+		return false;
+	if(next != allocated.begin()) {
+		--next;
+		if(next->first+next->second > ptr)
+			return false;
+	}
+	allocated[ptr] = size;
+	allocator.Origin<uint64_t>(ptr)[0] = ptr;
+	return true;
+}
+
+// bytes of memory file actually allocated on disk
+uint64_t DiskBytes() {
+	struct stat s;
+	if(stat("multi_block_memory.raw", &s))
+		return 0;
+	return s.st_blocks*512;
+}
+
+bool FreeAll() {
+	bool valid = true;
+	for(auto it : allocated) {
+		if(allocator.Origin<uint64_t>(it.first)[0] != it.first)
+			valid = false;
+		allocator.Free(it.first);
+	}
+	allocated.clear();
+	return valid;
+}
+
+void Test(uint64_t make, uint64_t size) {
+	bool valid = true;
+	usedSizes.insert(size);
+	Start();
+	for(uint64_t i=0; i<make && valid; ++i)
+		valid &= AllocateNew(size);
+	End();
+	printf("\n %.0f allocations/s of %lu bytes", make/DeltaTime(), size);
+	uint64_t superblocks = allocator.Superblocks();
+	uint64_t free = allocator.FreeSuperblocks();
+	printf("\n superblocks: %lu (free: %lu)", superblocks, free);
+	
+	const uint64_t disk = DiskBytes();
+	const uint64_t unreleased = allocator.UnreleasedSuperblocks();
+	valid &= FreeAll();
+	printf("\n after free: %lu (free: %lu)", allocator.Superblocks(),
+			allocator.FreeSuperblocks());
+	printf("\n disk: %.1f MiB -> %.1f MiB", disk/1048576.0,
+			DiskBytes()/1048576.0);
+	// released superblocks have to give their pages back
+	if(allocator.UnreleasedSuperblocks() != unreleased) {
+		printf(" (hole punching not supported, %lu superblocks not released)",
+				allocator.UnreleasedSuperblocks());
+	} else if(allocator.FreeSuperblocks() > free && DiskBytes() >= disk) {
+		valid = false;
+	}
+	// every size class keeps at most one empty superblock
+	if(allocator.Superblocks()-allocator.FreeSuperblocks() > usedSizes.size())
+		valid = false;
+	
+	if(valid == false) {
+		printf(" ... FAULT \n");
+	} else {
+		printf(" ... OK \n");
+	}
+}
+
+int main() {
+	try {
+		MultiBlockAllocator::RemoveFiles("multi_block");
+		allocator.Open("multi_block");
+		Test(1024*1024, 64);
+		Test(10000, 4096);
+		Test(1024*1024, 32);
+		Test(300, 1024*1024);
+		uint64_t superblocks = allocator.Superblocks();
+		Test(1024*1024, 64);
+		Test(1024*1024, 32);
+		Test(30000, 4096);
+		printf("\n superblocks reused: %s\n",
+				allocator.Superblocks()==superblocks ? "OK" : "FAULT");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	allocator.Close();
+	MultiBlockAllocator::RemoveFiles("multi_block");
+	printf("\n");
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include <set>
 #include <map>
 #include <unordered_set>
+#include <vector>
 
 #include "Debug.hpp"
 
@@ -538,9 +539,36 @@ int main() {
 		uint64_t size = used;
 		printf(" rbtree elments: %.2fM -> height: %lu, minHeight: %lu\n", size/1000000.0f, height, minHeight);
 		
+		Start();
 		height = grbt.Root()->Height(ttt);
 		minHeight = grbt.Root()->MinHeight(ttt);
-		printf(" grbt elments: %.2fM -> height: %lu, minHeight: %lu\n", size/1000000.0f, height, minHeight);
+		invalid_parenting = grbt.Root()->VerifyParenting(false, ttt);
+		End();
+		time = DeltaTime();
+		printf(" grbt elments: %.2fM -> height: %lu, minHeight: %lu (Height, MinHeight, VerifyParenting in %.3fs)\n", size/1000000.0f, height, minHeight, time);
+		
+		{
+			using GNode = decltype(grbt)::Node;
+			std::vector<uint64_t> queries(cc);
+			std::vector<GNode*> found(cc), foundMany(cc);
+			for(auto& q : queries)
+				q = (uint64_t)all[dist(rd)%used] + dist(rd)%2*32;
+			
+			Start();
+			for(uint64_t i=0; i<cc; ++i)
+				found[i] = grbt.FindGreaterEqual(queries[i]);
+			End();
+			time = DeltaTime();
+			printf(" grbt FindGreaterEqual %lu queries in %.2fs -> %.2f kops\n", cc, time, cc/(time*1000.0f));
+			
+			Start();
+			grbt.FindGreaterEqualMany<GNode>(queries, foundMany);
+			End();
+			time = DeltaTime();
+			printf(" grbt FindGreaterEqualMany %lu queries in %.2fs -> %.2f kops\n", cc, time, cc/(time*1000.0f));
+			if(found != foundMany)
+				printf(" grbt FindGreaterEqualMany invalid results ... FAULT\n");
+		}
 	}
 	
 	invalid_parenting = rbtree.Root<FIELD>()->VerifyParenting<FIELD>(false, nodes);
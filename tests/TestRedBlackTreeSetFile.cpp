@@ -0,0 +1,262 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "RedBlackTreeSetFile.hpp"
+#include "TreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <set>
+#include <vector>
+#include <algorithm>
+
+std::set<uint64_t> stdSet;
+
+uint64_t RandV() {
+	return Rand64()%987654321;
+}
+
+// returns black height or -1 on red-black property, parenting or subtree
+// size violation
+template<typename Iterator>
+int64_t Verify(Iterator it, Iterator parent) {
+	if(!it)
+		return 1;
+	if(it.parent() != parent)
+		return -1;
+	if constexpr(requires {it.count();})
+		if(it.count() != it.left().count() + it.right().count() + 1)
+			return -1;
+	if(it.red() && ((it.left() && it.left().red()) || (it.right() && it.right().red())))
+		return -1;
+	int64_t l = Verify(it.left(), it);
+	int64_t r = Verify(it.right(), it);
+	if(l < 0 || l != r)
+		return -1;
+	return l + it.black();
+}
+
+template<typename Set>
+uint64_t Cmp(Set& set) {
+	uint64_t invalid = 0;
+	if(set.size() != stdSet.size())
+		++invalid;
+	auto a = stdSet.begin();
+	for(auto it=set.begin(); it; ++it, ++a)
+		if(a == stdSet.end() || *a != *it) {
+			++invalid;
+			break;
+		}
+	auto b = stdSet.rbegin();
+	for(auto it=set.rbegin(); it; --it, ++b)
+		if(b == stdSet.rend() || *b != *it) {
+			++invalid;
+			break;
+		}
+	if(set.root() && set.root().red())
+		++invalid;
+	if(Verify(set.root(), set.end()) < 0)
+		++invalid;
+	return invalid;
+}
+
+uint64_t CmpOrderStatistics(CountedRedBlackTreeSetFile& set, uint64_t queries) {
+	std::vector<uint64_t> sorted(stdSet.begin(), stdSet.end());
+	uint64_t invalid = 0;
+	for(uint64_t i=0; i<queries; ++i) {
+		uint64_t v = RandV()%11000;
+		uint64_t expected = std::lower_bound(sorted.begin(), sorted.end(), v)
+			- sorted.begin();
+		if(set.rank(v) != expected)
+			++invalid;
+		auto it = set.select(expected);
+		if((bool)it != (expected<sorted.size()) || (it && *it != sorted[expected]))
+			++invalid;
+		uint64_t a = RandV()%11000, b = RandV()%11000;
+		expected = 0;
+		if(a <= b)
+			expected = std::upper_bound(sorted.begin(), sorted.end(), b)
+				- std::lower_bound(sorted.begin(), sorted.end(), a);
+		if(set.count_range(a, b) != expected)
+			++invalid;
+	}
+	return invalid;
+}
+
+template<typename Set>
+void TestCorrectness(Set& set) {
+	uint64_t invalid = 0;
+	for(uint64_t round=0; round<20; ++round) {
+		for(uint64_t i=0; i<3000; ++i) {
+			uint64_t v = RandV()%10000;
+			stdSet.insert(v);
+			set.insert(v);
+		}
+		for(uint64_t i=0; i<2500; ++i) {
+			uint64_t v = RandV()%10000;
+			auto it = stdSet.lower_bound(v);
+			if(it != stdSet.end() && Rand64()%2) {
+				auto next = std::next(it);
+				auto n = set.erase(*it);
+				if(next==stdSet.end() ? (bool)n : (!n || *n != *next))
+					++invalid;
+				stdSet.erase(it);
+			} else {
+				stdSet.erase(v);
+				set.erase(v);
+			}
+		}
+		invalid += Cmp(set);
+		if constexpr(std::is_same_v<Set, CountedRedBlackTreeSetFile>)
+			invalid += CmpOrderStatistics(set, 1000);
+		for(uint64_t i=0; i<1000; ++i) {
+			uint64_t v = RandV()%11000;
+			auto ge = stdSet.lower_bound(v);
+			auto it = set.find_ge(v);
+			if((bool)it != (ge!=stdSet.end()) || (it && *it != *ge))
+				++invalid;
+			auto le = stdSet.upper_bound(v);
+			it = set.find_le(v);
+			if((bool)it != (le!=stdSet.begin()) || (it && *it != *--le))
+				++invalid;
+		}
+	}
+	while(stdSet.size()) {
+		set.erase(*stdSet.begin());
+		stdSet.erase(stdSet.begin());
+	}
+	invalid += Cmp(set);
+	
+	if(invalid)
+		printf("\n insert/erase: %lu invalid ... FAULT\n", invalid);
+	else
+		printf("\n insert/erase ... OK\n");
+}
+
+template<typename Set>
+void Benchmark(const char* name, Set& set, const std::vector<uint64_t>& values,
+		const std::vector<uint64_t>& queries) {
+	uint64_t sum = 0;
+	Start();
+	for(uint64_t v : values)
+		set.insert(v);
+	End();
+	double insertTime = DeltaTime();
+	Start();
+	for(uint64_t v : queries)
+		sum += set.find(v) != set.end();
+	End();
+	double findTime = DeltaTime();
+	Start();
+	for(uint64_t v : queries)
+		set.erase(v);
+	End();
+	double eraseTime = DeltaTime();
+	printf("\n %-20s %10.0f insert/s %10.0f find/s %10.0f erase/s (%lu)",
+			name, values.size()/insertTime, queries.size()/findTime,
+			queries.size()/eraseTime, sum);
+}
+
+void Benchmark(uint64_t elements, bool sorted) {
+	printf("\n\n %s values: %lu", sorted ? "sorted" : "random", elements);
+	std::vector<uint64_t> values(elements), queries(elements);
+	for(uint64_t i=0; i<elements; ++i)
+		values[i] = sorted ? i*7 : Rand64();
+	for(auto& v : queries)
+		v = values[Rand64()%elements];
+	
+	BlockAllocator<32> allocator("32byte_block_mem.raw", "32byte_heap.raw");
+	allocator.SetReservingBlocksCount(1024*1024);
+	
+	RedBlackTreeSetFile rbSet(&allocator);
+	rbSet.InitNewTree();
+	Benchmark("RedBlackTreeSetFile", rbSet, values, queries);
+	rbSet.DestroyTree();
+	
+	CountedRedBlackTreeSetFile::AllocatorType countedAllocator(
+			"40byte_block_mem.raw", "40byte_heap.raw");
+	countedAllocator.SetReservingBlocksCount(1024*1024);
+	CountedRedBlackTreeSetFile countedSet(&countedAllocator);
+	countedSet.InitNewTree();
+	Benchmark("Counted", countedSet, values, queries);
+	countedSet.DestroyTree();
+	
+	// unbalanced tree degenerates into list on sorted values
+	if(!sorted) {
+		TreeSetFile fileSet(&allocator);
+		fileSet.InitNewTree();
+		Benchmark("TreeSetFile", fileSet, values, queries);
+		fileSet.DestroyTree();
+	}
+	
+	std::set<uint64_t> set;
+	Benchmark("std::set", set, values, queries);
+}
+
+void BenchmarkOrderStatistics(uint64_t elements) {
+	printf("\n\n order statistics, values: %lu", elements);
+	CountedRedBlackTreeSetFile::AllocatorType allocator(
+			"40byte_block_mem.raw", "40byte_heap.raw");
+	allocator.SetReservingBlocksCount(1024*1024);
+	CountedRedBlackTreeSetFile set(&allocator);
+	set.InitNewTree();
+	for(uint64_t i=0; i<elements; ++i)
+		set.insert(Rand64());
+	uint64_t sum = 0;
+	Start();
+	for(uint64_t i=0; i<elements; ++i)
+		sum += set.rank(Rand64());
+	End();
+	double rankTime = DeltaTime();
+	Start();
+	for(uint64_t i=0; i<elements; ++i)
+		sum += *set.select(Rand64()%set.size());
+	End();
+	double selectTime = DeltaTime();
+	printf("\n %-20s %10.0f rank/s   %10.0f select/s (%lu)", "Counted",
+			elements/rankTime, elements/selectTime, sum);
+	set.DestroyTree();
+}
+
+int main() {
+	try {
+		BlockAllocator<32> allocator("32byte_block_mem.raw", "32byte_heap.raw");
+		RedBlackTreeSetFile set(&allocator);
+		set.InitNewTree();
+		TestCorrectness(set);
+		set.DestroyTree();
+		
+		CountedRedBlackTreeSetFile::AllocatorType countedAllocator(
+				"40byte_block_mem.raw", "40byte_heap.raw");
+		CountedRedBlackTreeSetFile countedSet(&countedAllocator);
+		countedSet.InitNewTree();
+		TestCorrectness(countedSet);
+		countedSet.DestroyTree();
+		
+		Benchmark(1000000, false);
+		Benchmark(1000000, true);
+		BenchmarkOrderStatistics(1000000);
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
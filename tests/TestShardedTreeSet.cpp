@@ -0,0 +1,225 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Debug.hpp"
+
+#include "ShardedTreeSet.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <string>
+
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+const uint64_t shardCount = 16;
+const uint64_t testValues = 300000;
+const uint64_t benchmarkValues = 1000000;
+
+void RemoveShardFiles(const char* prefix) {
+	const std::string base = prefix;
+	RemoveFiles(base, {".meta.raw"});
+	for(uint64_t i=0; i<shardCount; ++i)
+		RemoveFiles(base + "." + std::to_string(i), {".mem.raw", ".heap.raw"});
+}
+
+uint64_t ShardFilesSize(const char* prefix) {
+	uint64_t bytes = 0;
+	for(uint64_t i=0; i<shardCount; ++i)
+		bytes += std::filesystem::file_size(std::string(prefix) + "." +
+				std::to_string(i) + ".mem.raw");
+	return bytes;
+}
+
+// thread t inserts count values from its own random sequence
+template<typename Insert>
+void Inserter(Insert insert, uint64_t t, uint64_t count, uint64_t mask) {
+	uint64_t seed = t*0x9E3779B97F4A7C15llu + 1;
+	for(uint64_t i=0; i<count; ++i) {
+		seed = seed*6364136223846793005llu + 1442695040888963407llu;
+		insert((seed ^ (seed>>31)) & mask);
+	}
+}
+
+template<typename Insert>
+double InsertParallel(Insert insert, uint64_t threads, uint64_t count,
+		uint64_t mask=-1) {
+	std::vector<std::thread> workers;
+	Start();
+	for(uint64_t t=0; t<threads; ++t)
+		workers.emplace_back(Inserter<Insert>, insert, t, count/threads, mask);
+	for(auto& w : workers)
+		w.join();
+	End();
+	return DeltaTime();
+}
+
+void Verify(const char* name, ShardedTreeSet& set, const std::set<uint64_t>& ref) {
+	CHECK(set.size() == ref.size(), "%s size %lu != %lu", name, set.size(),
+			ref.size());
+	
+	uint64_t n = 0;
+	auto r = ref.begin();
+	for(ShardedTreeSet::Iterator it=set.begin(); it; ++it, ++r, ++n) {
+		if(r == ref.end() || *it != *r) {
+			CHECK(false, "%s iteration differs at %lu", name, n);
+			break;
+		}
+	}
+	CHECK(n == ref.size(), "%s iterated %lu of %lu", name, n, ref.size());
+	
+	std::vector<uint64_t> values(ref.begin(), ref.end());
+	for(uint64_t i=0; i<10000; ++i) {
+		const uint64_t v = values[Rand64()%values.size()] + (Rand64()%5) - 2;
+		uint64_t result;
+		auto ge = ref.lower_bound(v);
+		bool found = set.find_ge(v, result);
+		CHECK(found == (ge!=ref.end()) && (!found || result==*ge),
+				"%s find_ge(%lu)", name, v);
+		auto le = ref.upper_bound(v);
+		found = set.find_le(v, result);
+		CHECK(found == (le!=ref.begin()) && (!found || result==*std::prev(le)),
+				"%s find_le(%lu)", name, v);
+		CHECK(set.find(v) == (ref.count(v)!=0), "%s find(%lu)", name, v);
+		
+		ShardedTreeSet::Iterator it = set.lower_bound(v);
+		CHECK((bool)it == (ge!=ref.end()) && (!it || *it==*ge),
+				"%s lower_bound(%lu)", name, v);
+	}
+}
+
+void TestCorrectness(ShardedTreeSet::Partitioning partitioning,
+		const char* name, const char* prefix) {
+	RemoveShardFiles(prefix);
+	ShardedTreeSet set(prefix, shardCount, partitioning);
+	std::set<uint64_t> ref;
+	std::mutex refMutex;
+	InsertParallel([&](uint64_t v) {
+				bool inserted = set.insert(v);
+				std::lock_guard lock(refMutex);
+				CHECK(inserted == ref.insert(v).second, "%s insert(%lu)", name, v);
+			}, 4, testValues);
+	Verify(name, set, ref);
+	
+	std::vector<uint64_t> values(ref.begin(), ref.end());
+	for(uint64_t i=0; i<values.size(); i+=3) {
+		CHECK(set.erase(values[i]), "%s erase(%lu)", name, values[i]);
+		ref.erase(values[i]);
+	}
+	CHECK(!set.erase(values[0]), "%s erased missing value", name);
+	Verify(name, set, ref);
+	
+	set.Close();
+	set.Open(prefix);
+	Verify(name, set, ref);
+	set.Close();
+	RemoveShardFiles(prefix);
+}
+
+void TestRebalance(const char* prefix) {
+	RemoveShardFiles(prefix);
+	std::set<uint64_t> ref;
+	{
+		ShardedTreeSet set(prefix, shardCount);
+		// whole key range lands in first shard of even split
+		InsertParallel([&](uint64_t v) {set.insert(v); ref.insert(v);},
+				1, testValues, 0xFFFFF);
+		CHECK(set.ShardSize(0) == ref.size(), "skewed insert spread over shards");
+		CHECK(set.Rebalance(), "skewed shards were not rebalanced");
+		CHECK(!set.Rebalance(), "balanced shards were rebalanced");
+		for(uint64_t i=0; i<shardCount; ++i) {
+			const uint64_t expected = ref.size()/shardCount;
+			CHECK(set.ShardSize(i) >= expected && set.ShardSize(i) <= expected+1,
+					"shard %lu holds %lu after rebalance", i, set.ShardSize(i));
+		}
+		Verify("rebalanced", set, ref);
+		// repeated rebuilds must not grow shard files
+		const uint64_t bytes = ShardFilesSize(prefix);
+		for(uint64_t i=0; i<3; ++i)
+			CHECK(set.Rebalance(0), "forced rebalance was skipped");
+		CHECK(ShardFilesSize(prefix) <= bytes, "shard files grew from %lu to %lu "
+				"bytes", bytes, ShardFilesSize(prefix));
+		Verify("rebuilt", set, ref);
+		for(uint64_t i=0; i<testValues/10; ++i) {
+			const uint64_t v = Rand64() & 0xFFFFF;
+			CHECK(set.insert(v) == ref.insert(v).second, "rebalanced insert(%lu)", v);
+		}
+		Verify("rebalanced", set, ref);
+	}
+	{
+		ShardedTreeSet set(prefix);
+		Verify("rebalanced reopened", set, ref);
+	}
+	RemoveShardFiles(prefix);
+}
+
+void Benchmark() {
+	printf("\n\n insert %lu random values, hardware threads: %u",
+			benchmarkValues, std::thread::hardware_concurrency());
+	for(uint64_t threads : {1, 2, 4, 8}) {
+		const char* prefix = "sharded_bench";
+		RemoveShardFiles(prefix);
+		{
+			ShardedTreeSet set(prefix, shardCount);
+			double t = InsertParallel([&set](uint64_t v) {set.insert(v);},
+					threads, benchmarkValues);
+			printf("\n ShardedTreeSet (%lu shards)  threads: %lu %10.0f inserts/s",
+					shardCount, threads, benchmarkValues/t);
+		}
+		RemoveShardFiles(prefix);
+		
+		{
+			TreeSetFile::AllocatorType allocator("sharded_bench_single_mem.raw",
+					"sharded_bench_single_heap.raw");
+			TreeSetFile set(&allocator);
+			set.InitNewTree();
+			std::mutex mutex;
+			double t = InsertParallel([&](uint64_t v) {
+						std::lock_guard lock(mutex);
+						set.insert(v);
+					}, threads, benchmarkValues);
+			printf("\n TreeSetFile with mutex         threads: %lu %10.0f inserts/s",
+					threads, benchmarkValues/t);
+			set.DestroyTree();
+		}
+		std::remove("sharded_bench_single_mem.raw");
+		std::remove("sharded_bench_single_heap.raw");
+	}
+}
+
+int main() {
+	try {
+		TestCorrectness(ShardedTreeSet::RANGE, "range", "sharded_range");
+		TestCorrectness(ShardedTreeSet::HASH, "hash", "sharded_hash");
+		TestRebalance("sharded_rebalance");
+		Benchmark();
+		
+		if(errors)
+			printf("\n errors: %lu ... FAULT\n", errors.load());
+		else
+			printf("\n ... OK\n");
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "Debug.hpp"
+
+#include "SortedArrayFile.hpp"
+#include "StaticTreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <set>
+#include <vector>
+#include <algorithm>
+
+std::set<uint64_t> stdSet;
+
+uint64_t RandV() {
+	return Rand64()%987654321987llu;
+}
+
+uint64_t TestInsert(uint64_t elements, uint64_t threshold) {
+	uint64_t invalid = 0;
+	stdSet.clear();
+	SortedArrayFile set("sorted_array.raw", "sorted_array_delta.raw");
+	set.Build(stdSet.begin(), stdSet.end());
+	set.SetMergeThreshold(threshold);
+	for(uint64_t i=0; i<elements; ++i) {
+		uint64_t v = RandV()%(elements*4);
+		if(set.insert(v) != stdSet.insert(v).second)
+			++invalid;
+	}
+	if(set.size() != stdSet.size())
+		++invalid;
+	for(uint64_t i=0; i<elements; ++i) {
+		uint64_t v = RandV()%(elements*5), result;
+		auto it = stdSet.lower_bound(v);
+		bool found = set.find_ge(v, result);
+		if(found != (it!=stdSet.end()) || (found && *it != result))
+			++invalid;
+		it = stdSet.upper_bound(v);
+		found = set.find_le(v, result);
+		if(found != (it!=stdSet.begin()) || (found && *--it != result))
+			++invalid;
+		if(set.find(v) != (stdSet.count(v)!=0))
+			++invalid;
+	}
+	set.Close();
+	set.Open("sorted_array.raw", "sorted_array_delta.raw");
+	if(set.size() != stdSet.size())
+		++invalid;
+	set.Merge();
+	uint64_t i = 0;
+	for(uint64_t v : stdSet)
+		if(set.lower_bound(v) != i++)
+			++invalid;
+	return invalid;
+}
+
+void Test(uint64_t elements, uint64_t queries) {
+	printf("\n elements: %lu, queries: %lu", elements, queries);
+	stdSet.clear();
+	for(uint64_t i=0; i<elements; ++i)
+		stdSet.insert(RandV());
+	
+	std::vector<uint64_t> q(queries), expected(queries), result(queries);
+	for(auto& v : q)
+		v = RandV();
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = stdSet.lower_bound(q[i]);
+		expected[i] = it==stdSet.end() ? -1 : *it;
+	}
+	End();
+	printf("\n stdSet                     %10.0f lower_bound/s", queries/DeltaTime());
+	
+	uint64_t invalid = 0;
+	
+	StaticTreeSetFile staticSet("static_set.raw");
+	staticSet.Build(stdSet.begin(), stdSet.end());
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		if(!staticSet.find_ge(q[i], result[i]))
+			result[i] = -1;
+	}
+	End();
+	double staticTime = DeltaTime();
+	printf("\n StaticTreeSetFile::find_ge %10.0f lower_bound/s", queries/staticTime);
+	invalid += result != expected;
+	
+	SortedArrayFile set("sorted_array.raw", "sorted_array_delta.raw");
+	set.Build(stdSet.begin(), stdSet.end());
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		if(!set.find_ge(q[i], result[i]))
+			result[i] = -1;
+	}
+	End();
+	printf("\n SortedArrayFile::find_ge   %10.0f lower_bound/s (%.2fx)",
+			queries/DeltaTime(), staticTime/DeltaTime());
+	invalid += result != expected;
+	
+	std::vector<uint8_t> found(queries);
+	Start();
+	set.find_ge(q.data(), queries, result.data(), (bool*)found.data());
+	End();
+	printf("\n SortedArrayFile batched    %10.0f lower_bound/s (%.2fx)",
+			queries/DeltaTime(), staticTime/DeltaTime());
+	for(uint64_t i=0; i<queries; ++i)
+		if(!found[i])
+			result[i] = -1;
+	invalid += result != expected;
+	
+	if(invalid)
+		printf("\n invalid results ... FAULT\n");
+	else
+		printf("\n ... OK\n");
+}
+
+uint64_t TestEmptyMain(uint64_t elements, uint64_t queries) {
+	uint64_t invalid = 0;
+	stdSet.clear();
+	SortedArrayFile set("sorted_array.raw", "sorted_array_delta.raw");
+	set.Build(stdSet.begin(), stdSet.end());
+	set.SetMergeThreshold(elements+1);
+	for(uint64_t i=0; i<elements; ++i) {
+		uint64_t v = RandV()%(elements*4);
+		set.insert(v);
+		stdSet.insert(v);
+	}
+	// main array stays empty, all values are in delta
+	std::vector<uint64_t> q(queries), result(queries);
+	std::vector<uint8_t> found(queries);
+	for(uint64_t i=0; i<queries; ++i)
+		q[i] = RandV()%(elements*5+1);
+	set.find_ge(q.data(), queries, result.data(), (bool*)found.data());
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = stdSet.lower_bound(q[i]);
+		if((bool)found[i] != (it!=stdSet.end()) || (found[i] && *it != result[i]))
+			++invalid;
+	}
+	return invalid;
+}
+
+int main() {
+	try {
+		uint64_t invalid = TestInsert(100, 7) + TestInsert(100000, 1000)
+			+ TestEmptyMain(0, 100) + TestEmptyMain(100, 1000);
+		if(invalid)
+			printf("\n insert: %lu invalid results ... FAULT\n", invalid);
+		else
+			printf("\n insert ... OK\n");
+		Test(1000, 1000000);
+		Test(1000000, 4000000);
+		Test(8000000, 4000000);
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ *  This file is part of NoSqlDB.
+ *  Copyright (C) 2020 Marek Zalewski aka Drwalin
+ *
+ *  ICon3 is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  ICon3 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "Debug.hpp"
+
+#include "StaticTreeSetFile.hpp"
+
+#include <cstdio>
+#include <exception>
+
+#include <set>
+#include <vector>
+#include <algorithm>
+
+std::set<uint64_t> stdSet;
+
+uint64_t RandV() {
+	return Rand64()%987654321987llu;
+}
+
+void Test(uint64_t elements, uint64_t queries) {
+	printf("\n elements: %lu, queries: %lu", elements, queries);
+	stdSet.clear();
+	BlockAllocator<32> allocator("32byte_block_mem.raw", "32byte_heap.raw");
+	allocator.SetReservingBlocksCount(1024*1024);
+	TreeSetFile fileSet(&allocator);
+	fileSet.InitNewTree();
+	for(uint64_t i=0; i<elements; ++i) {
+		uint64_t v = RandV();
+		stdSet.insert(v);
+		fileSet.insert(v);
+	}
+	
+	std::vector<uint64_t> q(queries), expected(queries), result(queries);
+	for(auto& v : q)
+		v = RandV();
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = stdSet.lower_bound(q[i]);
+		expected[i] = it==stdSet.end() ? -1 : *it;
+	}
+	End();
+	printf("\n stdSet                     %10.0f lower_bound/s", queries/DeltaTime());
+	
+	uint64_t invalid = 0;
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = fileSet.find_ge(q[i]);
+		result[i] = it ? *it : -1;
+	}
+	End();
+	double treeTime = DeltaTime();
+	printf("\n TreeSetFile::find_ge       %10.0f lower_bound/s", queries/treeTime);
+	invalid += result != expected;
+	
+	fileSet.BuildFromSorted(stdSet.begin(), stdSet.end());
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = fileSet.find_ge(q[i]);
+		result[i] = it ? *it : -1;
+	}
+	End();
+	printf("\n balanced TreeSetFile       %10.0f lower_bound/s", queries/DeltaTime());
+	invalid += result != expected;
+	
+	StaticTreeSetFile staticSet("static_set.raw");
+	Start();
+	staticSet.Build(fileSet);
+	End();
+	printf("\n StaticTreeSetFile build    %10.0f elements/s", elements/DeltaTime());
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i) {
+		if(!staticSet.find_ge(q[i], result[i]))
+			result[i] = -1;
+	}
+	End();
+	printf("\n StaticTreeSetFile::find_ge %10.0f lower_bound/s (%.2fx faster)",
+			queries/DeltaTime(), treeTime/DeltaTime());
+	invalid += result != expected;
+	
+	for(uint64_t i=0; i<queries; ++i) {
+		auto it = stdSet.upper_bound(q[i]);
+		uint64_t v;
+		bool found = staticSet.find_le(q[i], v);
+		if(found != (it!=stdSet.begin()) || (found && *--it != v))
+			++invalid;
+		if(staticSet.find(q[i]) != (stdSet.count(q[i])!=0))
+			++invalid;
+	}
+	
+	fileSet.DestroyTree();
+	
+	if(invalid)
+		printf("\n invalid results ... FAULT\n");
+	else
+		printf("\n ... OK\n");
+}
+
+int main() {
+	try {
+		Test(1000, 1000000);
+		Test(1000000, 4000000);
+		Test(8000000, 4000000);
+	} catch(std::exception& e) {
+		printf("\n%s\n", e.what());
+	}
+	printf("\n");
+	return 0;
+}
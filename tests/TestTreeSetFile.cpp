@@ -28,6 +28,8 @@
 #include <map>
 #include <set>
 #include <vector>
+#include <algorithm>
+#include <random>
 
 std::map<uint64_t, int64_t> allocated, full;
 
@@ -53,7 +55,8 @@ uint64_t RandV() {
 
 std::set<uint64_t> stdSet, temp;
 
-void Cmp(TreeSetFile& fileSet) {
+template<typename Set>
+void Cmp(Set& fileSet) {
 	bool equal = true;
 	auto a = stdSet.begin();
 	auto b = fileSet.begin();
@@ -71,7 +74,8 @@ void Cmp(TreeSetFile& fileSet) {
 		printf("\n   ... OK\n");
 }
 
-void Test(TreeSetFile& fileSet, uint64_t make, uint64_t remove) {
+template<typename Set>
+void Test(Set& fileSet, uint64_t make, uint64_t remove) {
 	std::vector<uint64_t> push, pop;
 	push.resize(make);
 	pop.resize(remove);
@@ -130,6 +134,114 @@ void Test(TreeSetFile& fileSet, uint64_t make, uint64_t remove) {
 	Cmp(fileSet);
 }
 
+template<typename Set>
+void TestCursor(Set& fileSet, uint64_t queries) {
+	uint64_t invalid = 0;
+	typename Set::Cursor cursor(&fileSet);
+	
+	uint64_t sum = 0, sum2 = 0;
+	Start();
+	for(auto it = fileSet.begin(); it; ++it)
+		sum += *it;
+	End();
+	printf("\n Iterator %.0f next/s", fileSet.size()/DeltaTime());
+	Start();
+	for(bool valid=cursor.first(); valid; valid=cursor.next())
+		sum2 += cursor.value();
+	End();
+	printf("\n Cursor   %.0f next/s", fileSet.size()/DeltaTime());
+	if(sum != sum2)
+		++invalid;
+	
+	auto a = stdSet.rbegin();
+	for(bool valid=cursor.last(); valid; valid=cursor.prev(), ++a) {
+		if(a == stdSet.rend() || *a != cursor.value()) {
+			++invalid;
+			break;
+		}
+	}
+	
+	for(uint64_t i=0; i<queries; ++i) {
+		uint64_t v = RandV();
+		auto ge = stdSet.lower_bound(v);
+		bool valid = cursor.seek(v);
+		for(int j=0; j<4; ++j) {
+			if(valid != (ge!=stdSet.end()) || (valid && *ge != cursor.value()))
+				++invalid;
+			if(ge == stdSet.end())
+				break;
+			++ge;
+			valid = cursor.next();
+		}
+		
+		auto le = stdSet.upper_bound(v);
+		valid = cursor.seek_le(v);
+		for(int j=0; j<4; ++j) {
+			if(valid != (le!=stdSet.begin()))
+				++invalid;
+			if(le == stdSet.begin())
+				break;
+			--le;
+			if(*le != cursor.value())
+				++invalid;
+			valid = cursor.prev();
+		}
+	}
+	
+	if(invalid)
+		printf("\n invalid cursor steps: %lu ... FAULT\n", invalid);
+	else
+		printf("\n cursor ... OK\n");
+}
+
+template<typename Set>
+void TestFindMany(Set& fileSet, uint64_t queries) {
+	std::vector<uint64_t> existing(stdSet.begin(), stdSet.end()), values(queries);
+	std::vector<typename Set::Iterator> found(queries), foundMany(queries);
+	for(auto& v : values)
+		v = Rand64()%2 ? RandV() : existing[Rand64()%existing.size()];
+	
+	Start();
+	for(uint64_t i=0; i<queries; ++i)
+		found[i] = fileSet.find(values[i]);
+	End();
+	double time = DeltaTime();
+	printf("\n find      %.0f lookups/s", queries/time);
+	Start();
+	fileSet.find_many(values, foundMany);
+	End();
+	printf("\n find_many %.0f lookups/s (%.2fx)", queries/DeltaTime(),
+			time/DeltaTime());
+	
+	if(found != foundMany)
+		printf("\n find_many ... FAULT\n");
+	else
+		printf("\n find_many ... OK\n");
+}
+
+template<typename Set>
+void TestBuildFromSorted(Set& fileSet) {
+	// inserting sorted values would degenerate unbalanced tree
+	std::vector<uint64_t> values(stdSet.begin(), stdSet.end());
+	std::mt19937_64 rd;
+	std::shuffle(values.begin(), values.end(), rd);
+	fileSet.DestroyTree();
+	fileSet.InitNewTree();
+	Start();
+	for(auto v : values)
+		fileSet.insert(v);
+	End();
+	printf("\n fileSet %.0f insert/s", values.size()/DeltaTime());
+	
+	Start();
+	fileSet.BuildFromSorted(stdSet.begin(), stdSet.end());
+	End();
+	printf("\n fileSet %.0f BuildFromSorted/s", stdSet.size()/DeltaTime());
+	printf("\n size: %lu\n height: %lu (optimal: %.0f)", fileSet.size(),
+			fileSet.root().Height(), ceil(log2(fileSet.size()+1)));
+	Cmp(fileSet);
+}
+
 int main() {
 	try {
 		BlockAllocator<32> allocator("32byte_block_mem.raw", "32byte_heap.raw");
@@ -145,8 +257,38 @@ int main() {
 		Test(fileSet, 118235, 235731);
 		Test(fileSet, 122574, 2331);
 		Test(fileSet, 145277, 75435642);
+		TestCursor(fileSet, 100000);
+		TestFindMany(fileSet, 1000000);
+		
+		fileSet.DestroyTree();
 		
+		// degenerated tree deeper than cursor stack
+		printf("\n\n Degenerated tree:\n");
+		fileSet.InitNewTree();
+		stdSet.clear();
+		for(uint64_t i=0; i<1000; ++i) {
+			fileSet.insert(i*1000000);
+			stdSet.insert(i*1000000);
+		}
+		TestCursor(fileSet, 1000);
 		fileSet.DestroyTree();
+		
+		printf("\n\n CompactTreeSetFile (%lu bytes per node):\n",
+				sizeof(CompactTreeSetFile::Block));
+		stdSet.clear();
+		CompactTreeSetFile::AllocatorType compactAllocator("24byte_block_mem.raw",
+				"24byte_heap.raw");
+		compactAllocator.SetReservingBlocksCount(1024*8192);
+		CompactTreeSetFile compactSet(&compactAllocator);
+		compactSet.InitNewTree();
+		
+		Test(compactSet, 447327, 276831);
+		Test(compactSet, 154723, 276831);
+		Test(compactSet, 125543, 22731);
+		TestBuildFromSorted(compactSet);
+		TestFindMany(compactSet, 1000000);
+		
+		compactSet.DestroyTree();
 	} catch(std::exception& e) {
 		printf("\n%s\n", e.what());
 	}